@@ -0,0 +1,43 @@
+# -------------------------------------------------
+# Headless batch waveform image renderer
+# -------------------------------------------------
+TARGET = waveformbatch
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+INCLUDEPATH += /usr/include
+QMAKE_CXXFLAGS += -std=c++11
+SOURCES += main.cpp \
+    ../../src/WaveformRenderer.cpp \
+    ../../src/AudioUtil.cpp \
+    ../../src/PerfStats.cpp \
+    ../../src/SeekIndex.cpp \
+    ../../src/ChunkedSampleBuffer.cpp \
+    ../../src/CompressedSampleBuffer.cpp \
+    ../../src/KWeightingFilter.cpp \
+    ../../src/SpectrogramTileCache.cpp \
+    ../../src/MemoryAccount.cpp \
+    ../../src/EventIndex.cpp \
+    ../../src/AudioSource.cpp \
+    ../../src/AudioProbe.cpp \
+    ../../src/EditList.cpp \
+    ../../src/FileReadHints.cpp
+HEADERS += ../../src/MathUtil.h \
+    ../../src/AudioUtil.h \
+    ../../src/WaveformRenderer.h \
+    ../../src/PerfStats.h \
+    ../../src/SeekIndex.h \
+    ../../src/ChunkedSampleBuffer.h \
+    ../../src/CompressedSampleBuffer.h \
+    ../../src/KWeightingFilter.h \
+    ../../src/SpectrogramTileCache.h \
+    ../../src/SampleKernels.h \
+    ../../src/PeakCodes.h \
+    ../../src/MemoryAccount.h \
+    ../../src/EventIndex.h \
+    ../../src/AudioSource.h \
+    ../../src/AudioProbe.h \
+    ../../src/EditList.h \
+    ../../src/FileReadHints.h
+LIBS += -lsndfile \
+    -L/usr/lib
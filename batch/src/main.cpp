@@ -0,0 +1,371 @@
+#include <QCoreApplication>
+#include <QImage>
+#include <QPainter>
+#include <QColor>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../src/AudioUtil.h"
+#include "../../src/AudioProbe.h"
+#include "../../src/WaveformRenderer.h"
+#include "../../src/PerfStats.h"
+
+/*
+  waveformbatch -- renders PNG waveform images for a list of audio files without a display.
+
+  Every file is rendered by its own job on a thread pool.  A job opens its file with an AudioUtil
+  in DISK_MODE, so a worker never holds more than one read block (SEEK_INDEX_BLOCK_FRAMES frames)
+  of audio plus one peak value per output column, whatever the length of the file.  Files short
+  enough to be drawn sample by sample are read whole, but those are by definition small.
+*/
+
+using namespace std;
+
+struct BatchOptions
+{
+    vector<QSize> sizes;
+    QColor color;
+    QColor background;
+    string outputDir;
+};
+
+struct BatchTotals
+{
+    QAtomicInt rendered;
+    QAtomicInt failed;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: waveformbatch [options] [file ...]\n"
+            "  -s WxH        image size; may be given several times (default 800x200)\n"
+            "  -c COLOR      waveform color, any name QColor understands (default blue)\n"
+            "  -b COLOR      background color (default transparent)\n"
+            "  -o DIR        output directory (default .)\n"
+            "  -l FILE       read input paths from FILE, one per line (\"-\" for stdin);\n"
+            "                a line of the form \"input<TAB>output.png\" sets the output path\n"
+            "  -j N          number of worker threads (default: number of cores, or 16 with -i)\n"
+            "  -t FILE       write a Chrome trace of the run to FILE (profiling builds only)\n"
+            "  -i            print channels, sample rate and length of every file instead of rendering\n"
+            "  -k FILE       with -i, keep the results in FILE so unchanged files are not read again\n");
+}
+
+/* Splits "path.png" into "path" and ".png" so that a size suffix can be inserted. */
+static string withSizeSuffix(const string &path, const QSize &size)
+{
+    char suffix[64];
+    sprintf(suffix, "_%dx%d", size.width(), size.height());
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if(dot == string::npos || (slash != string::npos && dot < slash))
+    {
+        return path + suffix;
+    }
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+static string defaultOutputPath(const string &inputPath, const string &outputDir)
+{
+    size_t slash = inputPath.rfind('/');
+    string base = (slash == string::npos) ? inputPath : inputPath.substr(slash + 1);
+    size_t dot = base.rfind('.');
+    if(dot != string::npos && dot > 0)
+    {
+        base = base.substr(0, dot);
+    }
+    return outputDir + "/" + base + ".png";
+}
+
+/*
+  Renders one input file at every requested size.
+*/
+class RenderJob : public QRunnable
+{
+public:
+    RenderJob(string inputPath, string outputPath, const BatchOptions *options, BatchTotals *totals)
+    {
+        this->inputPath = inputPath;
+        this->outputPath = outputPath;
+        this->options = options;
+        this->totals = totals;
+    }
+
+    void run()
+    {
+        PERF_SCOPE("waveformbatch::renderFile");
+
+        AudioUtil audioFile;
+        audioFile.setFileHandlingMode(AudioUtil::DISK_MODE);
+        audioFile.setReadHints(true);
+        if(!audioFile.setFile(this->inputPath))
+        {
+            this->totals->failed.ref();
+            return;
+        }
+
+        bool ok = true;
+        for(size_t i = 0; i < this->options->sizes.size(); i++)
+        {
+            QSize size = this->options->sizes[i];
+            string path = (this->options->sizes.size() == 1) ? this->outputPath : withSizeSuffix(this->outputPath, size);
+
+            QImage image(size, QImage::Format_ARGB32);
+            image.fill(this->options->background.rgba());
+
+            WaveformRenderer renderer(&audioFile);
+            renderer.setSize(size);
+            renderer.setColor(this->options->color);
+
+            QPainter painter(&image);
+            renderer.render(&painter, QRect(0, 0, size.width(), size.height()));
+            painter.end();
+
+            if(!image.save(QString::fromStdString(path), "PNG"))
+            {
+                fprintf(stderr, "failed to write image \"%s\".\n", path.c_str());
+                ok = false;
+            }
+        }
+
+        if(ok)
+            this->totals->rendered.ref();
+        else
+            this->totals->failed.ref();
+    }
+
+private:
+    string inputPath;
+    string outputPath;
+    const BatchOptions *options;
+    BatchTotals *totals;
+};
+
+/*
+  Prints one line per input: path, channels, sample rate, frames and seconds, tab separated.  Unreadable files
+  get zeros.
+*/
+static int printInfo(const vector<string> &inputs, int threads, const string &cachePath)
+{
+    AudioProbe probe;
+    probe.setMaxThreads(threads);
+    if(!cachePath.empty())
+    {
+        probe.setCaching(true);
+        probe.loadCache(cachePath);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    vector<AudioFileInfo> table = probe.probe(inputs);
+    double seconds = timer.elapsed() / 1000.0;
+
+    int failed = 0;
+    for(size_t i = 0; i < inputs.size(); i++)
+    {
+        const AudioFileInfo &info = table[i];
+        if(info.format == 0)
+        {
+            failed++;
+        }
+        printf("%s\t%d\t%d\t%lld\t%.3f\n", inputs[i].c_str(), info.channels, info.sampleRate,
+               (long long) info.frames, info.sampleRate > 0 ? (double) info.frames / info.sampleRate : 0.0);
+    }
+    fprintf(stderr, "%d files probed, %d failed, %.2f s on %d threads (%.1f files/s)\n",
+            (int) inputs.size() - failed, failed, seconds, probe.getMaxThreads(),
+            seconds > 0.0 ? inputs.size() / seconds : 0.0);
+
+    if(!cachePath.empty())
+    {
+        probe.saveCache(cachePath);
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+/* Reads input paths (and optional output paths after a tab) from a list file. */
+static bool readList(const string &listPath, vector<string> &inputs, vector<string> &outputs)
+{
+    ifstream file;
+    istream *in = &cin;
+    if(listPath != "-")
+    {
+        file.open(listPath.c_str());
+        if(!file)
+        {
+            fprintf(stderr, "failed to open list file \"%s\".\n", listPath.c_str());
+            return false;
+        }
+        in = &file;
+    }
+
+    string line;
+    while(getline(*in, line))
+    {
+        if(!line.empty() && line[line.size() - 1] == '\r')
+        {
+            line.erase(line.size() - 1);
+        }
+        if(line.empty())
+        {
+            continue;
+        }
+        size_t tab = line.find('\t');
+        if(tab == string::npos)
+        {
+            inputs.push_back(line);
+            outputs.push_back(string());
+        }
+        else
+        {
+            inputs.push_back(line.substr(0, tab));
+            outputs.push_back(line.substr(tab + 1));
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    BatchOptions options;
+    options.color = QColor(Qt::blue);
+    options.background = QColor(Qt::transparent);
+    options.outputDir = ".";
+
+    vector<string> inputs;
+    vector<string> outputs;
+    int threads = QThread::idealThreadCount();
+    bool threadsGiven = false;
+    string tracePath;
+    string probeCachePath;
+    bool infoOnly = false;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(strcmp(argv[i], "-s") == 0 && hasValue)
+        {
+            int w = 0, h = 0;
+            if(sscanf(argv[++i], "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+            {
+                fprintf(stderr, "invalid size \"%s\".\n", argv[i]);
+                return 2;
+            }
+            options.sizes.push_back(QSize(w, h));
+        }
+        else if(strcmp(argv[i], "-c") == 0 && hasValue)
+        {
+            options.color = QColor(QString(argv[++i]));
+        }
+        else if(strcmp(argv[i], "-b") == 0 && hasValue)
+        {
+            options.background = QColor(QString(argv[++i]));
+        }
+        else if(strcmp(argv[i], "-o") == 0 && hasValue)
+        {
+            options.outputDir = argv[++i];
+        }
+        else if(strcmp(argv[i], "-l") == 0 && hasValue)
+        {
+            if(!readList(argv[++i], inputs, outputs))
+                return 2;
+        }
+        else if(strcmp(argv[i], "-j") == 0 && hasValue)
+        {
+            threads = atoi(argv[++i]);
+            threadsGiven = true;
+        }
+        else if(strcmp(argv[i], "-t") == 0 && hasValue)
+        {
+            tracePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "-i") == 0)
+        {
+            infoOnly = true;
+        }
+        else if(strcmp(argv[i], "-k") == 0 && hasValue)
+        {
+            probeCachePath = argv[++i];
+        }
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+            outputs.push_back(string());
+        }
+    }
+
+    if(inputs.empty())
+    {
+        usage();
+        return 2;
+    }
+    if(infoOnly)
+    {
+        return printInfo(inputs, threadsGiven ? threads : DEFAULT_PROBE_THREADS, probeCachePath);
+    }
+    if(!options.color.isValid() || !options.background.isValid())
+    {
+        fprintf(stderr, "invalid color.\n");
+        return 2;
+    }
+    if(options.sizes.empty())
+    {
+        options.sizes.push_back(QSize(800, 200));
+    }
+    if(threads < 1)
+    {
+        threads = 1;
+    }
+    if(!tracePath.empty())
+    {
+        if(!PerfStats::isCompiledIn())
+            fprintf(stderr, "warning: built without WAVEFORM_PROFILING, the trace will be empty.\n");
+        PerfStats::setTraceEnabled(true);
+    }
+
+    BatchTotals totals;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for(size_t i = 0; i < inputs.size(); i++)
+    {
+        string outputPath = outputs[i].empty() ? defaultOutputPath(inputs[i], options.outputDir) : outputs[i];
+        pool.start(new RenderJob(inputs[i], outputPath, &options, &totals));
+    }
+    pool.waitForDone();
+
+    double seconds = timer.elapsed() / 1000.0;
+    int rendered = totals.rendered.fetchAndAddOrdered(0);
+    int failed = totals.failed.fetchAndAddOrdered(0);
+    fprintf(stderr, "%d files rendered, %d failed, %.2f s on %d threads (%.1f files/s)\n",
+            rendered, failed, seconds, threads, seconds > 0.0 ? (rendered + failed) / seconds : 0.0);
+
+    if(!tracePath.empty())
+    {
+        PerfStats::writeChromeTrace(tracePath);
+    }
+
+    return failed == 0 ? 0 : 1;
+}
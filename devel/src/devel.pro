@@ -4,14 +4,53 @@
 TARGET = WaveformViewerDevel
 TEMPLATE = app
 INCLUDEPATH += /usr/include
+QMAKE_CXXFLAGS += -std=c++11
 SOURCES += main.cpp \
     mainwindow.cpp \
     ../../src/WaveformWidget.cpp \
-    ../../src/AudioUtil.cpp
+    ../../src/WaveformRenderer.cpp \
+    ../../src/AudioUtil.cpp \
+    ../../src/PerfStats.cpp \
+    ../../src/SeekIndex.cpp \
+    ../../src/ChunkedSampleBuffer.cpp \
+    ../../src/CompressedSampleBuffer.cpp \
+    ../../src/KWeightingFilter.cpp \
+    ../../src/SpectrogramTileCache.cpp \
+    ../../src/WaveformListWidget.cpp \
+    ../../src/SampleRing.cpp \
+    ../../src/LiveAudioSource.cpp \
+    ../../src/LiveWaveformWidget.cpp \
+    ../../src/MemoryAccount.cpp \
+    ../../src/EventIndex.cpp \
+    ../../src/AudioSource.cpp \
+    ../../src/AudioProbe.cpp \
+    ../../src/WaveformOverviewWidget.cpp \
+    ../../src/EditList.cpp \
+    ../../src/FileReadHints.cpp
 HEADERS += mainwindow.h \
     ../../src/MathUtil.h \
     ../../src/AudioUtil.h \
     ../../src/WaveformWidget.h \
+    ../../src/WaveformRenderer.h \
+    ../../src/PerfStats.h \
+    ../../src/SeekIndex.h \
+    ../../src/ChunkedSampleBuffer.h \
+    ../../src/CompressedSampleBuffer.h \
+    ../../src/KWeightingFilter.h \
+    ../../src/SpectrogramTileCache.h \
+    ../../src/WaveformListWidget.h \
+    ../../src/SampleKernels.h \
+    ../../src/SampleRing.h \
+    ../../src/LiveAudioSource.h \
+    ../../src/LiveWaveformWidget.h \
+    ../../src/PeakCodes.h \
+    ../../src/MemoryAccount.h \
+    ../../src/EventIndex.h \
+    ../../src/AudioSource.h \
+    ../../src/AudioProbe.h \
+    ../../src/WaveformOverviewWidget.h \
+    ../../src/EditList.h \
+    ../../src/FileReadHints.h \
     ../../src/AudioUtil.h
 LIBS += -lsndfile \
     -L/usr/lib
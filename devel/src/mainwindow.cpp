@@ -20,12 +20,16 @@ MainWindow::MainWindow()
 
     layout->addWidget(scrollArea, 0, 0, 12, 12);
 
+    overviewWidget = new WaveformOverviewWidget(waveformWidget, this);
+    overviewWidget->setMinimumHeight(40);
+    layout->addWidget(overviewWidget, 12, 0, 1, 12);
+
     zoomInButton = new QPushButton("zoom in", this);
     zoomOutButton = new QPushButton("zoom out", this);
     setFileButton = new QPushButton("set source", this);
-    layout->addWidget(zoomInButton, 12,3,1,2 );
-    layout->addWidget(zoomOutButton, 12, 5, 1, 2);
-    layout->addWidget(setFileButton, 12, 7, 1, 2);
+    layout->addWidget(zoomInButton, 13,3,1,2 );
+    layout->addWidget(zoomOutButton, 13, 5, 1, 2);
+    layout->addWidget(setFileButton, 13, 7, 1, 2);
 
 
 
@@ -54,6 +58,7 @@ void MainWindow::setSourceClicked()
 
 MainWindow::~MainWindow()
 {
+    delete overviewWidget;
     delete waveformWidget;
 }
 
@@ -10,6 +10,7 @@
 #include <QMenu>
 
 #include "../../src/WaveformWidget.h"
+#include "../../src/WaveformOverviewWidget.h"
 
 class MainWindow : public QWidget
 {
@@ -24,6 +25,7 @@ public:
     QPushButton *setFileButton;
     void resizeEvent(QResizeEvent * );
     WaveformWidget *waveformWidget;
+    WaveformOverviewWidget *overviewWidget;
 
 
 public slots:
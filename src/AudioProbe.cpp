@@ -0,0 +1,310 @@
+#include "AudioProbe.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <thread>
+
+/*!
+\file AudioProbe.cpp
+\brief AudioProbe implementation file.
+*/
+
+#define PROBE_CACHE_MAGIC "WFPRB002"
+
+/*!
+\brief Constructs a probe with DEFAULT_PROBE_THREADS threads and caching off.
+*/
+AudioProbe::AudioProbe()
+{
+    this->maxThreads = DEFAULT_PROBE_THREADS;
+    this->caching = false;
+}
+
+/*!
+\brief Sets the number of files read at the same time.
+@param threads Number of threads; values below 1 are taken as 1.
+*/
+void AudioProbe::setMaxThreads(int threads)
+{
+    this->maxThreads = max(1, threads);
+}
+
+/*!
+\brief Returns the number of files read at the same time.
+*/
+int AudioProbe::getMaxThreads()
+{
+    return this->maxThreads;
+}
+
+/*!
+\brief Turns the cache of results on or off.  Turning it off does not clear it.
+*/
+void AudioProbe::setCaching(bool enabled)
+{
+    this->caching = enabled;
+}
+
+/*!
+\brief Whether results are cached.
+*/
+bool AudioProbe::getCaching()
+{
+    return this->caching;
+}
+
+/*!
+\brief Reads the headers of a list of files.
+@param paths Paths of the files.
+@return one entry per path, in the same order.  Files that could not be read have a format of 0.
+*/
+vector<AudioFileInfo> AudioProbe::probe(const vector<string> &paths)
+{
+    PERF_SCOPE("AudioProbe::probe");
+
+    vector<AudioFileInfo> table(paths.size());
+    std::atomic<size_t> next(0);
+    int numThreads = (int) min((size_t) this->maxThreads, paths.size());
+
+    vector<std::thread> workers;
+    for(int t = 1; t < numThreads; t++)
+    {
+        workers.push_back(std::thread(&AudioProbe::probeNext, this, &paths, &table, &next));
+    }
+    this->probeNext(&paths, &table, &next);
+    for(size_t t = 0; t < workers.size(); t++)
+    {
+        workers[t].join();
+    }
+    return table;
+}
+
+/*!
+\brief Reads the header of one file, without the cache.
+@param path Path of the file.
+@param info Filled in with the layout of the file, or with zeros if it could not be read.
+@return true if the file could be read.
+*/
+bool AudioProbe::probeFile(string path, AudioFileInfo *info)
+{
+    PERF_SCOPE("AudioProbe::probeFile");
+
+    memset(info, 0, sizeof(*info));
+    SF_INFO sfinfo;
+    sfinfo.format = 0;
+    SNDFILE *sndFile = sf_open(path.c_str(), SFM_READ, &sfinfo);
+    if(sndFile == NULL)
+    {
+        return false;
+    }
+    sf_close(sndFile);
+
+    info->frames = sfinfo.frames;
+    info->channels = sfinfo.channels;
+    info->sampleRate = sfinfo.samplerate;
+    info->format = sfinfo.format;
+    return true;
+}
+
+/*!
+\brief Number of files in the cache.
+*/
+size_t AudioProbe::getCacheSize()
+{
+    std::lock_guard<std::mutex> guard(this->cacheMutex);
+    return this->cache.size();
+}
+
+/*!
+\brief Forgets every cached result.
+*/
+void AudioProbe::clearCache()
+{
+    std::lock_guard<std::mutex> guard(this->cacheMutex);
+    this->cache.clear();
+}
+
+/*!
+\brief Writes the cache to a file.
+@param cachePath Destination path.
+@return true on success.
+*/
+bool AudioProbe::saveCache(string cachePath)
+{
+    FILE *out = fopen(cachePath.c_str(), "wb");
+    if(out == NULL)
+    {
+        fprintf(stderr, "failed to write probe cache \"%s\".\n", cachePath.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(this->cacheMutex);
+    long long numEntries = (long long) this->cache.size();
+    bool ok = fwrite(PROBE_CACHE_MAGIC, 1, 8, out) == 8
+            && fwrite(&numEntries, sizeof(numEntries), 1, out) == 1;
+    for(map<string, CacheEntry>::iterator it = this->cache.begin(); ok && it != this->cache.end(); ++it)
+    {
+        ok = writeEntry(out, it->first, it->second);
+    }
+    fclose(out);
+
+    if(!ok)
+    {
+        fprintf(stderr, "failed to write probe cache \"%s\".\n", cachePath.c_str());
+        remove(cachePath.c_str());
+    }
+    return ok;
+}
+
+/*!
+\brief Adds the results saved by saveCache() to the cache.  Stale entries are harmless: they are checked against
+the file before being used.
+@param cachePath Path of the cache file.
+@return true if the file was read completely.
+*/
+bool AudioProbe::loadCache(string cachePath)
+{
+    FILE *in = fopen(cachePath.c_str(), "rb");
+    if(in == NULL)
+    {
+        return false;
+    }
+
+    char magic[8];
+    long long numEntries = 0;
+    bool ok = fread(magic, 1, 8, in) == 8 && memcmp(magic, PROBE_CACHE_MAGIC, 8) == 0
+            && fread(&numEntries, sizeof(numEntries), 1, in) == 1 && numEntries >= 0;
+
+    map<string, CacheEntry> entries;
+    string path;
+    for(long long i = 0; ok && i < numEntries; i++)
+    {
+        CacheEntry entry;
+        ok = readEntry(in, &path, &entry);
+        if(ok)
+        {
+            entries[path] = entry;
+        }
+    }
+    fclose(in);
+
+    if(!ok)
+    {
+        fprintf(stderr, "probe cache \"%s\" is damaged; ignored.\n", cachePath.c_str());
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(this->cacheMutex);
+    for(map<string, CacheEntry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        this->cache[it->first] = it->second;
+    }
+    return true;
+}
+
+/*
+ * Fills in the identity of a file: the fields a rewrite is bound to change.
+ */
+void AudioProbe::identify(const struct stat &fileStat, CacheEntry *entry)
+{
+    entry->fileSize = fileStat.st_size;
+    entry->inode = fileStat.st_ino;
+    entry->modificationTime = fileStat.st_mtime;
+#if defined(__APPLE__)
+    entry->modificationNanoseconds = fileStat.st_mtimespec.tv_nsec;
+#else
+    entry->modificationNanoseconds = fileStat.st_mtim.tv_nsec;
+#endif
+}
+
+/*
+ * Writes one cache entry field by field, so that the file does not depend on the layout of the
+ * structs: the path with its length, then the identity and the result.
+ */
+bool AudioProbe::writeEntry(FILE *out, const string &path, const CacheEntry &entry)
+{
+    int length = (int) path.size();
+    long long identity[4] = {entry.fileSize, entry.inode, entry.modificationTime, entry.modificationNanoseconds};
+    long long frames = entry.info.frames;
+    int layout[3] = {entry.info.channels, entry.info.sampleRate, entry.info.format};
+    return fwrite(&length, sizeof(length), 1, out) == 1
+        && fwrite(path.data(), 1, length, out) == (size_t) length
+        && fwrite(identity, sizeof(identity), 1, out) == 1
+        && fwrite(&frames, sizeof(frames), 1, out) == 1
+        && fwrite(layout, sizeof(layout), 1, out) == 1;
+}
+
+/*
+ * Reads an entry written by writeEntry().
+ */
+bool AudioProbe::readEntry(FILE *in, string *path, CacheEntry *entry)
+{
+    int length = 0;
+    if(fread(&length, sizeof(length), 1, in) != 1 || length < 0 || length > 65536)
+    {
+        return false;
+    }
+    path->resize(length);
+    long long identity[4];
+    long long frames;
+    int layout[3];
+    if((length > 0 && fread(&(*path)[0], 1, length, in) != (size_t) length)
+            || fread(identity, sizeof(identity), 1, in) != 1
+            || fread(&frames, sizeof(frames), 1, in) != 1
+            || fread(layout, sizeof(layout), 1, in) != 1)
+    {
+        return false;
+    }
+    entry->fileSize = identity[0];
+    entry->inode = identity[1];
+    entry->modificationTime = identity[2];
+    entry->modificationNanoseconds = identity[3];
+    entry->info.frames = frames;
+    entry->info.channels = layout[0];
+    entry->info.sampleRate = layout[1];
+    entry->info.format = layout[2];
+    return true;
+}
+
+/*
+ * Run by every thread of probe(): takes the next unprobed path until there are none left.
+ */
+void AudioProbe::probeNext(const vector<string> *paths, vector<AudioFileInfo> *table, std::atomic<size_t> *next)
+{
+    bool useCache = this->caching;
+    size_t i;
+    while((i = next->fetch_add(1)) < paths->size())
+    {
+        const string &path = (*paths)[i];
+        struct stat fileStat;
+        bool identified = useCache && stat(path.c_str(), &fileStat) == 0;
+        if(identified)
+        {
+            std::lock_guard<std::mutex> guard(this->cacheMutex);
+            CacheEntry current;
+            identify(fileStat, &current);
+            map<string, CacheEntry>::iterator it = this->cache.find(path);
+            if(it != this->cache.end() && it->second.fileSize == current.fileSize && it->second.inode == current.inode
+                    && it->second.modificationTime == current.modificationTime
+                    && it->second.modificationNanoseconds == current.modificationNanoseconds)
+            {
+                PERF_COUNT("AudioProbe::cacheHit");
+                (*table)[i] = it->second.info;
+                continue;
+            }
+        }
+
+        probeFile(path, &(*table)[i]);
+
+        if(identified)
+        {
+            CacheEntry entry;
+            identify(fileStat, &entry);
+            entry.info = (*table)[i];
+            std::lock_guard<std::mutex> guard(this->cacheMutex);
+            this->cache[path] = entry;
+        }
+    }
+}
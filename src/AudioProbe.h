@@ -0,0 +1,89 @@
+#ifndef AUDIOPROBE_H
+#define AUDIOPROBE_H
+
+#include <sndfile.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "PerfStats.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*!
+    \file AudioProbe.h
+    \brief AudioProbe header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of files an AudioProbe reads at the same time unless set otherwise.  Reading a header mostly waits on
+the disk, so this is more than the number of cores of most machines.
+*/
+#define DEFAULT_PROBE_THREADS 16
+
+/*!
+\brief The layout of one audio file, as read from its header by AudioProbe.
+*/
+struct AudioFileInfo
+{
+    sf_count_t frames;  /*!< Length, in frames. */
+    int channels;       /*!< Number of channels. */
+    int sampleRate;     /*!< Sample rate, in Hz. */
+    int format;         /*!< libsndfile format code, or 0 if the file could not be read. */
+};
+
+/*!
+\brief Reads the headers of many audio files at once, for file browsers and library scans.
+
+probe() takes a list of paths and returns one AudioFileInfo per path, in the same order.  The headers are read by up
+to getMaxThreads() threads, each opening one file at a time with libsndfile and closing it as soon as the header is
+read, so a scan holds no more than that many files open and never keeps a decoder around as an AudioUtil would.
+
+With caching on, results are remembered by path together with the size, inode and modification time (to the
+nanosecond where the system records it) of the file, and a
+later probe of an unchanged file only costs a stat().  The cache can be saved to and loaded from a file, so that a
+library is only read once across sessions.  probe() and the cache functions may be called from several threads.
+*/
+class AudioProbe
+{
+public:
+    AudioProbe();
+    void setMaxThreads(int threads);
+    int getMaxThreads();
+    void setCaching(bool enabled);
+    bool getCaching();
+    vector<AudioFileInfo> probe(const vector<string> &paths);
+    static bool probeFile(string path, AudioFileInfo *info);
+    size_t getCacheSize();
+    void clearCache();
+    bool saveCache(string cachePath);
+    bool loadCache(string cachePath);
+
+private:
+    /* A cached result and the identity of the file it was read from. */
+    struct CacheEntry
+    {
+        long long fileSize;
+        long long inode;
+        long long modificationTime;
+        long long modificationNanoseconds;
+        AudioFileInfo info;
+    };
+
+    std::atomic<int> maxThreads;
+    std::atomic<bool> caching;
+    std::mutex cacheMutex;
+    map<string, CacheEntry> cache;
+
+    static void identify(const struct stat &fileStat, CacheEntry *entry);
+    static bool writeEntry(FILE *out, const string &path, const CacheEntry &entry);
+    static bool readEntry(FILE *in, string *path, CacheEntry *entry);
+    void probeNext(const vector<string> *paths, vector<AudioFileInfo> *table, std::atomic<size_t> *next);
+};
+
+#endif // AUDIOPROBE_H
@@ -0,0 +1,121 @@
+#include "AudioSource.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+/*!
+\file AudioSource.cpp
+\brief AudioSource implementation file.
+*/
+
+static sf_count_t cursorLength(void *userData)
+{
+    AudioSourceCursor *cursor = (AudioSourceCursor *) userData;
+    return cursor->source->getSize();
+}
+
+static sf_count_t cursorSeek(sf_count_t offset, int whence, void *userData)
+{
+    AudioSourceCursor *cursor = (AudioSourceCursor *) userData;
+    sf_count_t position = offset;
+    if(whence == SEEK_CUR)
+    {
+        position += cursor->position;
+    }
+    else if(whence == SEEK_END)
+    {
+        position += cursor->source->getSize();
+    }
+    if(position < 0)
+    {
+        return -1;
+    }
+    cursor->position = position;
+    return position;
+}
+
+static sf_count_t cursorRead(void *buffer, sf_count_t count, void *userData)
+{
+    AudioSourceCursor *cursor = (AudioSourceCursor *) userData;
+    sf_count_t n = cursor->source->read(cursor->position, buffer, count);
+    if(n <= 0)
+    {
+        return 0;
+    }
+    cursor->position += n;
+    return n;
+}
+
+static sf_count_t cursorWrite(const void *buffer, sf_count_t count, void *userData)
+{
+    (void) buffer;
+    (void) count;
+    (void) userData;
+    return 0;
+}
+
+static sf_count_t cursorTell(void *userData)
+{
+    AudioSourceCursor *cursor = (AudioSourceCursor *) userData;
+    return cursor->position;
+}
+
+static SF_VIRTUAL_IO cursorIO = {cursorLength, cursorSeek, cursorRead, cursorWrite, cursorTell};
+
+AudioSource::~AudioSource()
+{
+}
+
+/*!
+\brief A name for the source in error messages.
+*/
+string AudioSource::getName()
+{
+    return "audio source";
+}
+
+/*!
+\brief Opens a libsndfile handle on the source, for reading.
+@param info As for sf_open(): its format must be 0, unless the source holds headerless (SF_FORMAT_RAW) samples, in
+which case the format, channels and sample rate must be set.  Filled in with the layout of the file.
+@param cursor The position of the new handle.  It must stay at the same address until the handle is closed.
+@return the handle, or NULL if the source could not be opened.
+*/
+SNDFILE *AudioSource::open(SF_INFO *info, AudioSourceCursor *cursor)
+{
+    cursor->source = this;
+    cursor->position = 0;
+    return sf_open_virtual(&cursorIO, SFM_READ, info, cursor);
+}
+
+/*!
+\brief Wraps size bytes at data.  The bytes are not copied.
+*/
+MemoryAudioSource::MemoryAudioSource(const void *data, sf_count_t size)
+{
+    this->data = (const unsigned char *) data;
+    this->size = size;
+}
+
+sf_count_t MemoryAudioSource::getSize()
+{
+    return this->size;
+}
+
+sf_count_t MemoryAudioSource::read(sf_count_t offset, void *buffer, sf_count_t count)
+{
+    if(offset < 0 || offset >= this->size)
+    {
+        return 0;
+    }
+    count = min(count, this->size - offset);
+    memcpy(buffer, this->data + offset, (size_t) count);
+    return count;
+}
+
+string MemoryAudioSource::getName()
+{
+    return "memory source";
+}
@@ -0,0 +1,66 @@
+#ifndef AUDIOSOURCE_H
+#define AUDIOSOURCE_H
+
+#include <sndfile.h>
+
+#include <string>
+
+/*!
+    \file AudioSource.h
+    \brief AudioSource header file.  Contains the sources AudioUtil can read audio from instead of a path.
+*/
+
+using namespace std;
+
+class AudioSource;
+
+/*!
+\brief The position of one libsndfile handle within an AudioSource.  Every handle opened on a source has its own.
+*/
+struct AudioSourceCursor
+{
+    AudioSource *source;
+    sf_count_t position;
+};
+
+/*!
+\brief The bytes of an audio file that does not live at a path, such as a download, a decrypted blob or a member
+of an archive, read through libsndfile's virtual I/O.
+
+To read from anything that can be read at an offset, derive from this class and implement getSize() and read(),
+then hand an instance to AudioUtil::setSource().  AudioUtil opens several handles on a source, one per thread that
+reads at the same time, so read() may be called from several threads at once, each time with the offset it needs:
+a source built on a single stream with its own position (a socket, a decompressor) must seek and read under a lock
+of its own.  A source must outlive every AudioUtil instance reading from it.
+*/
+class AudioSource
+{
+public:
+    virtual ~AudioSource();
+    /*! \brief Length of the file, in bytes. */
+    virtual sf_count_t getSize() = 0;
+    /*! \brief Copies up to count bytes from offset into buffer and returns how many were copied, 0 at the end. */
+    virtual sf_count_t read(sf_count_t offset, void *buffer, sf_count_t count) = 0;
+    virtual string getName();
+    SNDFILE *open(SF_INFO *info, AudioSourceCursor *cursor);
+};
+
+/*!
+\brief An audio file held in memory, read in place.
+
+The bytes are not copied: they must stay valid, and unchanged, for as long as the source is read.
+*/
+class MemoryAudioSource : public AudioSource
+{
+public:
+    MemoryAudioSource(const void *data, sf_count_t size);
+    virtual sf_count_t getSize();
+    virtual sf_count_t read(sf_count_t offset, void *buffer, sf_count_t count);
+    virtual string getName();
+
+private:
+    const unsigned char *data;
+    sf_count_t size;
+};
+
+#endif // AUDIOSOURCE_H
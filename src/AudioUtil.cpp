@@ -1,5 +1,7 @@
 #include "AudioUtil.h"
 
+#include <sys/stat.h>
+
 /*!
 \file AudioUtil.cpp
 \brief AudioUtil implementation file.
@@ -14,9 +16,7 @@
  */
 AudioUtil::AudioUtil()
 {
-        this->sfinfo = new SF_INFO;
-        this->fileHandlingMode = DISK_MODE;
-        sndFileNotEmpty = false;
+        this->initialize();
 }
 
 /**
@@ -28,11 +28,44 @@ AudioUtil::AudioUtil()
  * @param filePath path to a WAV file
 */
 AudioUtil::AudioUtil(string filePath)
+{
+        this->initialize();
+	this->setFile(filePath);
+}
+
+/*
+ * Shared by both constructors.
+ */
+void AudioUtil::initialize()
 {
         this->sfinfo = new SF_INFO;
+        this->sfinfo->frames = 0;
+        this->sfinfo->channels = 0;
         this->fileHandlingMode = DISK_MODE;
+        this->seekIndexPolicy = INDEX_COMPRESSED_ONLY;
+        this->seekIndexPersistent = false;
+        this->indexFromFile = false;
+        this->eventsFromFile = false;
+        this->loaded = false;
+        this->indexedFrames = 0;
+        this->kernels = kernelsForChannels(0);
+        this->readAheadEnabled = false;
+        this->readAheadRunning = false;
+        this->readAheadPending = false;
+        this->hinted = false;
+        this->hintFrame = 0;
+        this->hintVelocity = 0.0;
+        this->readAheadWindow = READ_AHEAD_MIN_BLOCKS;
+        this->readAheadWasted = 0;
+        this->readHintsEnabled = false;
+        this->source = NULL;
+        this->ownedSource = NULL;
+        this->sourceFormat.format = 0;
+        this->fileCache.setMemoryAccount(&this->memoryAccount, TIER_SAMPLE_CACHE);
+        this->compressedCache.setMemoryAccount(&this->memoryAccount, TIER_COMPRESSED_CACHE);
+        this->seekIndex.setMemoryAccount(&this->memoryAccount, TIER_SEEK_INDEX);
+        this->eventIndex.setMemoryAccount(&this->memoryAccount, TIER_EVENT_INDEX);
         sndFileNotEmpty = false;
-	this->setFile(filePath);
 }
 
 
@@ -41,18 +74,17 @@ AudioUtil::AudioUtil(string filePath)
  */
 AudioUtil::~AudioUtil()
 {
-    if(sndFileNotEmpty == true)
-    {
-        sf_close(this->sndFile);
-    }
+    this->stopReadAhead();
+    this->closeReaders();
+    delete this->ownedSource;
     delete sfinfo;
 }
 
 /**
  *\brief The mutator for the file-handling mode of an instance of AudioUtil.
  *
- *  AudioUtil objects can function in one of two modes: \link AudioUtil::DISK_MODE \endlink and \link AudioUtil::FULL_CACHE 
- *  \endlink mode.  The default mode for AudioUtil objects is DISK_MODE.  In DISK_MODE, an instance of 
+ *  AudioUtil objects can function in one of three modes: \link AudioUtil::DISK_MODE \endlink, \link AudioUtil::FULL_CACHE 
+ *  \endlink and \link AudioUtil::COMPRESSED_CACHE \endlink mode.  The default mode for AudioUtil objects is DISK_MODE.  In DISK_MODE, an instance of 
  *  AudioUtil will dynamically load a region of the audio file it wraps from disk 
  *  into memory when asked to analyze or return this region (when the peakForRegion, getAllFrames and 
  *  grabFrame function are invoked, for example).  This keeps memory use minimal, but has an immense
@@ -61,16 +93,33 @@ AudioUtil::~AudioUtil()
  *  point values), and use this cached data to perform the operations that, in DISK_MODE, require that 
  *  data be loaded dynamically from disk for processing.  In FULL_CACHE mode, you get drastically increased performance, but 
  *  pay a penalty in increased memory consumption.
+ *
+ *  COMPRESSED_CACHE mode sits between the two: the whole file is held in memory, but under fast lossless
+ *  compression (see CompressedSampleBuffer), typically taking a third to a fifth of the memory of FULL_CACHE.
+ *  Blocks are decompressed on demand, and the few most recently used are kept decoded.  Files are always given a
+ *  SeekIndex in this mode, so peakForRegion() only decompresses the blocks at the edges of a region, and a
+ *  macro-mode view only decompresses the blocks it shows.
  * 
  *  @param mode  file-handling scheme for the AudioUtil instance.  Valid options: \link AudioUtil::DISK_MODE \endlink, \link 
- *  AudioUtil::FULL_CACHE \endlink
+ *  AudioUtil::FULL_CACHE \endlink, \link AudioUtil::COMPRESSED_CACHE \endlink
  */
 void AudioUtil::setFileHandlingMode(FileHandlingMode mode)
 {
+    if(mode != DISK_MODE)
+    {
+        this->stopReadAhead();
+    }
     this->fileHandlingMode = mode;
-    if(mode == FULL_CACHE)
+    if(mode != FULL_CACHE)
+    {
+        this->fileCache.reset(0, 0);
+    }
+    if(mode != COMPRESSED_CACHE)
+    {
+        this->compressedCache.reset(0, 0);
+    }
+    if(mode != DISK_MODE && this->sndFileNotEmpty == true && this->loaded)
     {
-        this->fileCache.clear();
         this->populateCache();
     }
 }
@@ -97,41 +146,506 @@ AudioUtil::FileHandlingMode AudioUtil::getFileHandlingMode()
   */
 bool AudioUtil::setFile(string filePath)
 {
+    PERF_SCOPE("AudioUtil::setFile");
+
+    if(!this->openFile(filePath))
+    {
+        return false;
+    }
+    this->loadFile();
+    return true;
+}
+
+/**
+  * \brief Opens a file without reading its samples.
+  *
+  *  The first half of setFile(): the file is opened and its header read, and a saved seek index is loaded if
+  *  there is one, but the pass over the file that fills the cache is left to loadFile().  Until then, the
+  *  file can be sketched with approximatePeaks(), and reads go to the file as in DISK_MODE.
+  *
+  *  @param filePath a string representing a valid path to a WAV file.
+  *  @return true if file was successfully opened, false otherwise.
+  */
+bool AudioUtil::openFile(string filePath)
+{
+    PERF_SCOPE("AudioUtil::openFile");
+
+    SF_INFO format;
+    format.format = 0;
+    return this->openInput(filePath, NULL, format);
+}
+
+/**
+  * \brief Sets an AudioSource to be wrapped instead of a file.
+  *
+  *  Like setFile(), for a file that does not live at a path: it is read through the source with libsndfile's
+  *  virtual I/O, in any format libsndfile can read from a path, so it never has to be written to a temporary file.
+  *  Saved seek indices (setSeekIndexPersistence()) are neither loaded nor saved for sources.
+  *
+  *  @param source The source.  It is not owned by the instance, and must outlive it or the next file set.
+  *  @return true if the source was successfully set, false otherwise.
+  */
+bool AudioUtil::setSource(AudioSource *source)
+{
+    PERF_SCOPE("AudioUtil::setSource");
+
+    if(!this->openSource(source))
+    {
+        return false;
+    }
+    this->loadFile();
+    return true;
+}
+
+/**
+  * \brief Opens an AudioSource without reading its samples.  The first half of setSource(); see openFile().
+  */
+bool AudioUtil::openSource(AudioSource *source)
+{
+    PERF_SCOPE("AudioUtil::openSource");
+
+    SF_INFO format;
+    format.format = 0;
+    return this->openInput(source->getName(), source, format);
+}
+
+/**
+  * \brief Sets already decoded samples to be wrapped instead of a file.
+  *
+  *  The samples are read in place, as headerless audio, so that audio decoded by other means (or generated) can be
+  *  drawn and analysed without being encoded and written to a temporary file first.  Like samples read from files,
+  *  they are expected to lie between -1 and 1.
+  *
+  *  @param samples Interleaved samples.  They are not copied, and must stay valid and unchanged until another file
+  *  is set or the instance is destroyed.
+  *  @param frames Number of frames.
+  *  @param channels Number of interleaved channels, at most MAX_CHANNELS.
+  *  @param sampleRate Sample rate, in Hz.
+  *  @return true if the samples were successfully set, false otherwise.
+  */
+bool AudioUtil::setSamples(const float *samples, sf_count_t frames, int channels, int sampleRate)
+{
+    PERF_SCOPE("AudioUtil::setSamples");
+
+    if(!this->openSamples(samples, frames, channels, sampleRate))
+    {
+        return false;
+    }
+    this->loadFile();
+    return true;
+}
+
+/**
+  * \brief Opens already decoded samples without reading them.  The first half of setSamples(); see openFile().
+  */
+bool AudioUtil::openSamples(const float *samples, sf_count_t frames, int channels, int sampleRate)
+{
+    PERF_SCOPE("AudioUtil::openSamples");
+
+    SF_INFO format;
+    format.format = SF_FORMAT_RAW | SF_FORMAT_FLOAT | SF_ENDIAN_CPU;
+    format.channels = channels;
+    format.samplerate = sampleRate;
+    MemoryAudioSource *source = new MemoryAudioSource(samples, frames * channels * (sf_count_t) sizeof(float));
+    if(!this->openInput("sample buffer", source, format))
+    {
+        delete source;
+        return false;
+    }
+    this->ownedSource = source;
+    return true;
+}
 
+/*
+ * Shared by openFile(), openSource() and openSamples().  Opens name, or source if it is not NULL,
+ * with format as the SF_INFO passed to libsndfile (a format of 0 unless the input is headerless).
+ */
+bool AudioUtil::openInput(string name, AudioSource *source, SF_INFO format)
+{
+    this->loaded = false;
+    this->indexedFrames = 0;
+    this->edits.reset(0);
+    this->stopReadAhead();
+    this->readHints.close();
     if(sndFileNotEmpty == true)
     {
-        sf_close(this->sndFile);
+        this->closeReaders();
+        this->sndFileNotEmpty = false;
     }
-    this->sfinfo->format=0;
-        if (! (this->sndFile = sf_open (filePath.c_str(), SFM_READ, this->sfinfo)))
+    delete this->ownedSource;
+    this->ownedSource = NULL;
+    this->srcFilePath = name;
+    this->source = source;
+    this->sourceFormat = format;
+
+        /* The handle that reads the header becomes the first decoder of the pool. */
+        Reader *reader = new Reader;
+        *this->sfinfo = format;
+        SNDFILE *sndFile;
+        if (! (sndFile = this->openHandle(reader, this->sfinfo)))
         {
                 /* Open failed so print an error message. */
-                fprintf (stderr, "failed to open input file \"%s\".\n", filePath.c_str()) ;
+                fprintf (stderr, "failed to open input file \"%s\".\n", name.c_str()) ;
                 /* Print the error message fron libsndfile. */
                 sf_perror (NULL) ;
+                delete reader;
+                this->source = NULL;
+                this->sfinfo->frames = 0;
+                this->sfinfo->channels = 0;
                 return false;
         };
 
         /* turn on normalization  */
-        sf_command (this->sndFile, SFC_SET_NORM_DOUBLE, NULL, SF_TRUE) ;
+        sf_command (sndFile, SFC_SET_NORM_DOUBLE, NULL, SF_TRUE) ;
 
         /*channel num check! */
         if (this->sfinfo->channels > MAX_CHANNELS)
         {
             fprintf (stderr, "Error.  Input has too many channels.  Maximum channels: %d channels\n", MAX_CHANNELS) ;
+            sf_close(sndFile);
+            delete reader;
+            this->source = NULL;
+            this->sfinfo->frames = 0;
             return false;
         };
 
-        if(this->fileHandlingMode == FULL_CACHE)
+        this->sndFileNotEmpty = true;
+        this->edits.reset(this->sfinfo->frames);
+        if(this->readHintsEnabled && source == NULL)
+        {
+            this->readHints.open(name, *this->sfinfo);
+        }
+        this->kernels = kernelsForChannels(this->sfinfo->channels);
+        this->seekIndex.reset(this->sfinfo->channels, this->sfinfo->frames, this->sfinfo->samplerate);
+        this->eventIndex.reset(this->sfinfo->channels, this->sfinfo->frames, this->sfinfo->samplerate);
+
+        reader->sndFile = sndFile;
+        reader->readPosition = 0;
+        reader->blockBufferIndex = -1;
+        this->idleReaders.push_back(reader);
+
+        this->indexFromFile = false;
+        this->eventsFromFile = false;
+        if(this->wantsSeekIndex() && this->persistsIndices())
+        {
+            this->indexFromFile = this->seekIndex.load(this->seekIndexPath(), this->seekIndexKey());
+            this->eventsFromFile = this->eventIndex.load(this->eventIndexPath(), this->seekIndexKey());
+        }
+        if(this->indexFromFile)
         {
-            this->fileCache.clear();
-            this->fileCache = this->getAllFrames();
+            this->indexedFrames = this->sourceFrames();
         }
 
-        this->sndFileNotEmpty = true;
 	return true;
 }
 
+/**
+  * \brief Makes the pass over a file opened with openFile() that fills the cache and the seek index.
+  *
+  *  The second half of setFile().  It may run on another thread than the one that opened the file, provided
+  *  nothing but getNumChannels(), getSampleRate(), getTotalFrames(), loadedPeaks() and hintAccess() is called on the
+  *  instance until it returns.
+  */
+void AudioUtil::loadFile()
+{
+        PERF_SCOPE("AudioUtil::loadFile");
+
+        if(!this->sndFileNotEmpty || this->loaded)
+        {
+            return;
+        }
+
+        /*
+          The seek and event indices are built during the first sequential pass over the file.  In the
+          cached modes that pass is the one that populates the cache; in DISK_MODE it is made here, only
+          for the indices.
+        */
+        if(this->fileHandlingMode != DISK_MODE)
+        {
+            this->populateCache();
+        }
+        else if(this->wantsSeekIndex() && !(this->seekIndex.isComplete() && this->eventIndex.isComplete()))
+        {
+            this->ingest(false);
+        }
+
+        if(!this->indexFromFile && this->persistsIndices() && this->seekIndex.isComplete())
+        {
+            this->seekIndex.save(this->seekIndexPath(), this->seekIndexKey());
+        }
+        if(!this->eventsFromFile && this->persistsIndices() && this->eventIndex.isComplete())
+        {
+            this->eventIndex.save(this->eventIndexPath(), this->seekIndexKey());
+        }
+
+        this->loaded = true;
+}
+
+/**
+ * \brief Whether loadFile() (or setFile()) has made its pass over the wrapped file.
+ */
+bool AudioUtil::isLoaded()
+{
+    return this->loaded;
+}
+
+/**
+ * \brief Chooses which files get a seek index.
+ *
+ *  In DISK_MODE, an AudioUtil instance can keep a SeekIndex: a compact, block-by-block summary of the
+ *  wrapped file built during one sequential pass when the file is set.  With an index, peakForRegion()
+ *  answers whole blocks without touching the file and only decodes the blocks at the edges of a region,
+ *  which keeps random access into compressed files (FLAC, Ogg/Vorbis) bounded.  The pass itself costs one
+ *  sequential read of the file, which is why, by default (\link AudioUtil::INDEX_COMPRESSED_ONLY \endlink),
+ *  only compressed files are indexed.  The policy takes effect the next time setFile() is called.
+ *
+ *  In the cached modes every file is indexed regardless of the policy, since the pass that fills the cache
+ *  builds the index at little extra cost, and the index is what lets statsForRegion() answer in constant time.
+ *
+ *  @param policy \link AudioUtil::INDEX_NEVER \endlink, \link AudioUtil::INDEX_COMPRESSED_ONLY \endlink
+ *  or \link AudioUtil::INDEX_ALWAYS \endlink
+ */
+void AudioUtil::setSeekIndexPolicy(SeekIndexPolicy policy)
+{
+    this->seekIndexPolicy = policy;
+}
+
+/**
+ * \brief Accessor for the seek index policy.
+ */
+AudioUtil::SeekIndexPolicy AudioUtil::getSeekIndexPolicy()
+{
+    return this->seekIndexPolicy;
+}
+
+/**
+ * \brief Enables saving and reusing seek indices.
+ *
+ *  When enabled, the seek index of a file is written next to it (as the file's path with ".wfidx"
+ *  appended) after it has been built, and its event index likewise (with ".wfevt"), and later calls to
+ *  setFile() load them from there instead of making another pass over the file.  A saved index is ignored if the file's size, inode,
+ *  modification time (to the nanosecond) or format have changed since it was written.  Each index is written to a
+ *  temporary file that is then renamed into place, so viewers of the same file that save or load it at the same time
+ *  never see a partly written index.  Disabled by default.
+ *
+ *  @param persistent true to save and load index files.
+ */
+void AudioUtil::setSeekIndexPersistence(bool persistent)
+{
+    this->seekIndexPersistent = persistent;
+}
+
+/**
+ * \brief Whether a complete seek index is available for the wrapped file.
+ */
+bool AudioUtil::hasSeekIndex()
+{
+    return this->sndFileNotEmpty && this->seekIndex.isComplete();
+}
+
+/**
+ * \brief Whether the silent spans and onsets of the wrapped file are available to nextSilence() and nextOnset().
+ *
+ *  They are found during the pass over the file made by loadFile(), which is always made in the cached modes and
+ *  in DISK_MODE when the file gets a seek index (see setSeekIndexPolicy()).  With setSeekIndexPersistence(), they
+ *  are saved next to the seek index, as the file's path with ".wfevt" appended.
+ */
+bool AudioUtil::hasEventIndex()
+{
+    return this->sndFileNotEmpty && this->eventIndex.isComplete();
+}
+
+/**
+ * \brief Sets what counts as silence for nextSilence().
+ *
+ *  The silent spans are worked out again from the event index, which takes a few milliseconds for hours of audio
+ *  and does not read the file.  The default is DEFAULT_SILENCE_THRESHOLD_DB for DEFAULT_MIN_SILENCE_SECONDS.
+ *
+ *  @param thresholdDb Level below which the samples of every channel must stay, in dBFS.
+ *  @param minSeconds Shortest silence reported, in seconds.
+ */
+void AudioUtil::setSilenceThreshold(double thresholdDb, double minSeconds)
+{
+    this->eventIndex.setSilenceThreshold(thresholdDb, minSeconds);
+}
+
+/**
+ * \brief Finds the next silent span of the wrapped audio file.
+ *
+ *  The span is found in the event index, in logarithmic time, and its edges are then placed on the last loud
+ *  sample before it and the first loud sample after it by reading the EVENT_HOP_FRAMES frames on either side.  To
+ *  jump to the next sound, seek to end.
+ *
+ *  @param frame The frame to search from.  If it lies in a silent span, that span is returned.
+ *  @param start Receives the first silent frame.
+ *  @param end Receives the frame after the last silent frame: the first loud frame, or the end of the file.
+ *  @return true on success, false if there is no silent span after frame or no event index (see hasEventIndex()).
+ */
+bool AudioUtil::nextSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end)
+{
+    sf_count_t hopStart, hopEnd;
+    if(!this->hasEventIndex() || !this->findSilence(frame, &hopStart, &hopEnd))
+    {
+        return false;
+    }
+
+    int numChannels = this->getNumChannels();
+    double threshold = pow(10.0, this->eventIndex.getSilenceThresholdDb() / 20.0);
+
+    /* The hops on either side of the span reach the threshold somewhere; the span grows up to where they do. */
+    sf_count_t before = max((sf_count_t) 0, hopStart - EVENT_HOP_FRAMES);
+    vector<double> frames = this->getFrames(before, hopStart - before);
+    sf_count_t count = (sf_count_t) frames.size() / numChannels;
+    sf_count_t f = count;
+    bool loud = false;
+    while(f > 0 && !loud)
+    {
+        for(int c = 0; c < numChannels; c++)
+        {
+            loud = loud || fabs(frames[(f - 1)*numChannels + c]) >= threshold;
+        }
+        if(!loud)
+        {
+            f--;
+        }
+    }
+    *start = hopStart - (count - f);
+
+    frames = this->getFrames(hopEnd, EVENT_HOP_FRAMES);
+    count = (sf_count_t) frames.size() / numChannels;
+    f = 0;
+    loud = false;
+    while(f < count && !loud)
+    {
+        for(int c = 0; c < numChannels; c++)
+        {
+            loud = loud || fabs(frames[f*numChannels + c]) >= threshold;
+        }
+        if(!loud)
+        {
+            f++;
+        }
+    }
+    *end = hopEnd + f;
+    return true;
+}
+
+/**
+ * \brief Finds the next onset (transient) of the wrapped audio file, in logarithmic time.
+ *
+ *  Onsets are where the energy of the signal rises suddenly, such as the attack of a note or a drum hit.  Their
+ *  strength is the rise over the preceding tenth of a second, in dB; see EventIndex.
+ *
+ *  @param frame The frame to search from.  An onset at frame itself is skipped, so that repeated calls step through
+ *  the onsets.
+ *  @param minStrengthDb Weakest onset to return, in dB.  ONSET_MIN_RISE_DB or less returns every onset.
+ *  @param onset Receives the frame of the onset.
+ *  @return true on success, false if there is no such onset after frame or no event index (see hasEventIndex()).
+ */
+bool AudioUtil::nextOnset(sf_count_t frame, double minStrengthDb, sf_count_t *onset)
+{
+    if(!this->hasEventIndex())
+    {
+        return false;
+    }
+
+    /* Searched piece by piece of the edit list: an onset at frame is skipped, one at the start of a later piece is not. */
+    for(int i = this->edits.findPiece(max(frame, (sf_count_t) 0)); i >= 0 && i < this->edits.getNumPieces(); i++)
+    {
+        EditPiece edit = this->edits.getPiece(i);
+        sf_count_t pieceStart = this->edits.getPieceStart(i);
+        sf_count_t from = (frame >= pieceStart) ? edit.sourceStart + (frame - pieceStart) : edit.sourceStart - 1;
+        sf_count_t found;
+        if(this->eventIndex.nextOnset(from, minStrengthDb, &found, NULL) && found < edit.sourceStart + edit.length)
+        {
+            *onset = pieceStart + (found - edit.sourceStart);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The silent span of the event index holding frame, or the next one after it, found piece by piece of
+ * the edit list and cut short at the edges of the piece it lies in.
+ */
+bool AudioUtil::findSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end)
+{
+    for(int i = this->edits.findPiece(max(frame, (sf_count_t) 0)); i >= 0 && i < this->edits.getNumPieces(); i++)
+    {
+        EditPiece edit = this->edits.getPiece(i);
+        sf_count_t pieceStart = this->edits.getPieceStart(i);
+        sf_count_t from = edit.sourceStart + (max(frame, pieceStart) - pieceStart);
+        sf_count_t spanStart, spanEnd;
+        if(this->eventIndex.nextSilence(from, &spanStart, &spanEnd) && spanStart < edit.sourceStart + edit.length)
+        {
+            *start = pieceStart + (max(spanStart, edit.sourceStart) - edit.sourceStart);
+            *end = pieceStart + (min(spanEnd, edit.sourceStart + edit.length) - edit.sourceStart);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Whether the wrapped file is in a compressed format, for which seeking requires decoding.
+ */
+bool AudioUtil::isCompressedFormat()
+{
+    int majorFormat = this->sfinfo->format & SF_FORMAT_TYPEMASK;
+    return majorFormat == SF_FORMAT_FLAC || majorFormat == SF_FORMAT_OGG;
+}
+
+bool AudioUtil::wantsSeekIndex()
+{
+    return this->fileHandlingMode != DISK_MODE || this->seekIndexPolicy == INDEX_ALWAYS
+            || (this->seekIndexPolicy == INDEX_COMPRESSED_ONLY && this->isCompressedFormat());
+}
+
+bool AudioUtil::persistsIndices()
+{
+    return this->seekIndexPersistent && this->source == NULL;
+}
+
+string AudioUtil::seekIndexPath()
+{
+    return this->srcFilePath + ".wfidx";
+}
+
+string AudioUtil::eventIndexPath()
+{
+    return this->srcFilePath + ".wfevt";
+}
+
+SeekIndexKey AudioUtil::seekIndexKey()
+{
+    SeekIndexKey key;
+    struct stat fileStat;
+    if(stat(this->srcFilePath.c_str(), &fileStat) == 0)
+    {
+        key.fileSize = fileStat.st_size;
+        key.inode = fileStat.st_ino;
+        key.modificationTime = fileStat.st_mtime;
+#if defined(__APPLE__)
+        key.modificationNanoseconds = fileStat.st_mtimespec.tv_nsec;
+#else
+        key.modificationNanoseconds = fileStat.st_mtim.tv_nsec;
+#endif
+    }
+    else
+    {
+        key.fileSize = -1;
+        key.inode = -1;
+        key.modificationTime = -1;
+        key.modificationNanoseconds = -1;
+    }
+    key.frames = this->sfinfo->frames;
+    key.channels = this->sfinfo->channels;
+    key.sampleRate = this->sfinfo->samplerate;
+    key.format = this->sfinfo->format;
+    return key;
+}
+
 /**
  * \brief Calculates peak values for the normalized audio data of the audio file wrapped by an instance of AudioUtil.
  *
@@ -141,26 +655,48 @@ bool AudioUtil::setFile(string filePath)
  */
 vector<double> AudioUtil::calculateNormalizedPeaks()
 {
-        this->peaks.clear();
-
-        double *peaksPtr = (double *) malloc(2*sizeof(double));
+        PERF_SCOPE("AudioUtil::calculateNormalizedPeaks");
+        vector<double> peaks;
 
-        sf_command (sndFile, SFC_CALC_NORM_MAX_ALL_CHANNELS, peaksPtr, sizeof(double)*this->getNumChannels()) ;
+        /* Through an edit list, the peaks are those of the edited file.  With a complete seek index,
+         * peakForRegion() only reads the few blocks that may hold the peaks. */
+        if(!this->edits.isIdentity() || this->hasSeekIndex())
+        {
+            vector<double> regionPeak(this->getNumChannels(), 0.0);
+            if(this->getTotalFrames() > 0)
+            {
+                regionPeak = this->peakForRegion(0, this->getTotalFrames());
+            }
+            for(size_t c = 0; c < regionPeak.size(); c++)
+            {
+                peaks.push_back(fabs(regionPeak[c]));
+            }
+            return peaks;
+        }
 
-        if(this->getNumChannels() == 2)
+        Reader *reader = this->acquireReader();
+        if(reader == NULL)
         {
-               this->peaks.push_back(peaksPtr[0]);
-               this->peaks.push_back((peaksPtr[1]));
+            return peaks;
         }
-        else if (this->getNumChannels() == 1)
+
+        /* Likewise with the whole file in memory. */
+        if(this->fileHandlingMode == FULL_CACHE && this->sourceFrames() > 0)
         {
-            this->peaks.push_back(peaksPtr[0]);
-        } else
-	{
-		perror("Error in AudioUtil::calculateNormalizedPeaks()\n");
-	}
+            double peak[MAX_CHANNELS] = {};
+            this->scanRegion(reader, 0, this->sourceFrames(), peak);
+            this->releaseReader(reader);
+            for(int c = 0; c < this->getNumChannels(); c++)
+            {
+                peaks.push_back(fabs(peak[c]));
+            }
+            return peaks;
+        }
 
-        free(peaksPtr);
+        peaks.resize(this->getNumChannels());
+        sf_command (reader->sndFile, SFC_CALC_NORM_MAX_ALL_CHANNELS, &peaks[0], sizeof(double)*this->getNumChannels()) ;
+        reader->readPosition = -1;
+        this->releaseReader(reader);
 
         return peaks;
 }
@@ -179,7 +715,7 @@ int AudioUtil::getNumChannels()
         }
         else
         {
-                return NULL;
+                return 0;
         }
 }
 
@@ -195,10 +731,18 @@ int AudioUtil::getSampleRate()
 
 
 /*!
-\brief The total number of frames of the wrapped audio file.
+\brief The total number of frames of the wrapped audio file, as edited (see setEdits()).
 @return the number of frames of the wrapped audio file.
 */
-int AudioUtil::getTotalFrames()
+sf_count_t AudioUtil::getTotalFrames()
+{
+    return this->edits.getTotalFrames();
+}
+
+/*
+ * The number of frames of the wrapped file itself, whatever the edits.
+ */
+sf_count_t AudioUtil::sourceFrames()
 {
     if (sfinfo != NULL)
     {
@@ -206,7 +750,7 @@ int AudioUtil::getTotalFrames()
     }
     else
     {
-            return NULL;
+            return 0;
     }
 }
 
@@ -224,79 +768,52 @@ int AudioUtil::getTotalFrames()
  * @return A vector of double-precision floating point values representing the contents of the requested frame.  In 
  * the case that an out-of-bounds frame is requested, an empty vector will be returned. 
  */
-vector<double> AudioUtil::grabFrame(int frameIndex)
+vector<double> AudioUtil::grabFrame(sf_count_t frameIndex)
 {
     vector<double> frameData;
 
-    if(this->fileHandlingMode == FULL_CACHE)
+    if(this->fileHandlingMode == DISK_MODE)
     {
-        if(this->getNumChannels() == 1)
-        {
-            if(frameIndex >= (int) this->fileCache.size())
-            {
-                perror("err in AudioUtil::grabFrame -- caller attempting to access out-of-range frame\n");
-                return frameData;
-            }
-
-            else
-            {
-                frameData.push_back(this->fileCache.at(frameIndex));
-            }
-        }
-
-        if(this->getNumChannels() == 2)
-        {
-            if(2*frameIndex+1 >= (int) this->fileCache.size())
-            {
-                perror("err in AudioUtil::grabFrame -- caller attempting to access out-of-range frame\n");
-                return frameData;
-            }
-            else
-            {
-                frameData.push_back(this->fileCache.at(2*frameIndex));
-                frameData.push_back(this->fileCache.at(2*frameIndex+1));
-            }
+        PERF_COUNT("AudioUtil::cacheMiss");
+    }
+    else
+    {
+        PERF_COUNT("AudioUtil::cacheHit");
+    }
 
-        }
+    if(frameIndex < 0 || frameIndex >= this->getTotalFrames())
+    {
+        perror("err in AudioUtil::grabFrame -- caller attempting to access out-of-range frame\n");
+        return frameData;
+    }
 
+    /*
+      In DISK_MODE, frames are served from a buffered block, so that reading neighbouring frames one
+      at a time does not reposition the decoder for every frame.
+    */
+    int piece = this->edits.findPiece(frameIndex);
+    EditPiece edit = this->edits.getPiece(piece);
+    sf_count_t sourceFrame = edit.sourceStart + (frameIndex - this->edits.getPieceStart(piece));
+
+    Reader *reader = this->acquireReader();
+    sf_count_t available;
+    const double *frame = (reader != NULL) ? this->frameSpan(reader, sourceFrame, &available) : NULL;
+    if(frame == NULL)
+    {
+        this->releaseReader(reader);
+        perror("file read error in AudioUtil::grabFrame\n");
+        return frameData;
     }
 
-    if(this->fileHandlingMode == DISK_MODE)
+    double values[MAX_CHANNELS];
+    this->kernels.copyFrame(frame, values);
+    this->releaseReader(reader);
+    for(int c = 0; c < this->kernels.numChannels; c++)
     {
-        if (sf_seek(sndFile, frameIndex, SEEK_SET) == -1)
-        {
-            perror("seek error in AudioUtil::grabFrame\n");
-            return frameData;
-        }
-        else
-        {
-                if(sf_readf_double(sndFile, data, 1) == 0)
-                {
-                    perror("file read error in AudioUtil::grabFrame\n");
-                    return frameData;
-
-                }
-                else
-                {
-                    if(this->getNumChannels() == 2)
-                    {
-                        frameData.push_back(data[0]);
-                        frameData.push_back(data[1]);
-                        return frameData;
-                    }
-                    if(this->getNumChannels() == 1)
-                    {
-                        frameData.push_back(data[0]);
-                        return frameData;
-                    }
-                }
-        }
+        values[c] *= edit.gain;
     }
-    //we should never find ourselves here, but as a precaution...
-    perror("invalid mode selected for AudioUtil instance\n");
+    frameData.assign(values, values + this->kernels.numChannels);
     return frameData;
-
-
 }
 
 /** 
@@ -310,145 +827,650 @@ vector<double> AudioUtil::grabFrame(int frameIndex)
  * 
  * @param region_start_frame The frame marking the beginning of the region to be analyzed
  * @param region_end_frame The frame marking the end of the region to be analyzed
+ * @param exact If false, the whole seek index blocks inside the region are answered with the bounds the index
+ * stores, which are rounded outwards by less than 1/32768 of each block's scale (see SeekIndex), and only the
+ * partial blocks at either end are read.  Meant for drawing.
  * @return A vector of double-precision floating point values representing the peak for each channel of the specified region 
  * of the audio file wrapped by an instance of AudioUtil.  In the case that an invalid region has been specified, return 
  * value is an empty vector.
  */
-vector<double> AudioUtil::peakForRegion(int region_start_frame, int region_end_frame)
+vector<double> AudioUtil::peakForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, bool exact)
 {
- 
+    PERF_SCOPE("AudioUtil::peakForRegion");
+
     int numChannels = this->getNumChannels();
+    vector<double> regionPeak;
 
-    if(this->fileHandlingMode == FULL_CACHE)
+    if(numChannels != 1 && numChannels != 2)
     {
-        if(numChannels == 2)
-        {
-            this->regionPeak.clear();
+        perror("err in AudioUtil::peakForRegion function.  Max channels: 2\n");
+        return regionPeak;
+    }
 
-            double max0 = 0.0;
-            double max1 = 0.0;
+    if(region_start_frame < 0 || region_end_frame > this->getTotalFrames() || region_start_frame >= region_end_frame)
+    {
+        perror("err in AudioUtil::peakForRegion -- invalid region\n");
+        return regionPeak;
+    }
 
-             for (int i = 2*region_start_frame; i <  2*region_end_frame; i+=2)
-             {
-                  if(fabs(fileCache[i]) > fabs(max0))
-                {
-                  max0 = fileCache[i];
-                }
-                if(fabs(fileCache[i+1]) > fabs(max1))
-                {
-                    max1 = fileCache[i+1];
-                }
+    if(this->fileHandlingMode == DISK_MODE)
+    {
+        PERF_COUNT("AudioUtil::cacheMiss");
+    }
+    else
+    {
+        PERF_COUNT("AudioUtil::cacheHit");
+    }
+
+    Reader *reader = this->acquireReader();
+    if(reader == NULL)
+    {
+        return regionPeak;
+    }
 
+    /* Each piece of the edit list is a region of the wrapped file, at its own gain. */
+    double peak[MAX_CHANNELS] = {};
+    for(int i = this->edits.findPiece(region_start_frame); i < this->edits.getNumPieces() && this->edits.getPieceStart(i) < region_end_frame; i++)
+    {
+        EditPiece edit = this->edits.getPiece(i);
+        sf_count_t offset = edit.sourceStart - this->edits.getPieceStart(i);
+        sf_count_t start = max(region_start_frame, this->edits.getPieceStart(i)) + offset;
+        sf_count_t end = min(region_end_frame, this->edits.getPieceStart(i + 1)) + offset;
+
+        double piecePeak[MAX_CHANNELS] = {};
+        if(!this->foldRegionPeak(reader, start, end, piecePeak, exact))
+        {
+            this->releaseReader(reader);
+            perror("read error in AudioUtil::peakForRegion function\n");
+            return regionPeak;
+        }
+        for(int c = 0; c < numChannels; c++)
+        {
+            if(fabs(piecePeak[c] * edit.gain) > fabs(peak[c]))
+            {
+                peak[c] = piecePeak[c] * edit.gain;
             }
+        }
+    }
+    this->releaseReader(reader);
 
-            this->regionPeak.push_back(max0);
-            this->regionPeak.push_back(max1);
+    regionPeak.assign(peak, peak + numChannels);
 
-           return regionPeak;
-       }
+    return regionPeak;
+}
 
-        if(numChannels == 1)
-        {
-            this->regionPeak.clear();
+/**
+ *\brief A quick, approximate peak for each of numColumns equal parts of a region.
+ *
+ * Meant for drawing something before the file has been loaded (see openFile()): instead of the whole region, at
+ * most MAX_SKETCH_BLOCKS blocks of SEEK_INDEX_BLOCK_FRAMES frames, evenly spaced across it, are read in file order,
+ * and each column gets the peak of the block nearest to it.  The result can miss short transients and should be
+ * drawn as an approximation.  If the seek index of the file is available, the peaks are taken from it instead, at
+ * block resolution, and nothing is read.
+ *
+ * @param region_start_frame The frame marking the beginning of the region
+ * @param region_end_frame The frame just past the end of the region
+ * @param numColumns Number of parts to divide the region into
+ * @return numColumns peaks of each channel, interleaved like frames, or an empty vector for an invalid region or a
+ * read error.
+ */
+vector<double> AudioUtil::approximatePeaks(sf_count_t region_start_frame, sf_count_t region_end_frame, int numColumns)
+{
+    PERF_SCOPE("AudioUtil::approximatePeaks");
 
-            double max0 = 0.0;
+    int numChannels = this->getNumChannels();
+    vector<double> columnPeaks;
+    if(numChannels <= 0 || numColumns <= 0 || region_start_frame < 0 || region_end_frame > this->getTotalFrames()
+            || region_start_frame >= region_end_frame)
+    {
+        return columnPeaks;
+    }
 
-             for (int i = region_start_frame; i <  region_end_frame; i++)
-             {
-                if(fabs(fileCache[i]) > fabs(max0))
-                {
-                  max0 = fileCache[i];
-                }
-            }
+    if(this->loadedPeaks(region_start_frame, region_end_frame, numColumns, &columnPeaks) == numColumns)
+    {
+        return columnPeaks;
+    }
 
-           this->regionPeak.push_back(max0);
+    sf_count_t firstBlock = region_start_frame / SEEK_INDEX_BLOCK_FRAMES;
+    sf_count_t endBlock = (region_end_frame + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES;
+    sf_count_t numBlocks = endBlock - firstBlock;
+    sf_count_t numProbes = min(numBlocks, min((sf_count_t) numColumns, (sf_count_t) MAX_SKETCH_BLOCKS));
 
-           return this->regionPeak;
-       }
+    Reader *reader = this->acquireReader();
+    if(reader == NULL)
+    {
+        return columnPeaks;
+    }
 
+    vector<sf_count_t> probeBlocks(numProbes);
+    vector<double> probeGains(numProbes, 1.0);
+    for(sf_count_t p = 0; p < numProbes; p++)
+    {
+        probeBlocks[p] = firstBlock + (sf_count_t) ((p + 0.5) * numBlocks / numProbes);
+        if(!this->edits.isIdentity())
+        {
+            sf_count_t frame = region_start_frame + (sf_count_t) ((p + 0.5) * (region_end_frame - region_start_frame) / numProbes);
+            int piece = this->edits.findPiece(frame);
+            EditPiece edit = this->edits.getPiece(piece);
+            probeBlocks[p] = (edit.sourceStart + (frame - this->edits.getPieceStart(piece))) / SEEK_INDEX_BLOCK_FRAMES;
+            probeGains[p] = edit.gain;
+        }
+        /* All the probes are requested before the first is read, so the kernel can fetch them in parallel. */
+        this->readHints.willNeed(probeBlocks[p] * SEEK_INDEX_BLOCK_FRAMES, (probeBlocks[p] + 1) * SEEK_INDEX_BLOCK_FRAMES);
     }
-    if(this->fileHandlingMode == DISK_MODE)
+
+    columnPeaks.assign(numColumns * numChannels, 0.0);
+    int column = 0;
+    for(sf_count_t p = 0; p < numProbes; p++)
     {
-        if(numChannels == 2)
+        sf_count_t block = probeBlocks[p];
+        double gain = probeGains[p];
+        sf_count_t blockStart = block * SEEK_INDEX_BLOCK_FRAMES;
+        sf_count_t frames = min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames() - blockStart);
+        if(!this->loadBlock(reader, block))
         {
-            this->regionPeak.clear();
-            double *chunk = new double[ 2*(region_end_frame - region_start_frame)];
-             //seek to region start
-            if (sf_seek(sndFile, region_start_frame, SEEK_SET) == -1)
-            {
-                 perror("seek error in AudioUtil::peakForRegion function\n");
-                 return this->regionPeak;
-            }
-            /*read the region into an array*/
-            if(sf_readf_double(sndFile, chunk, (region_end_frame - region_start_frame) ) == 0)
+            this->releaseReader(reader);
+            perror("read error in AudioUtil::approximatePeaks function\n");
+            return vector<double>();
+        }
+
+        double peak[MAX_CHANNELS] = {};
+        this->kernels.foldPeaks(&reader->blockBuffer[0], frames, peak);
+
+        /* Every column up to the one halfway to the next probe takes this probe's peak. */
+        int lastColumn = (p + 1 == numProbes) ? numColumns : (int) ((p + 1) * numColumns / numProbes);
+        for(; column < lastColumn; column++)
+        {
+            for(int c = 0; c < numChannels; c++)
             {
-                perror("read error in AudioUtil::peakForRegion function\n");
-                return this->regionPeak;
+                columnPeaks[column * numChannels + c] = peak[c] * gain;
             }
+        }
+    }
 
-            double max0 = 0.0;
-            double max1 = 0.0;
+    this->releaseReader(reader);
+    return columnPeaks;
+}
 
-             for (int i = 0; i <  2*(region_end_frame - region_start_frame); i+=2)
-             {
-                  if(fabs(chunk[i]) > fabs(max0))
-                {
-                  max0 = chunk[i];
-                }
-                if(fabs(chunk[i+1]) > fabs(max1))
+/**
+ *\brief Peaks for the columns of a region that the seek index already covers.
+ *
+ * While loadFile() runs, possibly on another thread, the seek index is filled from the start of the file on.
+ * This function divides a region into numColumns equal parts, like approximatePeaks(), and gives the peak of each
+ * part the index covers completely, at block resolution and with the index's bounds, which are rounded outwards by
+ * less than 1/32768 of each block's scale.  It is safe to call from another thread during
+ * loadFile().
+ *
+ * @param region_start_frame The frame marking the beginning of the region
+ * @param region_end_frame The frame just past the end of the region
+ * @param numColumns Number of parts to divide the region into
+ * @param columnPeaks Resized to numColumns peaks of each channel, interleaved; the first columns, up to the
+ * returned count, are filled in and the rest are left as they were (or zero).
+ * @return the number of leading columns filled in: numColumns once the index is complete, 0 for a file without an
+ * index.
+ */
+int AudioUtil::loadedPeaks(sf_count_t region_start_frame, sf_count_t region_end_frame, int numColumns, vector<double> *columnPeaks)
+{
+    int numChannels = this->getNumChannels();
+    if(numChannels <= 0 || numColumns <= 0 || region_start_frame < 0 || region_end_frame > this->getTotalFrames()
+            || region_start_frame >= region_end_frame)
+    {
+        return 0;
+    }
+    columnPeaks->resize(numColumns * numChannels, 0.0);
+
+    sf_count_t indexed = this->indexedFrames;
+    sf_count_t indexedBlocks = (indexed >= this->sourceFrames())
+            ? (indexed + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES
+            : indexed / SEEK_INDEX_BLOCK_FRAMES;
+
+    double framesPerColumn = ((double) (region_end_frame - region_start_frame)) / numColumns;
+    int column;
+    for(column = 0; column < numColumns; column++)
+    {
+        sf_count_t start = region_start_frame + (sf_count_t) (column * framesPerColumn);
+        sf_count_t end = max(start + 1, region_start_frame + (sf_count_t) ((column + 1) * framesPerColumn));
+
+        double low[MAX_CHANNELS] = {};
+        double high[MAX_CHANNELS] = {};
+        bool covered = true;
+        for(int i = this->edits.findPiece(start); covered && i < this->edits.getNumPieces() && this->edits.getPieceStart(i) < end; i++)
+        {
+            EditPiece edit = this->edits.getPiece(i);
+            sf_count_t offset = edit.sourceStart - this->edits.getPieceStart(i);
+            sf_count_t firstBlock = (max(start, this->edits.getPieceStart(i)) + offset) / SEEK_INDEX_BLOCK_FRAMES;
+            sf_count_t endBlock = (min(end, this->edits.getPieceStart(i + 1)) + offset + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES;
+            covered = endBlock <= indexedBlocks;
+            for(sf_count_t block = firstBlock; covered && block < endBlock; block++)
+            {
+                for(int c = 0; c < numChannels; c++)
                 {
-                    max1 = (chunk[i+1]);
+                    double minValue, maxValue;
+                    this->seekIndex.blockRange(block, c, &minValue, &maxValue);
+                    low[c] = min(low[c], minValue * edit.gain);
+                    high[c] = max(high[c], maxValue * edit.gain);
                 }
-
             }
+        }
+        if(!covered)
+        {
+            break;
+        }
+
+        for(int c = 0; c < numChannels; c++)
+        {
+            (*columnPeaks)[column * numChannels + c] = (fabs(low[c]) > fabs(high[c])) ? low[c] : high[c];
+        }
+    }
+    return column;
+}
+
+/**
+ *\brief Minimum, maximum, peak and RMS of a given region of the wrapped audio file.
+ *
+ * With a seek index (always present in the cached modes, see setSeekIndexPolicy()), the whole blocks inside the
+ * region are answered from the index in logarithmic time, and only the partial blocks at either end (fewer than
+ * 2*SEEK_INDEX_BLOCK_FRAMES frames) are read, so the cost hardly depends on the length of the region.  The index
+ * stores extremes rounded outwards and sums of squares to within 0.07% (see SeekIndex); to keep the minimum,
+ * maximum and peak exact, the blocks whose bounds may hold them are read as well, usually two per channel.  The
+ * RMS of the whole blocks is within 0.04% of the true one.  Without an index, the region is scanned and all
+ * results are exact.
+ *
+ * @param region_start_frame The frame marking the beginning of the region to be analyzed
+ * @param region_end_frame The frame just past the end of the region
+ * @param stats Receives the statistics
+ * @param exact If false, the minimum, maximum and peak of the whole blocks are the index's bounds and no block
+ * inside the region is read.  Meant for drawing.
+ * @return true on success.  On an invalid region or a read error, prints an error message and returns false.
+ */
+bool AudioUtil::statsForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, RegionStats *stats, bool exact)
+{
+    PERF_SCOPE("AudioUtil::statsForRegion");
+
+    int numChannels = this->getNumChannels();
+    if(numChannels != 1 && numChannels != 2)
+    {
+        perror("err in AudioUtil::statsForRegion function.  Max channels: 2\n");
+        return false;
+    }
 
-            this->regionPeak.push_back(max0);
-            this->regionPeak.push_back(max1);
+    if(region_start_frame < 0 || region_end_frame > this->getTotalFrames() || region_start_frame >= region_end_frame)
+    {
+        perror("err in AudioUtil::statsForRegion -- invalid region\n");
+        return false;
+    }
 
-           delete[] chunk;
+    Reader *reader = this->acquireReader();
+    if(reader == NULL)
+    {
+        return false;
+    }
 
-           return regionPeak;
-       }
+    double sumSquares[MAX_CHANNELS] = {};
 
+    stats->frames = region_end_frame - region_start_frame;
+    stats->numChannels = numChannels;
+    for(int c = 0; c < numChannels; c++)
+    {
+        stats->min[c] = HUGE_VAL;
+        stats->max[c] = -HUGE_VAL;
+    }
 
-        if(numChannels == 1)
+    /* As in peakForRegion(), piece by piece of the edit list. */
+    for(int i = this->edits.findPiece(region_start_frame); i < this->edits.getNumPieces() && this->edits.getPieceStart(i) < region_end_frame; i++)
+    {
+        EditPiece edit = this->edits.getPiece(i);
+        sf_count_t offset = edit.sourceStart - this->edits.getPieceStart(i);
+        sf_count_t start = max(region_start_frame, this->edits.getPieceStart(i)) + offset;
+        sf_count_t end = min(region_end_frame, this->edits.getPieceStart(i + 1)) + offset;
+
+        double pieceMin[MAX_CHANNELS];
+        double pieceMax[MAX_CHANNELS];
+        fill_n(pieceMin, numChannels, HUGE_VAL);
+        fill_n(pieceMax, numChannels, -HUGE_VAL);
+        double pieceSumSquares[MAX_CHANNELS] = {};
+        if(!this->foldRegionStats(reader, start, end, pieceMin, pieceMax, pieceSumSquares, exact))
         {
-            this->regionPeak.clear();
-            double *chunk = new double[ region_end_frame - region_start_frame];
-             //seek to region start
-            if (sf_seek(sndFile, region_start_frame, SEEK_SET) == -1)
-            {
-                perror("seek error in AudioUtil::peakForRegion function\n");
-                return this->regionPeak;
-            }
-            /*read the region into an array*/
-            if(sf_readf_double(sndFile, chunk, (region_end_frame - region_start_frame) ) == 0)
+            this->releaseReader(reader);
+            perror("read error in AudioUtil::statsForRegion function\n");
+            return false;
+        }
+        for(int c = 0; c < numChannels; c++)
+        {
+            stats->min[c] = min(stats->min[c], pieceMin[c] * edit.gain);
+            stats->max[c] = max(stats->max[c], pieceMax[c] * edit.gain);
+            sumSquares[c] += pieceSumSquares[c] * edit.gain * edit.gain;
+        }
+    }
+    this->releaseReader(reader);
+
+    for(int c = 0; c < numChannels; c++)
+    {
+        stats->peak[c] = (fabs(stats->min[c]) > fabs(stats->max[c])) ? stats->min[c] : stats->max[c];
+        stats->rms[c] = sqrt(max(0.0, sumSquares[c]) / stats->frames);
+    }
+    return true;
+}
+
+/**
+ *\brief K-weighted loudness of a given region of the wrapped audio file, in LUFS.
+ *
+ * The loudness is computed as in ITU-R BS.1770, without gating, from sums of K-weighted squares that the seek
+ * index collects while the file is read for the first time, so each query takes constant time.  Since the index
+ * works in blocks, the region is widened to whole blocks of SEEK_INDEX_BLOCK_FRAMES frames.  A seek index is
+ * required: it always exists in the cached modes, and in DISK_MODE it can be requested with setSeekIndexPolicy().
+ *
+ * @param region_start_frame The frame marking the beginning of the region to be measured
+ * @param region_end_frame The frame just past the end of the region
+ * @param lufs Receives the loudness, no lower than LOUDNESS_FLOOR
+ * @return true on success.  On an invalid region, or if there is no seek index, prints an error message and
+ * returns false.
+ */
+bool AudioUtil::loudnessForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, double *lufs)
+{
+    if(!this->hasSeekIndex())
+    {
+        perror("err in AudioUtil::loudnessForRegion -- no seek index\n");
+        return false;
+    }
+    if(region_start_frame < 0 || region_end_frame > this->getTotalFrames() || region_start_frame >= region_end_frame)
+    {
+        perror("err in AudioUtil::loudnessForRegion -- invalid region\n");
+        return false;
+    }
+
+    /* The pieces of the edit list add their K-weighted energy, scaled by the square of their gain. */
+    double energy = 0.0;
+    sf_count_t frames = 0;
+    for(int i = this->edits.findPiece(region_start_frame); i < this->edits.getNumPieces() && this->edits.getPieceStart(i) < region_end_frame; i++)
+    {
+        EditPiece edit = this->edits.getPiece(i);
+        sf_count_t offset = edit.sourceStart - this->edits.getPieceStart(i);
+        sf_count_t firstBlock = (max(region_start_frame, this->edits.getPieceStart(i)) + offset) / SEEK_INDEX_BLOCK_FRAMES;
+        sf_count_t endBlock = min(this->seekIndex.getNumBlocks(), (min(region_end_frame, this->edits.getPieceStart(i + 1)) + offset + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES);
+        for(int c = 0; c < this->getNumChannels(); c++)
+        {
+            energy += this->seekIndex.rangeWeightedSumOfSquares(firstBlock, endBlock, c) * edit.gain * edit.gain;
+        }
+        frames += min(endBlock * SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames()) - firstBlock * SEEK_INDEX_BLOCK_FRAMES;
+    }
+    double power = energy / frames;
+
+    *lufs = (power > 0.0) ? max(LOUDNESS_FLOOR, -0.691 + 10.0 * log10(power)) : LOUDNESS_FLOOR;
+    return true;
+}
+
+/**
+ *\brief Short-term loudness at a given frame of the wrapped audio file, in LUFS.
+ *
+ * The loudness of the SHORT_TERM_LOUDNESS_SECONDS seconds ending at frame (or of the beginning of the file, for
+ * the first few seconds), as shown by the short-term meters of EBU R 128.  See loudnessForRegion().
+ *
+ * @param frame The frame at which the window ends
+ * @param lufs Receives the loudness
+ * @return true on success, false on an invalid frame or if there is no seek index.
+ */
+bool AudioUtil::shortTermLoudness(sf_count_t frame, double *lufs)
+{
+    sf_count_t end = min(max(frame, (sf_count_t) 1), this->getTotalFrames());
+    sf_count_t start = max((sf_count_t) 0, end - (sf_count_t) SHORT_TERM_LOUDNESS_SECONDS * this->getSampleRate());
+    return this->loudnessForRegion(start, end, lufs);
+}
+
+/**
+ * \brief A range of frames of the wrapped audio file.
+ *
+ * Function to get count frames, starting at frame start, of the audio file wrapped by an instance of AudioUtil
+ * as interleaved double-precision floating-point values.  Unlike getAllFrames(), the cost of this function only
+ * depends on the size of the requested range.  If the range extends past the end of the file, it is truncated.
+ *
+ * @param start The first frame to return
+ * @param count The number of frames to return
+ * @return a vector of numChannels*count values, or an empty vector if the range is invalid or could not be read.
+ */
+vector<double> AudioUtil::getFrames(sf_count_t start, sf_count_t count)
+{
+    PERF_SCOPE("AudioUtil::getFrames");
+
+    vector<double> frames;
+    int numChannels = this->getNumChannels();
+    if(start < 0 || count <= 0 || start >= this->getTotalFrames() || numChannels == 0)
+    {
+        return frames;
+    }
+    sf_count_t end = min(this->getTotalFrames(), start + count);
+    frames.reserve((size_t) ((end - start) * numChannels));
+
+    Reader *reader = this->acquireReader();
+    while(start < end)
+    {
+        int piece = this->edits.findPiece(start);
+        EditPiece edit = this->edits.getPiece(piece);
+        sf_count_t offset = edit.sourceStart - this->edits.getPieceStart(piece);
+        sf_count_t pieceEnd = min(end, this->edits.getPieceStart(piece + 1));
+        while(start < pieceEnd)
+        {
+            sf_count_t available;
+            const double *data = (reader != NULL) ? this->frameSpan(reader, start + offset, &available) : NULL;
+            if(data == NULL)
             {
-                perror("read error in AudioUtil::peakForRegion function\n");
-                return this->regionPeak;
+                this->releaseReader(reader);
+                perror("read error in AudioUtil::getFrames function\n");
+                return vector<double>();
             }
 
-            double max0 = 0.0;
-
-             for (int i = 0; i <  region_end_frame - region_start_frame; i++)
-             {
-                if(fabs(chunk[i]) > max0)
+            sf_count_t n = min(available, pieceEnd - start);
+            size_t first = frames.size();
+            frames.insert(frames.end(), data, data + n * numChannels);
+            if(edit.gain != 1.0)
+            {
+                for(size_t i = first; i < frames.size(); i++)
                 {
-                  max0 = fabs(chunk[i]);
+                    frames[i] *= edit.gain;
                 }
             }
+            start += n;
+        }
+    }
 
-           this->regionPeak.push_back(max0);
+    this->releaseReader(reader);
+    return frames;
+}
 
-           delete[] chunk;
+/**
+ * \brief Frees the cached samples of a region of the wrapped file.
+ *
+ * In FULL_CACHE mode the cache is held in chunks of CACHE_CHUNK_FRAMES frames.  This function releases every
+ * chunk that lies entirely inside [startFrame, endFrame), so that an application can give back the memory of
+ * parts of a long file it is not currently looking at.  Frames of released chunks are read from the file,
+ * a block at a time, when they are needed again, as in DISK_MODE.  Has no effect in the other modes.  The region
+ * is given in frames of the wrapped file, regardless of setEdits().
+ *
+ * @param startFrame First frame of the region
+ * @param endFrame Frame just past the end of the region
+ */
+void AudioUtil::releaseCacheRegion(sf_count_t startFrame, sf_count_t endFrame)
+{
+    sf_count_t firstChunk = (startFrame + CACHE_CHUNK_FRAMES - 1) / CACHE_CHUNK_FRAMES;
+    sf_count_t endChunk = (endFrame >= this->sourceFrames()) ? this->fileCache.getNumChunks() : endFrame / CACHE_CHUNK_FRAMES;
+    for(sf_count_t c = firstChunk; c < endChunk; c++)
+    {
+        this->fileCache.releaseChunk(c);
+    }
+}
 
-           return this->regionPeak;
-       }
-   }
-   perror("err in AudioUtil::peakForRegion function.  Max channels: 2\n");
-   return this->regionPeak;
+/**
+ * \brief Bytes of memory currently held by the sample cache of the FULL_CACHE or COMPRESSED_CACHE mode.
+ */
+size_t AudioUtil::getCacheBytes()
+{
+    std::lock_guard<std::mutex> guard(this->compressedCacheMutex);
+    return this->fileCache.getResidentBytes() + this->compressedCache.getResidentBytes();
+}
+
+/**
+ * \brief The account the memory of this instance's caches is counted in.
+ *
+ * The sample caches of the FULL_CACHE and COMPRESSED_CACHE modes, the seek index and the blocks read ahead in
+ * DISK_MODE are each counted in their own MemoryTier.  To take that memory from another MemoryResource, call
+ * getMemoryAccount()->setResource() before the first file is set; it is refused while the caches hold memory.
+ */
+MemoryAccount *AudioUtil::getMemoryAccount()
+{
+    return &this->memoryAccount;
+}
+
+/**
+ * \brief Enables reading ahead of the viewer in DISK_MODE.
+ *
+ * With read-ahead enabled, the first hintAccess() in DISK_MODE starts a thread that keeps a window of blocks around
+ * the hinted position in memory: ahead of it in the direction the hints are moving, or on both sides while they
+ * stand still.  A read whose block is there does not touch the file.  The window starts at READ_AHEAD_MIN_BLOCKS
+ * blocks.  It doubles when a read near the hinted position falls outside it, and halves when a window's worth of
+ * blocks has been read ahead and dropped unused, always within READ_AHEAD_MAX_BLOCKS.  Disabled by default, and
+ * without effect in the other modes, which hold the file in memory.
+ *
+ * @param enabled true to read ahead.
+ */
+void AudioUtil::setReadAhead(bool enabled)
+{
+    if(!enabled)
+    {
+        this->stopReadAhead();
+    }
+    this->readAheadEnabled = enabled;
+}
+
+/**
+ * \brief Whether reading ahead is enabled.
+ */
+bool AudioUtil::getReadAhead()
+{
+    return this->readAheadEnabled;
+}
+
+/**
+ * \brief Tells the read-ahead thread which frame is being looked at or played.
+ *
+ * Successive hints give the direction and speed of scrolling or playback.  A hint far from the previous one, or
+ * more than READ_AHEAD_IDLE_SECONDS after it, starts over.  Returns at once; may be called from any thread, also
+ * while loadFile() runs.  Does nothing unless read-ahead is enabled and the instance is in DISK_MODE.
+ *
+ * @param frame The frame at the middle of the view, or under the playhead.
+ */
+void AudioUtil::hintAccess(sf_count_t frame)
+{
+    if(!this->readAheadEnabled || this->fileHandlingMode != DISK_MODE || !this->sndFileNotEmpty)
+    {
+        return;
+    }
+    sf_count_t sourceFrame = this->edits.toSource(frame);
+    if(sourceFrame >= 0)
+    {
+        frame = sourceFrame;
+    }
+
+    std::lock_guard<std::mutex> guard(this->readAheadMutex);
+    if(this->hinted && frame == this->hintFrame)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - this->hintTime).count();
+    sf_count_t distance = frame - this->hintFrame;
+    if(!this->hinted || elapsed > READ_AHEAD_IDLE_SECONDS || llabs(distance) > 2 * this->readAheadWindow * SEEK_INDEX_BLOCK_FRAMES)
+    {
+        this->hintVelocity = 0.0;
+    }
+    else if(elapsed > 0.0)
+    {
+        /* Smoothed over a few hints, so that an uneven paint rate does not flip the direction. */
+        this->hintVelocity = 0.5 * this->hintVelocity + 0.5 * distance / elapsed;
+    }
+    this->hintFrame = frame;
+    this->hintTime = now;
+    this->hinted = true;
+    this->readAheadPending = true;
+
+    if(!this->readAheadRunning)
+    {
+        this->readAheadRunning = true;
+        this->readAheadThread = std::thread(&AudioUtil::readAhead, this);
+    }
+    this->readAheadWake.notify_one();
+}
+
+/**
+ * \brief Enables hints to the kernel about how the wrapped file is about to be read.
+ *
+ * With read hints enabled, the pass of loadFile() is announced as sequential and the kernel is asked to read
+ * READ_HINT_PASS_BLOCKS blocks ahead of it, so that the device is kept busy while the pass decodes.  In FULL_CACHE
+ * and COMPRESSED_CACHE mode, where the samples are held in memory once read, the pages the pass is done with are
+ * dropped from the page cache, so that loading a long file does not evict the pages of other files.  In DISK_MODE,
+ * the blocks of the read-ahead window (see setReadAhead()) and those of approximatePeaks() are asked for at once,
+ * before the first of them is read, rather than one at a time.  Only files set by path are hinted, and only
+ * uncompressed ones by range; see FileReadHints.  Disabled by default.
+ *
+ * @param enabled true to give hints.
+ */
+void AudioUtil::setReadHints(bool enabled)
+{
+    this->readHintsEnabled = enabled;
+    this->readHints.close();
+    if(enabled && this->sndFileNotEmpty && this->source == NULL)
+    {
+        this->readHints.open(this->srcFilePath, *this->sfinfo);
+    }
+}
+
+/**
+ * \brief Whether read hints are enabled.
+ */
+bool AudioUtil::getReadHints()
+{
+    return this->readHintsEnabled;
+}
+
+/**
+ * \brief Shows the wrapped file through an edit list.
+ *
+ * From then on, the accessors and every function that reads the file see the edited file: its frames are those
+ * of the pieces of the list, in order, multiplied by their gain.  Each query is answered piece by piece from the
+ * caches and the seek index of the unedited file, so setting a list copies nothing and reads nothing, whatever
+ * the length of the file.  Silences and onsets are those of the unedited audio, before gain, cut at the edges of
+ * the pieces.  The list is discarded when another file is set.
+ *
+ * @param edits A list made for the wrapped file: its getSourceFrames() must be the length of the file.
+ * @return true on success, false if the list was made for a file of another length.
+ */
+bool AudioUtil::setEdits(EditList edits)
+{
+    if(edits.getSourceFrames() != this->sourceFrames())
+    {
+        fprintf(stderr, "err in AudioUtil::setEdits -- edit list made for %lld frames, file has %lld\n",
+                (long long) edits.getSourceFrames(), (long long) this->sourceFrames());
+        return false;
+    }
+    this->edits = edits;
+    return true;
+}
+
+/**
+ * \brief A copy of the edit list the wrapped file is seen through.  Edit it and pass it back to setEdits().
+ */
+EditList AudioUtil::getEdits()
+{
+    return this->edits;
 }
 
+/**
+ * \brief Shows the wrapped file unedited again.
+ */
+void AudioUtil::clearEdits()
+{
+    this->edits.reset(this->sourceFrames());
+}
 
 /**
  * \brief The content of the wrapped audio file.
@@ -461,83 +1483,803 @@ vector<double> AudioUtil::peakForRegion(int region_start_frame, int region_end_f
  */
 vector<double> AudioUtil::getAllFrames()
 {
+   PERF_SCOPE("AudioUtil::getAllFrames");
 
-   if(this->fileHandlingMode == FULL_CACHE)
+   if(this->fileHandlingMode != DISK_MODE || !this->edits.isIdentity())
    {
-      return this->fileCache;
+      PERF_COUNT("AudioUtil::cacheHit");
+      return this->getFrames(0, this->getTotalFrames());
    }
    else
    {
-       this->dataVector.clear();
+       PERF_COUNT("AudioUtil::cacheMiss");
+       vector<double> dataVector;
+       Reader *reader = this->acquireReader();
+       if(reader == NULL)
+       {
+           return dataVector;
+       }
        int readSize = 1024;
 
        //seek to file start
-      if (sf_seek(sndFile, 0, SEEK_SET) == -1)
+      reader->readPosition = -1;
+      if (sf_seek(reader->sndFile, 0, SEEK_SET) == -1)
       {
           fprintf(stderr, "seek failed in AudioUtil::getAllFrames() function\n");
       }
        double *chunk = new double[readSize];
-       int itemsRead = sf_read_double(this->sndFile, chunk, readSize);
+       int itemsRead = sf_read_double(reader->sndFile, chunk, readSize);
 
        while(itemsRead == readSize)
        {
 
            for(int i = 0; i < readSize; i++)
            {
-                this->dataVector.push_back(chunk[i]);
+                dataVector.push_back(chunk[i]);
            }
 
-           itemsRead = sf_read_double(this->sndFile, chunk, readSize);
+           itemsRead = sf_read_double(reader->sndFile, chunk, readSize);
        }
 
        //add the last items to the vector
        for(int i = 0; i < itemsRead; i++)
        {
-            this->dataVector.push_back(chunk[i]);
+            dataVector.push_back(chunk[i]);
        }
 
        delete[] chunk;
+       this->releaseReader(reader);
 
-       return this->dataVector;
+       return dataVector;
    }
 }
 
 
 /**
- * For internal use only!!!  Function populates the fileCache vector with the contents of the audio file wrapped by this 
- * instance of AudioUtil.
+ * For internal use only!!!  Function populates the cache of the current file-handling mode with the contents of the audio
+ * file wrapped by this instance of AudioUtil.
  */
 void AudioUtil::populateCache()
 {
-    this->fileCache.clear();
-    int readSize = 1024;
+    PERF_SCOPE("AudioUtil::populateCache");
+    this->ingest(true);
+}
+
+/*
+ * Makes one sequential pass over the wrapped file, filling the cache if fillCache is set, feeding the
+ * seek index if one is wanted and not yet complete, and feeding the event index if it is not complete.
+ */
+void AudioUtil::ingest(bool fillCache)
+{
+    PERF_SCOPE("AudioUtil::ingest");
+
+    int numChannels = this->getNumChannels();
+    bool fillIndex = this->wantsSeekIndex() && !this->seekIndex.isComplete();
+    bool fillEvents = !this->eventIndex.isComplete();
+
+    bool fillCompressed = fillCache && this->fileHandlingMode == COMPRESSED_CACHE;
+    fillCache = fillCache && this->fileHandlingMode == FULL_CACHE;
+
+    if(fillCache)
+    {
+        this->fileCache.reset(numChannels, this->sourceFrames());
+    }
+    if(fillCompressed)
+    {
+        this->compressedCache.reset(numChannels, this->sourceFrames());
+    }
+    if(fillIndex)
+    {
+        this->indexedFrames = 0;
+        this->seekIndex.reset(numChannels, this->sourceFrames(), this->getSampleRate());
+    }
+    if(fillEvents)
+    {
+        this->eventIndex.reset(numChannels, this->sourceFrames(), this->getSampleRate());
+    }
+
+    Reader *reader = this->acquireReader();
+    if(reader == NULL)
+    {
+        return;
+    }
 
     //seek to file start
-   if (sf_seek(sndFile, 0, SEEK_SET) == -1)
-   {
-       fprintf(stderr, "seek failed in AudioUtil::getAllFrames() function\n");
-   }
+    if (sf_seek(reader->sndFile, 0, SEEK_SET) == -1)
+    {
+        fprintf(stderr, "seek failed in AudioUtil::ingest() function\n");
+        reader->readPosition = -1;
+        this->releaseReader(reader);
+        return;
+    }
+    reader->readPosition = 0;
+
+    double *chunk = new double[SEEK_INDEX_BLOCK_FRAMES * numChannels];
+    sf_count_t framesRead;
 
-    double *chunk = new double[readSize];
-    int itemsRead = sf_read_double(this->sndFile, chunk, readSize);
+    /* Once a cache holds the samples, the pages the pass has read are of no more use. */
+    bool dropBehind = fillCache || fillCompressed;
+    sf_count_t position = 0;
+    sf_count_t hintedEnd = 0;
+    sf_count_t droppedEnd = 0;
+    this->readHints.setSequential(true);
 
-    while(itemsRead == readSize)
+    while(true)
     {
+        if(position + (READ_HINT_PASS_BLOCKS/2) * SEEK_INDEX_BLOCK_FRAMES >= hintedEnd)
+        {
+            hintedEnd = position + READ_HINT_PASS_BLOCKS * SEEK_INDEX_BLOCK_FRAMES;
+            this->readHints.willNeed(position, hintedEnd);
+            if(dropBehind)
+            {
+                this->readHints.dontNeed(droppedEnd, position);
+                droppedEnd = position;
+            }
+        }
+        if((framesRead = this->readFrames(reader, chunk, SEEK_INDEX_BLOCK_FRAMES)) <= 0)
+        {
+            break;
+        }
+        position += framesRead;
 
-        for(int i = 0; i < readSize; i++)
+        if(fillCache)
+        {
+            this->fileCache.append(chunk, framesRead);
+        }
+        if(fillCompressed)
+        {
+            this->compressedCache.append(chunk, framesRead);
+        }
+        if(fillIndex)
         {
-             this->fileCache.push_back(chunk[i]);
+            this->seekIndex.addFrames(chunk, framesRead);
+            /* Published after the blocks are written, for loadedPeaks() on other threads. */
+            this->indexedFrames += framesRead;
         }
+        if(fillEvents)
+        {
+            this->eventIndex.addFrames(chunk, framesRead);
+        }
+    }
 
-        itemsRead = sf_read_double(this->sndFile, chunk, readSize);
+    this->readHints.setSequential(false);
+    if(dropBehind)
+    {
+        this->readHints.dontNeedAll();
     }
+    delete[] chunk;
+    this->releaseReader(reader);
+}
 
-    //add the last items to the vector
-    for(int i = 0; i < itemsRead; i++)
+/*
+ * Takes an idle decoder from the pool, or opens another handle on the wrapped file if every
+ * decoder is in use.  Returns NULL if no file is open or the file could not be opened again.
+ */
+AudioUtil::Reader *AudioUtil::acquireReader()
+{
+    this->readerMutex.lock();
+    if(!this->idleReaders.empty())
     {
-         this->fileCache.push_back(chunk[i]);
+        Reader *reader = this->idleReaders.back();
+        this->idleReaders.pop_back();
+        this->readerMutex.unlock();
+        return reader;
     }
+    this->readerMutex.unlock();
 
-    delete[] chunk;
+    if(!this->sndFileNotEmpty)
+    {
+        return NULL;
+    }
+
+    PERF_COUNT("AudioUtil::readerOpened");
+    Reader *reader = new Reader;
+    SF_INFO info = this->sourceFormat;
+    SNDFILE *sndFile = this->openHandle(reader, &info);
+    if(sndFile == NULL)
+    {
+        fprintf(stderr, "failed to open another decoder of \"%s\".\n", this->srcFilePath.c_str());
+        delete reader;
+        return NULL;
+    }
+    sf_command(sndFile, SFC_SET_NORM_DOUBLE, NULL, SF_TRUE);
+
+    reader->sndFile = sndFile;
+    reader->readPosition = 0;
+    reader->blockBufferIndex = -1;
+    return reader;
+}
+
+/*
+ * Opens a libsndfile handle for reader on the wrapped file or source.  A source handle keeps its
+ * position in the reader, which therefore must not move while the handle is open.
+ */
+SNDFILE *AudioUtil::openHandle(Reader *reader, SF_INFO *info)
+{
+    if(this->source != NULL)
+    {
+        return this->source->open(info, &reader->cursor);
+    }
+    return sf_open(this->srcFilePath.c_str(), SFM_READ, info);
+}
+
+/*
+ * Returns a decoder to the pool.  The most recently returned decoder is handed out first, so a
+ * single thread keeps reading through the same decoder and its buffered block.
+ */
+void AudioUtil::releaseReader(Reader *reader)
+{
+    if(reader == NULL)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(this->readerMutex);
+    this->idleReaders.push_back(reader);
+}
+
+/*
+ * Closes every decoder.  No read may be in progress.
+ */
+void AudioUtil::closeReaders()
+{
+    std::lock_guard<std::mutex> guard(this->readerMutex);
+    for(size_t i = 0; i < this->idleReaders.size(); i++)
+    {
+        sf_close(this->idleReaders[i]->sndFile);
+        delete this->idleReaders[i];
+    }
+    this->idleReaders.clear();
+}
+
+/*
+ * Stops the read-ahead thread and drops the blocks it has read.
+ */
+void AudioUtil::stopReadAhead()
+{
+    this->readAheadMutex.lock();
+    this->readAheadRunning = false;
+    this->readAheadWake.notify_all();
+    this->readAheadMutex.unlock();
+
+    if(this->readAheadThread.joinable())
+    {
+        this->readAheadThread.join();
+    }
+
+    std::lock_guard<std::mutex> guard(this->readAheadMutex);
+    this->readAheadBlocks.clear();
+    this->readAheadPending = false;
+    this->hinted = false;
+    this->hintVelocity = 0.0;
+    this->readAheadWindow = READ_AHEAD_MIN_BLOCKS;
+    this->readAheadWasted = 0;
+}
+
+/*
+ * The read-ahead thread.  Each time a hint arrives, it drops the blocks that have left the window
+ * and reads the missing ones, nearest first, until the window is full or another hint arrives.
+ */
+void AudioUtil::readAhead()
+{
+    std::unique_lock<std::mutex> lock(this->readAheadMutex);
+    while(this->readAheadRunning)
+    {
+        if(!this->readAheadPending)
+        {
+            this->readAheadWake.wait(lock);
+            continue;
+        }
+        this->readAheadPending = false;
+
+        sf_count_t first, last;
+        int direction;
+        this->readAheadRange(&first, &last, &direction);
+
+        map<sf_count_t, ReadAheadBlock>::iterator i = this->readAheadBlocks.begin();
+        while(i != this->readAheadBlocks.end())
+        {
+            if(i->first >= first && i->first <= last)
+            {
+                ++i;
+                continue;
+            }
+            if(!i->second.used)
+            {
+                PERF_COUNT("AudioUtil::readAheadWasted");
+                this->readAheadWasted++;
+            }
+            this->readAheadBlocks.erase(i++);
+        }
+        if(this->readAheadWasted >= this->readAheadWindow)
+        {
+            this->readAheadWindow = max((sf_count_t) READ_AHEAD_MIN_BLOCKS, this->readAheadWindow / 2);
+            this->readAheadWasted = 0;
+        }
+
+        /* The kernel is asked for every missing run of the window at once, and reads them in parallel. */
+        if(this->readHints.isFrameAddressable())
+        {
+            vector<sf_count_t> runs;
+            for(sf_count_t block = first; block <= last; block++)
+            {
+                if(this->readAheadBlocks.count(block) > 0)
+                {
+                    continue;
+                }
+                if(!runs.empty() && runs.back() == block)
+                {
+                    runs.back() = block + 1;
+                }
+                else
+                {
+                    runs.push_back(block);
+                    runs.push_back(block + 1);
+                }
+            }
+            lock.unlock();
+            for(size_t r = 0; r < runs.size(); r += 2)
+            {
+                this->readHints.willNeed(runs[r] * SEEK_INDEX_BLOCK_FRAMES, runs[r + 1] * SEEK_INDEX_BLOCK_FRAMES);
+            }
+            lock.lock();
+        }
+
+        sf_count_t center = this->hintFrame / SEEK_INDEX_BLOCK_FRAMES;
+        Reader *reader = NULL;
+        for(sf_count_t step = 0; step <= 2 * (last - first) && this->readAheadRunning && !this->readAheadPending; step++)
+        {
+            sf_count_t block;
+            if(direction > 0)
+            {
+                block = first + step;
+            }
+            else if(direction < 0)
+            {
+                block = last - step;
+            }
+            else
+            {
+                block = (step % 2 == 1) ? center + (step + 1)/2 : center - step/2;
+            }
+            if(block < first || block > last || this->readAheadBlocks.count(block) > 0)
+            {
+                continue;
+            }
+
+            lock.unlock();
+            if(reader == NULL)
+            {
+                reader = this->acquireReader();
+            }
+            ReadAheadBlock fetched;
+            fetched.frames = CacheVector<double>(CacheAllocator<double>(&this->memoryAccount, TIER_READ_AHEAD));
+            fetched.used = false;
+            bool read = (reader != NULL && this->loadBlock(reader, block));
+            if(read)
+            {
+                PERF_COUNT("AudioUtil::readAheadBlock");
+                sf_count_t frames = min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames() - block * SEEK_INDEX_BLOCK_FRAMES);
+                fetched.frames.assign(reader->blockBuffer.begin(), reader->blockBuffer.begin() + frames * this->getNumChannels());
+            }
+            lock.lock();
+
+            if(!read)
+            {
+                break;
+            }
+            ReadAheadBlock &slot = this->readAheadBlocks[block];
+            slot.frames.swap(fetched.frames);
+            slot.used = false;
+        }
+        this->releaseReader(reader);
+    }
+}
+
+/*
+ * The blocks [first, last] the read-ahead thread should hold for the last hint, and the direction
+ * of movement: 1 forward, -1 backward, 0 for none.  Called with readAheadMutex held.
+ */
+void AudioUtil::readAheadRange(sf_count_t *first, sf_count_t *last, int *direction)
+{
+    sf_count_t center = this->hintFrame / SEEK_INDEX_BLOCK_FRAMES;
+    *direction = 0;
+    if(this->hintVelocity > SEEK_INDEX_BLOCK_FRAMES)
+    {
+        *direction = 1;
+    }
+    else if(this->hintVelocity < -SEEK_INDEX_BLOCK_FRAMES)
+    {
+        *direction = -1;
+    }
+
+    if(*direction > 0)
+    {
+        *first = center;
+        *last = center + this->readAheadWindow;
+    }
+    else if(*direction < 0)
+    {
+        *first = center - this->readAheadWindow;
+        *last = center;
+    }
+    else
+    {
+        *first = center - this->readAheadWindow/2;
+        *last = center + this->readAheadWindow/2;
+    }
+
+    sf_count_t numBlocks = (this->sourceFrames() + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES;
+    *first = max((sf_count_t) 0, *first);
+    *last = min(numBlocks - 1, *last);
+}
+
+/*
+ * Serves a block from the read-ahead thread's blocks, if it has it, into a decoder's block buffer.
+ * A miss near the hinted position but outside the window means the window is too small.
+ */
+bool AudioUtil::takeReadAhead(Reader *reader, sf_count_t block)
+{
+    if(!this->readAheadEnabled || this->fileHandlingMode != DISK_MODE || block == reader->blockBufferIndex)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(this->readAheadMutex);
+    if(!this->readAheadRunning)
+    {
+        return false;
+    }
+
+    map<sf_count_t, ReadAheadBlock>::iterator i = this->readAheadBlocks.find(block);
+    if(i == this->readAheadBlocks.end())
+    {
+        sf_count_t first, last;
+        int direction;
+        this->readAheadRange(&first, &last, &direction);
+        if((block < first || block > last) && llabs(block - this->hintFrame / SEEK_INDEX_BLOCK_FRAMES) <= 2 * this->readAheadWindow
+                && this->readAheadWindow < READ_AHEAD_MAX_BLOCKS)
+        {
+            PERF_COUNT("AudioUtil::readAheadMiss");
+            this->readAheadWindow = min((sf_count_t) READ_AHEAD_MAX_BLOCKS, this->readAheadWindow * 2);
+            this->readAheadWasted = 0;
+            this->readAheadPending = true;
+            this->readAheadWake.notify_one();
+        }
+        return false;
+    }
+
+    PERF_COUNT("AudioUtil::readAheadHit");
+    i->second.used = true;
+    reader->blockBuffer.assign(i->second.frames.begin(), i->second.frames.end());
+    reader->blockBufferIndex = block;
+    return true;
+}
+
+/*
+ * Moves a decoder to the given frame.  For compressed formats a short distance forward is
+ * covered by decoding and discarding frames, which is much cheaper than a seek that has to search
+ * for a sync point.  The decoder's block buffer is used as scratch space, so it is invalidated.
+ */
+bool AudioUtil::seekTo(Reader *reader, sf_count_t frame)
+{
+    if(frame == reader->readPosition)
+    {
+        return true;
+    }
+
+    if(this->isCompressedFormat() && reader->readPosition >= 0 && frame > reader->readPosition
+            && frame - reader->readPosition <= SEEK_FORWARD_READ_LIMIT)
+    {
+        PERF_COUNT("AudioUtil::seekAvoided");
+        reader->blockBufferIndex = -1;
+        reader->blockBuffer.resize(SEEK_INDEX_BLOCK_FRAMES * this->getNumChannels());
+        while(reader->readPosition < frame)
+        {
+            sf_count_t toSkip = min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, frame - reader->readPosition);
+            if(this->readFrames(reader, &reader->blockBuffer[0], toSkip) <= 0)
+            {
+                break;
+            }
+        }
+        if(reader->readPosition == frame)
+        {
+            return true;
+        }
+    }
+
+    PERF_COUNT("AudioUtil::seek");
+    if(sf_seek(reader->sndFile, frame, SEEK_SET) == -1)
+    {
+        reader->readPosition = -1;
+        return false;
+    }
+    reader->readPosition = frame;
+    return true;
+}
+
+/*
+ * Reads frames from a decoder's current position, keeping track of where it ends up.
+ */
+sf_count_t AudioUtil::readFrames(Reader *reader, double *buffer, sf_count_t frames)
+{
+    sf_count_t framesRead = sf_readf_double(reader->sndFile, buffer, frames);
+    if(framesRead > 0 && reader->readPosition >= 0)
+    {
+        reader->readPosition += framesRead;
+    }
+    return framesRead;
+}
+
+/*
+ * Makes the given block of the wrapped file available in a decoder's block buffer.  DISK_MODE
+ * reads always go through whole, aligned blocks so that consecutive requests reuse the buffered
+ * block or continue reading where the previous one stopped.
+ */
+bool AudioUtil::loadBlock(Reader *reader, sf_count_t block)
+{
+    if(block == reader->blockBufferIndex)
+    {
+        PERF_COUNT("AudioUtil::blockBufferHit");
+        return true;
+    }
+    PERF_COUNT("AudioUtil::blockBufferMiss");
+
+    sf_count_t firstFrame = block * SEEK_INDEX_BLOCK_FRAMES;
+    sf_count_t frames = min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames() - firstFrame);
+    if(frames <= 0 || !this->seekTo(reader, firstFrame))
+    {
+        return false;
+    }
+
+    reader->blockBuffer.resize(SEEK_INDEX_BLOCK_FRAMES * this->getNumChannels());
+    if(this->readFrames(reader, &reader->blockBuffer[0], frames) != frames)
+    {
+        reader->blockBufferIndex = -1;
+        return false;
+    }
+    reader->blockBufferIndex = block;
+    return true;
+}
+
+/*
+ * Like scanRegion(), but with a seek index, only the partial blocks at either end of the region
+ * are scanned; the whole blocks in between are answered by the index (see rangeExtremes()).
+ */
+bool AudioUtil::foldRegionPeak(Reader *reader, sf_count_t start, sf_count_t end, double *peak, bool exact)
+{
+    sf_count_t firstWholeBlock, endWholeBlock;
+    if(!this->wholeBlocks(start, end, &firstWholeBlock, &endWholeBlock))
+    {
+        return this->scanRegion(reader, start, end, peak);
+    }
+
+    double minValue[MAX_CHANNELS], maxValue[MAX_CHANNELS];
+    if(!this->rangeExtremes(reader, firstWholeBlock, endWholeBlock, exact, minValue, maxValue))
+    {
+        return false;
+    }
+    for(int c = 0; c < this->getNumChannels(); c++)
+    {
+        double value = (fabs(minValue[c]) > fabs(maxValue[c])) ? minValue[c] : maxValue[c];
+        if(fabs(value) > fabs(peak[c]))
+        {
+            peak[c] = value;
+        }
+    }
+    return this->scanRegion(reader, start, firstWholeBlock*SEEK_INDEX_BLOCK_FRAMES, peak)
+            && this->scanRegion(reader, min(end, endWholeBlock*SEEK_INDEX_BLOCK_FRAMES), end, peak);
+}
+
+/*
+ * Like foldRegionPeak(), for the running minimum, maximum and sum of squares of scanStats().
+ */
+bool AudioUtil::foldRegionStats(Reader *reader, sf_count_t start, sf_count_t end, double *minValue, double *maxValue, double *sumSquares, bool exact)
+{
+    sf_count_t firstWholeBlock, endWholeBlock;
+    if(!this->wholeBlocks(start, end, &firstWholeBlock, &endWholeBlock))
+    {
+        return this->scanStats(reader, start, end, minValue, maxValue, sumSquares);
+    }
+
+    double low[MAX_CHANNELS], high[MAX_CHANNELS];
+    if(!this->rangeExtremes(reader, firstWholeBlock, endWholeBlock, exact, low, high))
+    {
+        return false;
+    }
+    for(int c = 0; c < this->getNumChannels(); c++)
+    {
+        minValue[c] = min(minValue[c], low[c]);
+        maxValue[c] = max(maxValue[c], high[c]);
+        sumSquares[c] += this->seekIndex.rangeSumOfSquares(firstWholeBlock, endWholeBlock, c);
+    }
+    return this->scanStats(reader, start, firstWholeBlock*SEEK_INDEX_BLOCK_FRAMES, minValue, maxValue, sumSquares)
+            && this->scanStats(reader, min(end, endWholeBlock*SEEK_INDEX_BLOCK_FRAMES), end, minValue, maxValue, sumSquares);
+}
+
+/*
+ * The minimum and maximum of each channel over the whole blocks [firstBlock, endBlock).  The seek index
+ * gives them rounded outwards.  If exact, and the index did not store them exactly, the blocks with the
+ * lowest and highest bounds are read, then every other block whose bounds still reach beyond what was
+ * found; on ordinary audio, that is the first two.
+ */
+bool AudioUtil::rangeExtremes(Reader *reader, sf_count_t firstBlock, sf_count_t endBlock, bool exact, double *minValue, double *maxValue)
+{
+    int numChannels = this->getNumChannels();
+    for(int c = 0; c < numChannels; c++)
+    {
+        this->seekIndex.rangeMinMax(firstBlock, endBlock, c, &minValue[c], &maxValue[c]);
+    }
+    if(!exact || this->seekIndex.hasExactExtremes())
+    {
+        return true;
+    }
+
+    map<sf_count_t, vector<double> > blocks;
+    vector<sf_count_t> candidates;
+    for(int c = 0; c < numChannels; c++)
+    {
+        minValue[c] = HUGE_VAL;
+        maxValue[c] = -HUGE_VAL;
+        candidates.clear();
+        candidates.push_back(this->seekIndex.lowestBlock(firstBlock, endBlock, c));
+        candidates.push_back(this->seekIndex.highestBlock(firstBlock, endBlock, c));
+        for(int round = 0; round < 2; round++)
+        {
+            for(size_t i = 0; i < candidates.size(); i++)
+            {
+                const vector<double> *extremes = this->blockExtremes(reader, candidates[i], &blocks);
+                if(extremes == NULL)
+                {
+                    return false;
+                }
+                minValue[c] = min(minValue[c], (*extremes)[c]);
+                maxValue[c] = max(maxValue[c], (*extremes)[numChannels + c]);
+            }
+            if(round == 0)
+            {
+                this->seekIndex.blocksBeyond(firstBlock, endBlock, c, minValue[c], maxValue[c], &candidates);
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * The exact minimum of each channel of one block, followed by its maximum, read once per call of
+ * rangeExtremes() and kept in blocks.  Returns NULL on a read error.
+ */
+const vector<double> *AudioUtil::blockExtremes(Reader *reader, sf_count_t block, map<sf_count_t, vector<double> > *blocks)
+{
+    map<sf_count_t, vector<double> >::iterator found = blocks->find(block);
+    if(found != blocks->end())
+    {
+        return &found->second;
+    }
+
+    PERF_COUNT("AudioUtil::exactBlocks");
+    int numChannels = this->getNumChannels();
+    vector<double> extremes(2*numChannels);
+    fill_n(extremes.begin(), numChannels, HUGE_VAL);
+    fill_n(extremes.begin() + numChannels, numChannels, -HUGE_VAL);
+    double sumSquares[MAX_CHANNELS] = {};
+    sf_count_t start = block*SEEK_INDEX_BLOCK_FRAMES;
+    if(!this->scanStats(reader, start, min(start + SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames()), &extremes[0], &extremes[numChannels], sumSquares))
+    {
+        return NULL;
+    }
+    return &((*blocks)[block] = extremes);
+}
+
+/*
+ * Folds the frames [start, end) of the wrapped file into peak (one signed value of greatest
+ * magnitude per channel), from the cache or the file depending on the file-handling mode.
+ */
+bool AudioUtil::scanRegion(Reader *reader, sf_count_t start, sf_count_t end, double *peak)
+{
+    while(start < end)
+    {
+        sf_count_t available;
+        const double *frames = this->frameSpan(reader, start, &available);
+        if(frames == NULL)
+        {
+            return false;
+        }
+        sf_count_t n = min(available, end - start);
+        this->kernels.foldPeaks(frames, n, peak);
+        start += n;
+    }
+    return true;
+}
+
+/*
+ * Like scanRegion(), but folds the frames [start, end) into a running minimum, maximum and sum of
+ * squares per channel.
+ */
+bool AudioUtil::scanStats(Reader *reader, sf_count_t start, sf_count_t end, double *minValue, double *maxValue, double *sumSquares)
+{
+    while(start < end)
+    {
+        sf_count_t available;
+        const double *frames = this->frameSpan(reader, start, &available);
+        if(frames == NULL)
+        {
+            return false;
+        }
+        sf_count_t n = min(available, end - start);
+        this->kernels.foldStats(frames, n, minValue, maxValue, sumSquares);
+        start += n;
+    }
+    return true;
+}
+
+/*
+ * With a complete seek index, finds the run of whole index blocks [firstBlock, endBlock) inside the
+ * region [start, end).  The last block of the file counts as whole when the region reaches the end
+ * of the file.  Returns false if there is no index or no such block.
+ */
+bool AudioUtil::wholeBlocks(sf_count_t start, sf_count_t end, sf_count_t *firstBlock, sf_count_t *endBlock)
+{
+    if(!this->hasSeekIndex())
+    {
+        return false;
+    }
+
+    *firstBlock = (start + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES;
+    *endBlock = end / SEEK_INDEX_BLOCK_FRAMES;
+    if(end == this->sourceFrames())
+    {
+        *endBlock = this->seekIndex.getNumBlocks();
+    }
+    return *firstBlock < *endBlock;
+}
+
+/*
+ * Returns a pointer to the given frame and, in available, how many frames follow it contiguously:
+ * up to the end of a cache chunk in FULL_CACHE mode, or of a block otherwise.  Cached samples are
+ * only read; anything else goes through the decoder's block buffer.  The pointer is only valid
+ * until the decoder is used again.  Returns NULL if the frame could not be read.
+ */
+const double *AudioUtil::frameSpan(Reader *reader, sf_count_t frame, sf_count_t *available)
+{
+    if(this->fileHandlingMode == FULL_CACHE && this->loaded)
+    {
+        sf_count_t chunk = frame / CACHE_CHUNK_FRAMES;
+        const double *data = this->fileCache.chunkData(chunk);
+        if(data != NULL)
+        {
+            sf_count_t offset = frame - chunk * CACHE_CHUNK_FRAMES;
+            *available = this->fileCache.chunkFrames(chunk) - offset;
+            return data + offset * this->getNumChannels();
+        }
+        /* The chunk has been released: read the block from the file instead. */
+        PERF_COUNT("AudioUtil::releasedChunkRead");
+    }
+
+    sf_count_t block = frame / SEEK_INDEX_BLOCK_FRAMES;
+    sf_count_t offset = frame - block * SEEK_INDEX_BLOCK_FRAMES;
+    if(this->fileHandlingMode == COMPRESSED_CACHE && this->loaded)
+    {
+        /*
+          The compressed cache keeps its recently decoded blocks for every thread, so it is
+          consulted under a lock and the block is copied out.
+        */
+        if(block != reader->blockBufferIndex)
+        {
+            std::lock_guard<std::mutex> guard(this->compressedCacheMutex);
+            const double *data = this->compressedCache.blockData(block);
+            if(data == NULL)
+            {
+                return NULL;
+            }
+            reader->blockBuffer.assign(data, data + this->compressedCache.blockFrames(block) * this->getNumChannels());
+            reader->blockBufferIndex = block;
+        }
+    }
+    else if(!this->takeReadAhead(reader, block) && !this->loadBlock(reader, block))
+    {
+        return NULL;
+    }
 
+    *available = min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, this->sourceFrames() - block * SEEK_INDEX_BLOCK_FRAMES) - offset;
+    return &reader->blockBuffer[0] + offset * this->getNumChannels();
 }
@@ -3,10 +3,26 @@
 
 #include <sndfile.h>
 
+#include "AudioSource.h"
+#include "PerfStats.h"
+#include "SeekIndex.h"
+#include "EventIndex.h"
+#include "EditList.h"
+#include "FileReadHints.h"
+#include "ChunkedSampleBuffer.h"
+#include "CompressedSampleBuffer.h"
+#include "SampleKernels.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <string>
 #include <vector>
 
@@ -15,14 +31,115 @@
     \brief AudioUtil header file
  */
 
-#define MAX_CHANNELS 2
+/*!
+\brief The largest channel count of a file AudioUtil can open: that of the sample kernels (see SampleKernels.h).
+*/
+#define MAX_CHANNELS SAMPLE_KERNEL_MAX_CHANNELS
+
+/*!
+\brief For compressed files in DISK_MODE, the largest forward distance (in frames) that is covered by decoding
+rather than by seeking.
+*/
+#define SEEK_FORWARD_READ_LIMIT (4*SEEK_INDEX_BLOCK_FRAMES)
+
+/*!
+\brief Most blocks approximatePeaks() reads, however many columns it is asked for.
+*/
+#define MAX_SKETCH_BLOCKS 256
+
+/*!
+\brief Bounds, in blocks of SEEK_INDEX_BLOCK_FRAMES frames, of the window AudioUtil reads ahead of the hinted position in
+DISK_MODE (see AudioUtil::setReadAhead()).
+*/
+#define READ_AHEAD_MIN_BLOCKS 4
+#define READ_AHEAD_MAX_BLOCKS 128
+
+/*!
+\brief Hints further apart than this, in seconds, are not taken to be one continuous movement.
+*/
+#define READ_AHEAD_IDLE_SECONDS 0.5
+
+/*!
+\brief How far ahead of the pass that loads a file, in blocks of SEEK_INDEX_BLOCK_FRAMES frames, AudioUtil asks the
+kernel to read when read hints are enabled (see AudioUtil::setReadHints()).
+*/
+#define READ_HINT_PASS_BLOCKS 256
+
+/*!
+\brief The lowest loudness, in LUFS, reported by AudioUtil::loudnessForRegion(); quieter regions, including digital
+silence, report this value.  It is the absolute gate of ITU-R BS.1770.
+*/
+#define LOUDNESS_FLOOR -70.0
+
+/*!
+\brief Length of the window of AudioUtil::shortTermLoudness(), in seconds, as defined by EBU R 128.
+*/
+#define SHORT_TERM_LOUDNESS_SECONDS 3
 
 using namespace std;
 
+/*!
+\brief Summary statistics of a region of an audio file, as computed by AudioUtil::statsForRegion().
+*/
+struct RegionStats
+{
+    /*! \brief Number of frames in the region. */
+    sf_count_t frames;
+    /*! \brief Number of channels; only the first numChannels entries of the arrays below are set. */
+    int numChannels;
+    /*! \brief Smallest sample of each channel. */
+    double min[MAX_CHANNELS];
+    /*! \brief Largest sample of each channel. */
+    double max[MAX_CHANNELS];
+    /*! \brief Sample of greatest magnitude of each channel, with its sign, as returned by AudioUtil::peakForRegion(). */
+    double peak[MAX_CHANNELS];
+    /*! \brief Root mean square of each channel. */
+    double rms[MAX_CHANNELS];
+};
+
 /*!
 \brief Provides a number of utilities for pulling useful data from audio files.
 
 This class began as a nice, object-oriented wrapper for certain functions that I found myself frequently using in Erik de Castro Lopo's <a href="http://www.mega-nerd.com/libsndfile/">libsndfile</a>.  It now supports an optional caching scheme (enabled by calling setFileHandlingMode(AudioUtil::FULL_CACHE) on an instance of AudioUtil)  to dramatically speed up the performance of certain functions, like that for accessing arbitrary frames (grabFrame()) of an audio file and that for determining the peak value for a given region of an audio file (peakForRegion()).
+
+In the default DISK_MODE, reads are made in aligned blocks of SEEK_INDEX_BLOCK_FRAMES frames, and compressed files (FLAC, Ogg/Vorbis) are summarized in a SeekIndex when they are set, so that random access into them does not have to decode from a distant sync point for every request (see setSeekIndexPolicy()).
+
+Frames are addressed with 64-bit sf_count_t indices, and the FULL_CACHE cache is held in a ChunkedSampleBuffer, so files longer than 2^31 frames can be cached without a single huge allocation; parts of the cache can be given back with releaseCacheRegion().  For files too large for that, COMPRESSED_CACHE mode keeps the whole file in memory under lossless compression instead.
+
+Besides files at a path, an instance can wrap an AudioSource (setSource()), such as a MemoryAudioSource over a file
+already in memory, or samples already decoded (setSamples()), so that audio that was downloaded, decrypted or
+decoded by other means never has to be written to a temporary file.  Everything below applies to them alike.
+
+setFile() opens a file and makes the pass over it that fills the cache and the seek index.  The two steps can also be taken apart: openFile() only reads the header, after which approximatePeaks() gives a quick sketch of any region from a few sparse reads, and loadFile() makes the pass, possibly on another thread, during which loadedPeaks() can be asked for the peaks of the part already indexed.
+
+The same pass finds the silent spans and onsets of the file, in an EventIndex, so that an editor can jump to the next
+sound (nextSilence()) or the next transient (nextOnset()) in logarithmic time, however long the file.  What counts as
+silence is set with setSilenceThreshold(), which does not read the file again.
+
+With setEdits(), the file is seen through an EditList: cut, spliced and with changed gain, without anything being
+rewritten or read again.  Every function that reads the file then works in frames of the edited file, from
+getTotalFrames() on, and looks each region up piece by piece in the caches and the seek index of the unedited file,
+so a query costs what it cost before plus a few lookups per piece it spans.  Only releaseCacheRegion() and the
+memory accessors keep to the unedited file.
+
+Once a file has been loaded, every function that only reads it (the accessors, grabFrame(), getFrames(),
+getAllFrames(), peakForRegion(), approximatePeaks(), loadedPeaks(), statsForRegion(), loudnessForRegion(),
+shortTermLoudness(), nextSilence(), nextOnset(), calculateNormalizedPeaks(), hasSeekIndex(), hasEventIndex() and
+getCacheBytes()) can be called from any number of threads at once.  Reads that reach the file go through a pool of
+decoders, each with its own position and block buffer: a thread takes an idle decoder for the length of a call, or
+opens another one if all are busy, so the pool grows to the number of threads that actually read at the same time
+and no decoder's position is ever shared.  The cached samples and the seek index are not written after loading.  The
+functions that change what is wrapped or how (setFile(), openFile(), loadFile(), setFileHandlingMode(), the seek
+index settings, setSilenceThreshold(), setEdits(), clearEdits(), setReadHints() and releaseCacheRegion()) must not run while another thread uses the instance.
+
+In DISK_MODE, setReadAhead() starts a thread that reads the blocks a viewer is about to need before it asks for
+them.  The viewer reports where it is with hintAccess() (WaveformWidget does so with the middle of every region it
+paints and with the playhead), and the direction and speed of successive hints decide which blocks are read.
+
+setReadHints() passes the same knowledge on to the kernel, through FileReadHints: the loading pass is announced as
+sequential and fetched READ_HINT_PASS_BLOCKS blocks ahead, the read-ahead window and the blocks of a sketch are
+asked for all at once before the first of them is read, and, once the samples are held in a cache, the pages the pass
+is done with are let go rather than left to push other files out of the page cache.
 */
 class AudioUtil
 {
@@ -32,30 +149,137 @@ public:
 	AudioUtil(string filePath);
         ~AudioUtil();
         bool setFile(string filePath);
+        bool openFile(string filePath);
+        bool setSource(AudioSource *source);
+        bool openSource(AudioSource *source);
+        bool setSamples(const float *samples, sf_count_t frames, int channels, int sampleRate);
+        bool openSamples(const float *samples, sf_count_t frames, int channels, int sampleRate);
+        void loadFile();
+        bool isLoaded();
         int getNumChannels();
         int getSampleRate();
-        int getTotalFrames();
+        sf_count_t getTotalFrames();
         vector<double> calculateNormalizedPeaks();
-        vector<double> grabFrame(int frameIndex);
-        vector<double> peakForRegion(int region_start_frame, int region_end_frame);
+        vector<double> grabFrame(sf_count_t frameIndex);
+        vector<double> peakForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, bool exact = true);
+        vector<double> approximatePeaks(sf_count_t region_start_frame, sf_count_t region_end_frame, int numColumns);
+        int loadedPeaks(sf_count_t region_start_frame, sf_count_t region_end_frame, int numColumns, vector<double> *columnPeaks);
+        bool statsForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, RegionStats *stats, bool exact = true);
+        bool loudnessForRegion(sf_count_t region_start_frame, sf_count_t region_end_frame, double *lufs);
+        bool shortTermLoudness(sf_count_t frame, double *lufs);
+        vector<double> getFrames(sf_count_t start, sf_count_t count);
         vector<double> getAllFrames();
-        enum FileHandlingMode {FULL_CACHE, DISK_MODE};
+        enum FileHandlingMode {FULL_CACHE, DISK_MODE, COMPRESSED_CACHE};
         FileHandlingMode getFileHandlingMode();
         void setFileHandlingMode(FileHandlingMode mode);
+        enum SeekIndexPolicy {INDEX_NEVER, INDEX_COMPRESSED_ONLY, INDEX_ALWAYS};
+        void setSeekIndexPolicy(SeekIndexPolicy policy);
+        SeekIndexPolicy getSeekIndexPolicy();
+        void setSeekIndexPersistence(bool persistent);
+        bool hasSeekIndex();
+        bool hasEventIndex();
+        void setSilenceThreshold(double thresholdDb, double minSeconds);
+        bool nextSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end);
+        bool nextOnset(sf_count_t frame, double minStrengthDb, sf_count_t *onset);
+        bool isCompressedFormat();
+        void releaseCacheRegion(sf_count_t startFrame, sf_count_t endFrame);
+        size_t getCacheBytes();
+        MemoryAccount *getMemoryAccount();
+        void setReadAhead(bool enabled);
+        bool getReadAhead();
+        void hintAccess(sf_count_t frame);
+        void setReadHints(bool enabled);
+        bool getReadHints();
+        bool setEdits(EditList edits);
+        EditList getEdits();
+        void clearEdits();
 
 private:
-        double data [MAX_CHANNELS];
+        /* A decoder of the wrapped file, with its own position and block buffer. */
+        struct Reader
+        {
+            SNDFILE *sndFile;
+            AudioSourceCursor cursor;
+            sf_count_t readPosition;
+            vector<double> blockBuffer;
+            sf_count_t blockBufferIndex;
+        };
+
+        /* A block read ahead of the viewer, and whether a read has used it yet. */
+        struct ReadAheadBlock
+        {
+            CacheVector<double> frames;
+            bool used;
+        };
+
         FileHandlingMode fileHandlingMode;
         string srcFilePath;
-        SNDFILE *sndFile;
+        AudioSource *source;
+        AudioSource *ownedSource;
+        SF_INFO sourceFormat;
         SF_INFO *sfinfo;
         bool sndFileNotEmpty;
-        vector<double> peaks;
-        vector<double> regionPeak;
-        vector<double> fileCache;
-        int readcount;
-        vector<double> dataVector;
+        vector<Reader*> idleReaders;
+        std::mutex readerMutex;
+        MemoryAccount memoryAccount;
+        ChunkedSampleBuffer fileCache;
+        CompressedSampleBuffer compressedCache;
+        std::mutex compressedCacheMutex;
+        SeekIndex seekIndex;
+        SeekIndexPolicy seekIndexPolicy;
+        bool seekIndexPersistent;
+        bool indexFromFile;
+        EventIndex eventIndex;
+        bool eventsFromFile;
+        EditList edits;
+        bool loaded;
+        std::atomic<sf_count_t> indexedFrames;
+        SampleKernelTable kernels;
+        bool readAheadEnabled;
+        bool readAheadRunning;
+        bool readAheadPending;
+        std::thread readAheadThread;
+        std::mutex readAheadMutex;
+        std::condition_variable readAheadWake;
+        map<sf_count_t, ReadAheadBlock> readAheadBlocks;
+        sf_count_t hintFrame;
+        double hintVelocity;
+        std::chrono::steady_clock::time_point hintTime;
+        bool hinted;
+        sf_count_t readAheadWindow;
+        sf_count_t readAheadWasted;
+        bool readHintsEnabled;
+        FileReadHints readHints;
+        void initialize();
+        bool openInput(string name, AudioSource *source, SF_INFO format);
+        SNDFILE *openHandle(Reader *reader, SF_INFO *info);
+        Reader *acquireReader();
+        void releaseReader(Reader *reader);
+        void closeReaders();
+        void stopReadAhead();
+        void readAhead();
+        void readAheadRange(sf_count_t *first, sf_count_t *last, int *direction);
+        bool takeReadAhead(Reader *reader, sf_count_t block);
         void populateCache();
+        void ingest(bool fillCache);
+        bool wantsSeekIndex();
+        bool persistsIndices();
+        string seekIndexPath();
+        string eventIndexPath();
+        SeekIndexKey seekIndexKey();
+        bool seekTo(Reader *reader, sf_count_t frame);
+        sf_count_t readFrames(Reader *reader, double *buffer, sf_count_t frames);
+        bool loadBlock(Reader *reader, sf_count_t block);
+        sf_count_t sourceFrames();
+        bool foldRegionPeak(Reader *reader, sf_count_t start, sf_count_t end, double *peak, bool exact);
+        bool foldRegionStats(Reader *reader, sf_count_t start, sf_count_t end, double *minValue, double *maxValue, double *sumSquares, bool exact);
+        bool rangeExtremes(Reader *reader, sf_count_t firstBlock, sf_count_t endBlock, bool exact, double *minValue, double *maxValue);
+        const vector<double> *blockExtremes(Reader *reader, sf_count_t block, map<sf_count_t, vector<double> > *blocks);
+        bool findSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end);
+        bool scanRegion(Reader *reader, sf_count_t start, sf_count_t end, double *peak);
+        bool scanStats(Reader *reader, sf_count_t start, sf_count_t end, double *minValue, double *maxValue, double *sumSquares);
+        bool wholeBlocks(sf_count_t start, sf_count_t end, sf_count_t *firstBlock, sf_count_t *endBlock);
+        const double *frameSpan(Reader *reader, sf_count_t frame, sf_count_t *available);
 
 };
 
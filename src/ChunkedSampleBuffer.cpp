@@ -0,0 +1,159 @@
+#include "ChunkedSampleBuffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+/*!
+\file ChunkedSampleBuffer.cpp
+\brief ChunkedSampleBuffer implementation file.
+*/
+
+/*!
+\brief Constructs an empty buffer.
+*/
+ChunkedSampleBuffer::ChunkedSampleBuffer()
+{
+    this->reset(0, 0);
+}
+
+/*!
+\brief Releases all chunks and counts the memory of chunks allocated from now on in an account.
+@param account The account, or NULL not to count the chunks.
+@param tier The tier of the account the chunks are counted in.
+*/
+void ChunkedSampleBuffer::setMemoryAccount(MemoryAccount *account, MemoryTier tier)
+{
+    this->allocator = CacheAllocator<double>(account, tier);
+    this->clear();
+}
+
+/*!
+\brief Releases all chunks and prepares the buffer to hold a file of the given layout.
+@param numChannels Number of interleaved channels per frame.
+@param totalFrames Number of frames the buffer will eventually hold.
+*/
+void ChunkedSampleBuffer::reset(int numChannels, sf_count_t totalFrames)
+{
+    this->numChannels = numChannels;
+    this->totalFrames = totalFrames;
+    this->framesAppended = 0;
+    this->chunks.clear();
+    if(numChannels > 0 && totalFrames > 0)
+    {
+        this->chunks.resize((totalFrames + CACHE_CHUNK_FRAMES - 1) / CACHE_CHUNK_FRAMES, CacheVector<double>(this->allocator));
+    }
+}
+
+/*!
+\brief Releases all chunks, keeping the layout set by reset().
+*/
+void ChunkedSampleBuffer::clear()
+{
+    this->reset(this->numChannels, this->totalFrames);
+}
+
+/*!
+\brief Appends frames in file order, allocating each chunk when the first frame is written to it.
+@param frames Interleaved samples.
+@param count Number of frames.  Frames beyond the length given to reset() are ignored.
+*/
+void ChunkedSampleBuffer::append(const double *frames, sf_count_t count)
+{
+    count = min(count, this->totalFrames - this->framesAppended);
+    while(count > 0)
+    {
+        sf_count_t chunk = this->framesAppended / CACHE_CHUNK_FRAMES;
+        sf_count_t offset = this->framesAppended % CACHE_CHUNK_FRAMES;
+        sf_count_t n = min(count, this->chunkFrames(chunk) - offset);
+
+        CacheVector<double> &data = this->chunks[chunk];
+        if(data.empty())
+        {
+            data.resize(this->chunkFrames(chunk) * this->numChannels);
+        }
+        memcpy(&data[offset * this->numChannels], frames, n * this->numChannels * sizeof(double));
+
+        frames += n * this->numChannels;
+        count -= n;
+        this->framesAppended += n;
+    }
+}
+
+/*!
+\brief Number of interleaved channels per frame.
+*/
+int ChunkedSampleBuffer::getNumChannels()
+{
+    return this->numChannels;
+}
+
+/*!
+\brief Number of frames the buffer holds once completely filled.
+*/
+sf_count_t ChunkedSampleBuffer::getTotalFrames()
+{
+    return this->totalFrames;
+}
+
+/*!
+\brief Number of chunks the buffer is divided into.
+*/
+sf_count_t ChunkedSampleBuffer::getNumChunks()
+{
+    return (sf_count_t) this->chunks.size();
+}
+
+/*!
+\brief Whether a chunk currently holds its samples.
+*/
+bool ChunkedSampleBuffer::isChunkResident(sf_count_t chunk)
+{
+    return chunk >= 0 && chunk < this->getNumChunks() && !this->chunks[chunk].empty();
+}
+
+/*!
+\brief Frees the memory of one chunk.  AudioUtil reads the samples of a released chunk from the file, a block at
+a time, when they are needed again.
+*/
+void ChunkedSampleBuffer::releaseChunk(sf_count_t chunk)
+{
+    if(chunk >= 0 && chunk < this->getNumChunks())
+    {
+        CacheVector<double>(this->allocator).swap(this->chunks[chunk]);
+    }
+}
+
+/*!
+\brief Interleaved samples of a resident chunk.
+@return a pointer to the first sample of the chunk, or NULL if the chunk is not resident.
+*/
+double *ChunkedSampleBuffer::chunkData(sf_count_t chunk)
+{
+    if(!this->isChunkResident(chunk))
+    {
+        return NULL;
+    }
+    return &this->chunks[chunk][0];
+}
+
+/*!
+\brief Number of frames in a chunk.  Every chunk but the last holds CACHE_CHUNK_FRAMES frames.
+*/
+sf_count_t ChunkedSampleBuffer::chunkFrames(sf_count_t chunk)
+{
+    return min((sf_count_t) CACHE_CHUNK_FRAMES, this->totalFrames - chunk * CACHE_CHUNK_FRAMES);
+}
+
+/*!
+\brief Bytes of sample memory currently held by resident chunks.
+*/
+size_t ChunkedSampleBuffer::getResidentBytes()
+{
+    size_t bytes = 0;
+    for(size_t c = 0; c < this->chunks.size(); c++)
+    {
+        bytes += this->chunks[c].capacity() * sizeof(double);
+    }
+    return bytes;
+}
@@ -0,0 +1,56 @@
+#ifndef CHUNKEDSAMPLEBUFFER_H
+#define CHUNKEDSAMPLEBUFFER_H
+
+#include "MemoryAccount.h"
+
+#include <sndfile.h>
+
+#include <vector>
+
+/*!
+    \file ChunkedSampleBuffer.h
+    \brief ChunkedSampleBuffer header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of frames held by each chunk of a ChunkedSampleBuffer.  A multiple of SEEK_INDEX_BLOCK_FRAMES, so
+that no index block straddles two chunks.
+*/
+#define CACHE_CHUNK_FRAMES (1 << 20)
+
+/*!
+\brief Interleaved audio samples stored as a list of fixed-size chunks rather than one contiguous array.
+
+This is the storage behind AudioUtil's FULL_CACHE mode.  Because every chunk is allocated once at its final size,
+appending never reallocates or copies what is already stored, however long the file; and because chunks are
+independent, any of them can be released to give memory back.  Frames are addressed with 64-bit sf_count_t indices
+throughout.
+*/
+class ChunkedSampleBuffer
+{
+public:
+    ChunkedSampleBuffer();
+    void setMemoryAccount(MemoryAccount *account, MemoryTier tier);
+    void reset(int numChannels, sf_count_t totalFrames);
+    void clear();
+    void append(const double *frames, sf_count_t count);
+    int getNumChannels();
+    sf_count_t getTotalFrames();
+    sf_count_t getNumChunks();
+    bool isChunkResident(sf_count_t chunk);
+    void releaseChunk(sf_count_t chunk);
+    double *chunkData(sf_count_t chunk);
+    sf_count_t chunkFrames(sf_count_t chunk);
+    size_t getResidentBytes();
+
+private:
+    int numChannels;
+    sf_count_t totalFrames;
+    sf_count_t framesAppended;
+    CacheAllocator<double> allocator;
+    vector< CacheVector<double> > chunks;
+};
+
+#endif // CHUNKEDSAMPLEBUFFER_H
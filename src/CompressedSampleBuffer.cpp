@@ -0,0 +1,361 @@
+#include "CompressedSampleBuffer.h"
+
+#include "PerfStats.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+/*!
+\file CompressedSampleBuffer.cpp
+\brief CompressedSampleBuffer implementation file.
+*/
+
+/* Block encodings; the first byte of every compressed block. */
+#define BLOCK_INTEGER 0
+#define BLOCK_FLOAT 1
+#define BLOCK_RAW 2
+
+#define INTEGER_SCALE 2147483648.0
+
+static void putVarint(vector<unsigned char> &out, unsigned long long value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char) value);
+}
+
+static unsigned long long getVarint(const unsigned char *&in, const unsigned char *end)
+{
+    unsigned long long value = 0;
+    int shift = 0;
+    while(in < end && shift < 64)
+    {
+        unsigned char byte = *in++;
+        value |= ((unsigned long long) (byte & 0x7f)) << shift;
+        if(!(byte & 0x80))
+            break;
+        shift += 7;
+    }
+    return value;
+}
+
+static unsigned long long zigzag(long long value)
+{
+    return (((unsigned long long) value) << 1) ^ (value < 0 ? ~0ULL : 0ULL);
+}
+
+static long long unzigzag(unsigned long long value)
+{
+    return (long long) ((value >> 1) ^ ((value & 1) ? ~0ULL : 0ULL));
+}
+
+/*!
+\brief Constructs an empty buffer.
+*/
+CompressedSampleBuffer::CompressedSampleBuffer()
+{
+    this->reset(0, 0);
+}
+
+/*!
+\brief Releases all blocks and counts the memory of blocks allocated from now on in an account.
+@param account The account, or NULL not to count the blocks.
+@param tier The tier of the account the blocks are counted in.
+*/
+void CompressedSampleBuffer::setMemoryAccount(MemoryAccount *account, MemoryTier tier)
+{
+    this->allocator = CacheAllocator<double>(account, tier);
+    this->reset(this->numChannels, this->totalFrames);
+}
+
+/*!
+\brief Releases all blocks and prepares the buffer to hold a file of the given layout.
+@param numChannels Number of interleaved channels per frame.
+@param totalFrames Number of frames the buffer will eventually hold.
+*/
+void CompressedSampleBuffer::reset(int numChannels, sf_count_t totalFrames)
+{
+    this->numChannels = numChannels;
+    this->totalFrames = totalFrames;
+    this->framesAppended = 0;
+    this->useCounter = 0;
+    CacheVector<double>(this->allocator).swap(this->pending);
+    this->blocks.clear();
+    this->hotBlocks.clear();
+    /* blockData() hands out pointers into hotBlocks, so it must never reallocate. */
+    this->hotBlocks.reserve(COMPRESSED_HOT_BLOCKS);
+    if(numChannels > 0 && totalFrames > 0)
+    {
+        this->blocks.reserve((totalFrames + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES);
+    }
+}
+
+/*!
+\brief Appends frames in file order, compressing each block as soon as it is complete.
+@param frames Interleaved samples.
+@param count Number of frames.  Frames beyond the length given to reset() are ignored.
+*/
+void CompressedSampleBuffer::append(const double *frames, sf_count_t count)
+{
+    count = min(count, this->totalFrames - this->framesAppended);
+    while(count > 0)
+    {
+        sf_count_t block = this->framesAppended / SEEK_INDEX_BLOCK_FRAMES;
+        sf_count_t inPending = (sf_count_t) this->pending.size() / this->numChannels;
+        sf_count_t n = min(count, this->blockFrames(block) - inPending);
+
+        this->pending.insert(this->pending.end(), frames, frames + n * this->numChannels);
+        frames += n * this->numChannels;
+        count -= n;
+        this->framesAppended += n;
+
+        if(inPending + n == this->blockFrames(block))
+        {
+            /* Encoded into scratch space first, so that the stored block is allocated once at its final size. */
+            this->encodeBlock(&this->pending[0], inPending + n, this->encoded);
+            this->blocks.push_back(CacheVector<unsigned char>(this->encoded.begin(), this->encoded.end(), CacheAllocator<unsigned char>(this->allocator)));
+            this->pending.clear();
+        }
+    }
+}
+
+/*!
+\brief Number of interleaved channels per frame.
+*/
+int CompressedSampleBuffer::getNumChannels()
+{
+    return this->numChannels;
+}
+
+/*!
+\brief Number of frames the buffer holds once completely filled.
+*/
+sf_count_t CompressedSampleBuffer::getTotalFrames()
+{
+    return this->totalFrames;
+}
+
+/*!
+\brief Number of blocks compressed so far.
+*/
+sf_count_t CompressedSampleBuffer::getNumBlocks()
+{
+    return (sf_count_t) this->blocks.size();
+}
+
+/*!
+\brief Decoded samples of one block.
+
+The block is decoded unless it is one of the COMPRESSED_HOT_BLOCKS most recently used blocks, in which case the
+decoded copy is returned directly.
+@param block Block number; block b covers frames [b*SEEK_INDEX_BLOCK_FRAMES, (b+1)*SEEK_INDEX_BLOCK_FRAMES).
+@return a pointer to blockFrames(block) frames of interleaved samples, valid until COMPRESSED_HOT_BLOCKS other
+blocks have been read, or NULL if the block has not been stored.
+*/
+const double *CompressedSampleBuffer::blockData(sf_count_t block)
+{
+    if(block < 0 || block >= this->getNumBlocks())
+    {
+        return NULL;
+    }
+
+    this->useCounter++;
+    size_t victim = 0;
+    for(size_t i = 0; i < this->hotBlocks.size(); i++)
+    {
+        if(this->hotBlocks[i].block == block)
+        {
+            PERF_COUNT("CompressedSampleBuffer::hotBlockHit");
+            this->hotBlocks[i].lastUse = this->useCounter;
+            return &this->hotBlocks[i].frames[0];
+        }
+        if(this->hotBlocks[i].lastUse < this->hotBlocks[victim].lastUse)
+        {
+            victim = i;
+        }
+    }
+    PERF_COUNT("CompressedSampleBuffer::hotBlockMiss");
+
+    if(this->hotBlocks.size() < COMPRESSED_HOT_BLOCKS)
+    {
+        victim = this->hotBlocks.size();
+        this->hotBlocks.push_back(HotBlock());
+        this->hotBlocks[victim].frames = CacheVector<double>(this->allocator);
+        this->hotBlocks[victim].frames.resize(SEEK_INDEX_BLOCK_FRAMES * this->numChannels);
+    }
+
+    HotBlock &hot = this->hotBlocks[victim];
+    hot.block = -1;
+    if(!this->decodeBlock(block, &hot.frames[0]))
+    {
+        fprintf(stderr, "corrupt block %lld in CompressedSampleBuffer.\n", (long long) block);
+        return NULL;
+    }
+    hot.block = block;
+    hot.lastUse = this->useCounter;
+    return &hot.frames[0];
+}
+
+/*!
+\brief Number of frames in a block.  Every block but the last holds SEEK_INDEX_BLOCK_FRAMES frames.
+*/
+sf_count_t CompressedSampleBuffer::blockFrames(sf_count_t block)
+{
+    return min((sf_count_t) SEEK_INDEX_BLOCK_FRAMES, this->totalFrames - block * SEEK_INDEX_BLOCK_FRAMES);
+}
+
+/*!
+\brief Bytes held by the compressed blocks.
+*/
+size_t CompressedSampleBuffer::getCompressedBytes()
+{
+    size_t bytes = 0;
+    for(size_t b = 0; b < this->blocks.size(); b++)
+    {
+        bytes += this->blocks[b].capacity();
+    }
+    return bytes;
+}
+
+/*!
+\brief Bytes held by the compressed blocks, the decoded hot blocks and the block being filled.
+*/
+size_t CompressedSampleBuffer::getResidentBytes()
+{
+    size_t bytes = this->getCompressedBytes() + this->pending.capacity() * sizeof(double);
+    for(size_t i = 0; i < this->hotBlocks.size(); i++)
+    {
+        bytes += this->hotBlocks[i].frames.capacity() * sizeof(double);
+    }
+    return bytes;
+}
+
+/*
+ * Compresses count frames into out, picking the first encoding that represents every sample exactly.
+ */
+void CompressedSampleBuffer::encodeBlock(const double *frames, sf_count_t count, vector<unsigned char> &out)
+{
+    sf_count_t numSamples = count * this->numChannels;
+    vector<long long> values(numSamples);
+    int encoding = BLOCK_INTEGER;
+    unsigned long long usedBits = 0;
+
+    for(sf_count_t i = 0; i < numSamples && encoding == BLOCK_INTEGER; i++)
+    {
+        double scaled = frames[i] * INTEGER_SCALE;
+        if(scaled != floor(scaled) || scaled < -INTEGER_SCALE || scaled >= INTEGER_SCALE)
+        {
+            encoding = BLOCK_FLOAT;
+            break;
+        }
+        values[i] = (long long) scaled;
+        usedBits |= (unsigned long long) values[i];
+    }
+
+    for(sf_count_t i = 0; i < numSamples && encoding == BLOCK_FLOAT; i++)
+    {
+        float single = (float) frames[i];
+        if((double) single != frames[i])
+        {
+            encoding = BLOCK_RAW;
+            break;
+        }
+        int bits;
+        memcpy(&bits, &single, sizeof(bits));
+        values[i] = bits;
+    }
+
+    out.clear();
+    out.push_back((unsigned char) encoding);
+
+    if(encoding == BLOCK_RAW)
+    {
+        out.resize(1 + numSamples * sizeof(double));
+        memcpy(&out[1], frames, numSamples * sizeof(double));
+        return;
+    }
+
+    /* Trailing zero bits common to every sample, e.g. the 16 low bits of 16-bit audio. */
+    int shift = 0;
+    if(encoding == BLOCK_INTEGER && usedBits != 0)
+    {
+        while(shift < 31 && !(usedBits & (1ULL << shift)))
+        {
+            shift++;
+        }
+    }
+    out.push_back((unsigned char) shift);
+
+    vector<long long> previous(this->numChannels, 0);
+    out.reserve(2 + numSamples * 2);
+    for(sf_count_t i = 0; i < numSamples; i++)
+    {
+        int c = (int) (i % this->numChannels);
+        long long value = values[i] / (1LL << shift);
+        putVarint(out, zigzag(value - previous[c]));
+        previous[c] = value;
+    }
+}
+
+/*
+ * Decompresses one block into frames.  Returns false if the block is damaged.
+ */
+bool CompressedSampleBuffer::decodeBlock(sf_count_t block, double *frames)
+{
+    const CacheVector<unsigned char> &data = this->blocks[block];
+    sf_count_t numSamples = this->blockFrames(block) * this->numChannels;
+    if(data.empty())
+    {
+        return false;
+    }
+
+    int encoding = data[0];
+    if(encoding == BLOCK_RAW)
+    {
+        if(data.size() != 1 + numSamples * sizeof(double))
+        {
+            return false;
+        }
+        memcpy(frames, &data[1], numSamples * sizeof(double));
+        return true;
+    }
+
+    if(data.size() < 2 || (encoding != BLOCK_INTEGER && encoding != BLOCK_FLOAT))
+    {
+        return false;
+    }
+
+    long long multiplier = 1LL << data[1];
+    const unsigned char *in = &data[2];
+    const unsigned char *end = &data[0] + data.size();
+    vector<long long> previous(this->numChannels, 0);
+
+    for(sf_count_t i = 0; i < numSamples; i++)
+    {
+        if(in >= end)
+        {
+            return false;
+        }
+        int c = (int) (i % this->numChannels);
+        previous[c] += unzigzag(getVarint(in, end));
+
+        if(encoding == BLOCK_INTEGER)
+        {
+            frames[i] = (double) (previous[c] * multiplier) / INTEGER_SCALE;
+        }
+        else
+        {
+            int bits = (int) previous[c];
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            frames[i] = single;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef COMPRESSEDSAMPLEBUFFER_H
+#define COMPRESSEDSAMPLEBUFFER_H
+
+#include <sndfile.h>
+
+#include "MemoryAccount.h"
+#include "SeekIndex.h"
+
+#include <vector>
+
+/*!
+    \file CompressedSampleBuffer.h
+    \brief CompressedSampleBuffer header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of decoded blocks a CompressedSampleBuffer keeps ready for reading.
+*/
+#define COMPRESSED_HOT_BLOCKS 16
+
+/*!
+\brief Interleaved audio samples held in memory under fast lossless compression.
+
+This is the storage behind AudioUtil's COMPRESSED_CACHE mode.  Samples are stored in blocks of
+SEEK_INDEX_BLOCK_FRAMES frames, the same blocks a SeekIndex summarizes, and each block is compressed on its own so
+that any block can be decoded without its neighbours.  The last COMPRESSED_HOT_BLOCKS blocks read are kept decoded.
+
+Each block is stored in the cheapest of three lossless encodings:
+
+- integer: samples read from integer PCM, FLAC and similar files are exact multiples of 2^-31.  They are stored as
+  the difference from the previous sample of the same channel, with the trailing zero bits common to the block
+  (16 of them for 16-bit audio) shifted away, as zigzag variable-length integers.  This is typically 3 to 5 times
+  smaller than the decoded doubles.
+- float: samples that are exact single-precision values (float and Ogg/Vorbis files) are stored the same way,
+  using their bit patterns.
+- raw: anything else is copied as is.
+*/
+class CompressedSampleBuffer
+{
+public:
+    CompressedSampleBuffer();
+    void setMemoryAccount(MemoryAccount *account, MemoryTier tier);
+    void reset(int numChannels, sf_count_t totalFrames);
+    void append(const double *frames, sf_count_t count);
+    int getNumChannels();
+    sf_count_t getTotalFrames();
+    sf_count_t getNumBlocks();
+    const double *blockData(sf_count_t block);
+    sf_count_t blockFrames(sf_count_t block);
+    size_t getCompressedBytes();
+    size_t getResidentBytes();
+
+private:
+    struct HotBlock
+    {
+        sf_count_t block;
+        unsigned long long lastUse;
+        CacheVector<double> frames;
+    };
+
+    int numChannels;
+    sf_count_t totalFrames;
+    sf_count_t framesAppended;
+    CacheAllocator<double> allocator;
+    CacheVector<double> pending;
+    vector< CacheVector<unsigned char> > blocks;
+    vector<unsigned char> encoded;
+    vector<HotBlock> hotBlocks;
+    unsigned long long useCounter;
+
+    void encodeBlock(const double *frames, sf_count_t count, vector<unsigned char> &out);
+    bool decodeBlock(sf_count_t block, double *frames);
+};
+
+#endif // COMPRESSEDSAMPLEBUFFER_H
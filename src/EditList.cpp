@@ -0,0 +1,295 @@
+#include "EditList.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+/*!
+\file EditList.cpp
+\brief EditList implementation file.
+*/
+
+/*!
+\brief Constructs an empty list, for a source file of no frames.
+*/
+EditList::EditList()
+{
+    this->reset(0);
+}
+
+/*!
+\brief Constructs the unedited list of a source file of sourceFrames frames.
+*/
+EditList::EditList(sf_count_t sourceFrames)
+{
+    this->reset(sourceFrames);
+}
+
+/*!
+\brief Discards every edit: the list plays the whole source file, of sourceFrames frames, at unity gain.
+*/
+void EditList::reset(sf_count_t sourceFrames)
+{
+    this->sourceFrames = max((sf_count_t) 0, sourceFrames);
+    this->pieces.clear();
+    EditPiece piece;
+    piece.sourceStart = 0;
+    piece.length = this->sourceFrames;
+    piece.gain = 1.0;
+    this->pieces.push_back(piece);
+    this->update();
+}
+
+/*!
+\brief Number of frames of the source file.
+*/
+sf_count_t EditList::getSourceFrames()
+{
+    return this->sourceFrames;
+}
+
+/*!
+\brief Number of frames of the edited file.
+*/
+sf_count_t EditList::getTotalFrames()
+{
+    return this->pieceStarts.back();
+}
+
+/*!
+\brief Whether the list plays the source file unchanged.
+*/
+bool EditList::isIdentity()
+{
+    if(this->pieces.empty())
+    {
+        return this->sourceFrames == 0;
+    }
+    return this->pieces.size() == 1 && this->pieces[0].sourceStart == 0 && this->pieces[0].length == this->sourceFrames
+            && this->pieces[0].gain == 1.0;
+}
+
+/*!
+\brief Number of pieces in the list.
+*/
+int EditList::getNumPieces()
+{
+    return (int) this->pieces.size();
+}
+
+/*!
+\brief The piece at a given index, from 0 to getNumPieces() - 1.
+*/
+EditPiece EditList::getPiece(int index)
+{
+    return this->pieces[index];
+}
+
+/*!
+\brief The frame of the edited file at which the piece at a given index starts.  An index of getNumPieces() gives
+getTotalFrames().
+*/
+sf_count_t EditList::getPieceStart(int index)
+{
+    return this->pieceStarts[index];
+}
+
+/*!
+\brief The index of the piece holding a given frame of the edited file, or -1 if the frame is out of range.
+*/
+int EditList::findPiece(sf_count_t frame)
+{
+    if(frame < 0 || frame >= this->getTotalFrames())
+    {
+        return -1;
+    }
+    return (int) (upper_bound(this->pieceStarts.begin(), this->pieceStarts.end(), frame) - this->pieceStarts.begin()) - 1;
+}
+
+/*!
+\brief The frame of the source file played at a given frame of the edited file, or -1 if the frame is out of range.
+*/
+sf_count_t EditList::toSource(sf_count_t frame)
+{
+    int index = this->findPiece(frame);
+    if(index < 0)
+    {
+        return -1;
+    }
+    return this->pieces[index].sourceStart + (frame - this->pieceStarts[index]);
+}
+
+/*!
+\brief Removes the frames [startFrame, endFrame) of the edited file.
+@return true on success, false on an invalid range.
+*/
+bool EditList::cut(sf_count_t startFrame, sf_count_t endFrame)
+{
+    if(!this->validRange(startFrame, endFrame, "cut"))
+    {
+        return false;
+    }
+    int first = this->split(startFrame);
+    int end = this->split(endFrame);
+    this->pieces.erase(this->pieces.begin() + first, this->pieces.begin() + end);
+    this->update();
+    return true;
+}
+
+/*!
+\brief Inserts the frames [sourceStart, sourceEnd) of the source file, at unity gain, before a given frame of the
+edited file.
+@param frame Frame of the edited file before which to insert; getTotalFrames() appends.
+@param sourceStart First frame of the source file to insert.
+@param sourceEnd Frame of the source file just past the last one to insert.
+@return true on success, false on an invalid frame or range.
+*/
+bool EditList::insertSource(sf_count_t frame, sf_count_t sourceStart, sf_count_t sourceEnd)
+{
+    if(frame < 0 || frame > this->getTotalFrames() || sourceStart < 0 || sourceEnd > this->sourceFrames || sourceStart >= sourceEnd)
+    {
+        fprintf(stderr, "err in EditList::insertSource -- invalid range\n");
+        return false;
+    }
+    EditPiece piece;
+    piece.sourceStart = sourceStart;
+    piece.length = sourceEnd - sourceStart;
+    piece.gain = 1.0;
+    int index = this->split(frame);
+    this->pieces.insert(this->pieces.begin() + index, piece);
+    this->update();
+    return true;
+}
+
+/*!
+\brief Inserts a copy of the frames [startFrame, endFrame) of the edited file, with their gain, before a given
+frame.
+@param frame Frame of the edited file, before the insertion, before which to insert; getTotalFrames() appends.
+@param startFrame First frame to copy.
+@param endFrame Frame just past the last one to copy.
+@return true on success, false on an invalid frame or range.
+*/
+bool EditList::paste(sf_count_t frame, sf_count_t startFrame, sf_count_t endFrame)
+{
+    if(!this->validRange(startFrame, endFrame, "paste"))
+    {
+        return false;
+    }
+    if(frame < 0 || frame > this->getTotalFrames())
+    {
+        fprintf(stderr, "err in EditList::paste -- invalid frame\n");
+        return false;
+    }
+
+    vector<EditPiece> copied;
+    for(int i = this->findPiece(startFrame); i < (int) this->pieces.size() && this->pieceStarts[i] < endFrame; i++)
+    {
+        sf_count_t first = max(startFrame, this->pieceStarts[i]);
+        sf_count_t end = min(endFrame, this->pieceStarts[i + 1]);
+        EditPiece piece = this->pieces[i];
+        piece.sourceStart += first - this->pieceStarts[i];
+        piece.length = end - first;
+        copied.push_back(piece);
+    }
+
+    int index = this->split(frame);
+    this->pieces.insert(this->pieces.begin() + index, copied.begin(), copied.end());
+    this->update();
+    return true;
+}
+
+/*!
+\brief Multiplies the gain of the frames [startFrame, endFrame) of the edited file.
+@param gain Linear factor, 0 or more: 0.5 lowers the frames by about 6 dB, 0 mutes them.
+@return true on success, false on an invalid range or a negative gain.
+*/
+bool EditList::applyGain(sf_count_t startFrame, sf_count_t endFrame, double gain)
+{
+    if(!this->validRange(startFrame, endFrame, "applyGain"))
+    {
+        return false;
+    }
+    if(gain < 0.0)
+    {
+        fprintf(stderr, "err in EditList::applyGain -- negative gain\n");
+        return false;
+    }
+    int first = this->split(startFrame);
+    int end = this->split(endFrame);
+    for(int i = first; i < end; i++)
+    {
+        this->pieces[i].gain *= gain;
+    }
+    this->update();
+    return true;
+}
+
+bool EditList::validRange(sf_count_t startFrame, sf_count_t endFrame, const char *function)
+{
+    if(startFrame < 0 || endFrame > this->getTotalFrames() || startFrame >= endFrame)
+    {
+        fprintf(stderr, "err in EditList::%s -- invalid range\n", function);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Makes a piece start at frame, splitting the piece that holds it if needed, and returns its index;
+ * getNumPieces() for the end of the edited file.
+ */
+int EditList::split(sf_count_t frame)
+{
+    int index = this->findPiece(frame);
+    if(index < 0)
+    {
+        return (int) this->pieces.size();
+    }
+    sf_count_t offset = frame - this->pieceStarts[index];
+    if(offset == 0)
+    {
+        return index;
+    }
+
+    EditPiece tail = this->pieces[index];
+    tail.sourceStart += offset;
+    tail.length -= offset;
+    this->pieces[index].length = offset;
+    this->pieces.insert(this->pieces.begin() + index + 1, tail);
+    this->pieceStarts.insert(this->pieceStarts.begin() + index + 1, frame);
+    return index + 1;
+}
+
+/*
+ * Drops empty pieces, merges pieces that continue each other in the source at the same gain, and
+ * works out where each piece starts.
+ */
+void EditList::update()
+{
+    vector<EditPiece> merged;
+    for(size_t i = 0; i < this->pieces.size(); i++)
+    {
+        const EditPiece &piece = this->pieces[i];
+        if(piece.length <= 0)
+        {
+            continue;
+        }
+        if(!merged.empty() && merged.back().sourceStart + merged.back().length == piece.sourceStart
+                && merged.back().gain == piece.gain)
+        {
+            merged.back().length += piece.length;
+        }
+        else
+        {
+            merged.push_back(piece);
+        }
+    }
+    this->pieces.swap(merged);
+
+    this->pieceStarts.resize(this->pieces.size() + 1);
+    this->pieceStarts[0] = 0;
+    for(size_t i = 0; i < this->pieces.size(); i++)
+    {
+        this->pieceStarts[i + 1] = this->pieceStarts[i] + this->pieces[i].length;
+    }
+}
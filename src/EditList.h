@@ -0,0 +1,65 @@
+#ifndef EDITLIST_H
+#define EDITLIST_H
+
+#include <sndfile.h>
+
+#include <vector>
+
+/*!
+    \file EditList.h
+    \brief EditList header file.
+*/
+
+using namespace std;
+
+/*!
+\brief A run of frames of the source file, as placed in an EditList.
+*/
+struct EditPiece
+{
+    sf_count_t sourceStart; /*!< First frame of the run in the source file. */
+    sf_count_t length;      /*!< Number of frames. */
+    double gain;            /*!< Linear gain the frames are multiplied by. */
+};
+
+/*!
+\brief A non-destructive edit of an audio file: the order in which runs of its frames are played, and their gain.
+
+The list is a piece table.  It starts as a single piece covering the whole source file at unity gain.  cut(),
+insertSource(), paste() and applyGain() split pieces at the edges of the range they touch and rearrange or scale
+them.  Nothing is read or copied, so each edit costs time in proportion to the number of pieces, whatever the length
+of the file.  Adjacent pieces that continue each other in the source at the same gain are merged back into one.
+
+Frames of the edited file are looked up with findPiece(), in logarithmic time.  AudioUtil::setEdits() makes an
+AudioUtil instance answer every query through a list, from the caches and indices of the unedited file.
+*/
+class EditList
+{
+public:
+    EditList();
+    EditList(sf_count_t sourceFrames);
+    void reset(sf_count_t sourceFrames);
+    sf_count_t getSourceFrames();
+    sf_count_t getTotalFrames();
+    bool isIdentity();
+    int getNumPieces();
+    EditPiece getPiece(int index);
+    sf_count_t getPieceStart(int index);
+    int findPiece(sf_count_t frame);
+    sf_count_t toSource(sf_count_t frame);
+    bool cut(sf_count_t startFrame, sf_count_t endFrame);
+    bool insertSource(sf_count_t frame, sf_count_t sourceStart, sf_count_t sourceEnd);
+    bool paste(sf_count_t frame, sf_count_t startFrame, sf_count_t endFrame);
+    bool applyGain(sf_count_t startFrame, sf_count_t endFrame, double gain);
+
+private:
+    sf_count_t sourceFrames;
+    vector<EditPiece> pieces;
+    vector<sf_count_t> pieceStarts;
+
+    bool validRange(sf_count_t startFrame, sf_count_t endFrame, const char *function);
+    int split(sf_count_t frame);
+    void update();
+};
+
+#endif // EDITLIST_H
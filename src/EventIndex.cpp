@@ -0,0 +1,443 @@
+#include "EventIndex.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+/*!
+\file EventIndex.cpp
+\brief EventIndex implementation file.
+*/
+
+#define EVENT_INDEX_MAGIC "WFEVT002"
+
+/* Number of preceding hops whose mean energy an onset must rise above: about 90 ms at 44.1 kHz. */
+#define ONSET_HISTORY_HOPS 8
+/* Mean square below which a hop is never an onset: -60 dBFS. */
+#define ONSET_FLOOR_ENERGY 1e-6
+/* Added to both energies compared by the detector, so that a sound after digital silence has a finite rise. */
+#define ONSET_EPSILON 1e-10
+
+/*!
+\brief Constructs an empty index with the default silence threshold.
+*/
+EventIndex::EventIndex()
+{
+    this->silenceThresholdDb = DEFAULT_SILENCE_THRESHOLD_DB;
+    this->minSilenceSeconds = DEFAULT_MIN_SILENCE_SECONDS;
+    this->reset(0, 0, 0);
+}
+
+/*!
+\brief Discards all entries and counts the memory of the index from now on in an account.
+@param account The account, or NULL not to count the index.
+@param tier The tier of the account the index is counted in.
+*/
+void EventIndex::setMemoryAccount(MemoryAccount *account, MemoryTier tier)
+{
+    this->hopPeaks = CacheVector<int16_t>(CacheAllocator<int16_t>(account, tier));
+    this->onsetFrames = CacheVector<sf_count_t>(CacheAllocator<sf_count_t>(account, tier));
+    this->onsetStrengths = CacheVector<float>(CacheAllocator<float>(account, tier));
+    this->onsetTree = CacheVector<float>(CacheAllocator<float>(account, tier));
+    this->silenceStarts = CacheVector<sf_count_t>(CacheAllocator<sf_count_t>(account, tier));
+    this->silenceEnds = CacheVector<sf_count_t>(CacheAllocator<sf_count_t>(account, tier));
+    this->reset(0, 0, 0);
+}
+
+/*!
+\brief Discards all entries and prepares the index for a file with the given layout.  The silence threshold is kept.
+@param numChannels Number of channels of the file to be indexed.
+@param totalFrames Length of the file to be indexed, in frames.
+@param sampleRate Sample rate of the file to be indexed, which the minimum silence duration is converted with.
+*/
+void EventIndex::reset(int numChannels, sf_count_t totalFrames, int sampleRate)
+{
+    this->numChannels = numChannels;
+    this->totalFrames = totalFrames;
+    this->sampleRate = sampleRate;
+    this->framesAdded = 0;
+    this->framesInHop = 0;
+    this->hopSquares = 0.0;
+    this->hopLevels.assign(EVENT_HOP_FRAMES, 0.0);
+    this->history.assign(ONSET_HISTORY_HOPS, 0.0);
+    this->historyHops = 0;
+    this->hopPeaks.clear();
+    this->onsetFrames.clear();
+    this->onsetStrengths.clear();
+    this->onsetTree.clear();
+    this->onsetLeaves = 0;
+    this->lastOnsetHop = -1;
+    this->silenceStarts.clear();
+    this->silenceEnds.clear();
+    if(numChannels > 0 && totalFrames > 0)
+    {
+        this->hopPeaks.reserve((size_t) ((totalFrames + EVENT_HOP_FRAMES - 1) / EVENT_HOP_FRAMES));
+    }
+}
+
+/*!
+\brief Feeds the next frames of the file, in order, into the index.
+@param frames Interleaved, normalized samples.
+@param count Number of frames in frames.  Frames beyond the length given to reset() are ignored.
+*/
+void EventIndex::addFrames(const double *frames, sf_count_t count)
+{
+    count = min(count, this->totalFrames - this->framesAdded);
+    if(count <= 0)
+    {
+        return;
+    }
+
+    for(sf_count_t f = 0; f < count; f++)
+    {
+        const double *frame = &frames[f*this->numChannels];
+        double level = 0.0;
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            level = max(level, fabs(frame[c]));
+            this->hopSquares += frame[c]*frame[c];
+        }
+        this->hopLevels[this->framesInHop] = level;
+
+        this->framesInHop++;
+        if(this->framesInHop == EVENT_HOP_FRAMES)
+        {
+            this->closeHop();
+        }
+    }
+    this->framesAdded += count;
+
+    if(this->isComplete())
+    {
+        if(this->framesInHop > 0)
+        {
+            this->closeHop();
+        }
+        this->findSilences();
+        this->buildOnsetTree();
+    }
+}
+
+/*!
+\brief Whether every frame of the file has been fed into the index.
+*/
+bool EventIndex::isComplete()
+{
+    return this->numChannels > 0 && this->framesAdded >= this->totalFrames;
+}
+
+/*!
+\brief Sets what counts as silence, and works out the silent spans again if the index is complete.
+@param thresholdDb Level below which a hop is silent, in dBFS.
+@param minSeconds Shortest silent span reported, in seconds.
+*/
+void EventIndex::setSilenceThreshold(double thresholdDb, double minSeconds)
+{
+    this->silenceThresholdDb = thresholdDb;
+    this->minSilenceSeconds = max(0.0, minSeconds);
+    if(this->isComplete())
+    {
+        this->findSilences();
+    }
+}
+
+/*!
+\brief Returns the level below which a hop is silent, in dBFS.
+*/
+double EventIndex::getSilenceThresholdDb()
+{
+    return this->silenceThresholdDb;
+}
+
+/*!
+\brief Returns the shortest silent span reported, in seconds.
+*/
+double EventIndex::getMinSilenceSeconds()
+{
+    return this->minSilenceSeconds;
+}
+
+/*!
+\brief Number of silent spans found with the current threshold.
+*/
+sf_count_t EventIndex::getNumSilences()
+{
+    return (sf_count_t) this->silenceStarts.size();
+}
+
+/*!
+\brief Finds the first silent span that ends after a frame.  Spans start and end on hop boundaries.
+@param frame The frame to search from.  If it lies in a silent span, that span is returned.
+@param start Set to the first frame of the span.
+@param end Set to the frame after the last frame of the span.
+@return false if the index is not complete or no span ends after frame.
+*/
+bool EventIndex::nextSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end)
+{
+    if(!this->isComplete())
+    {
+        return false;
+    }
+    size_t i = upper_bound(this->silenceEnds.begin(), this->silenceEnds.end(), frame) - this->silenceEnds.begin();
+    if(i == this->silenceEnds.size())
+    {
+        return false;
+    }
+    *start = this->silenceStarts[i];
+    *end = this->silenceEnds[i];
+    return true;
+}
+
+/*!
+\brief Number of onsets found in the file.
+*/
+sf_count_t EventIndex::getNumOnsets()
+{
+    return (sf_count_t) this->onsetFrames.size();
+}
+
+/*!
+\brief Finds the first onset after a frame with at least a given strength.
+@param frame The frame to search from.  An onset at frame itself is not returned, so that repeated calls step
+through the onsets.
+@param minStrengthDb Weakest rise to return, in dB.  Only rises of ONSET_MIN_RISE_DB and above are recorded.
+@param onset Set to the frame of the onset.
+@param strengthDb Set to the strength of the onset, in dB.  May be NULL.
+@return false if the index is not complete or there is no such onset.
+*/
+bool EventIndex::nextOnset(sf_count_t frame, double minStrengthDb, sf_count_t *onset, double *strengthDb)
+{
+    if(!this->isComplete() || this->onsetFrames.empty())
+    {
+        return false;
+    }
+    size_t first = upper_bound(this->onsetFrames.begin(), this->onsetFrames.end(), frame) - this->onsetFrames.begin();
+    if(first == this->onsetFrames.size())
+    {
+        return false;
+    }
+
+    /* Climbs to the leftmost subtree starting at or after first that holds a strong enough onset, then descends it. */
+    size_t node = first + this->onsetLeaves;
+    while(this->onsetTree[node] < minStrengthDb)
+    {
+        while(node & 1)
+        {
+            node >>= 1;
+            if(node == 0)
+            {
+                return false;
+            }
+        }
+        node++;
+    }
+    while(node < this->onsetLeaves)
+    {
+        node = (this->onsetTree[2*node] >= minStrengthDb) ? 2*node : 2*node + 1;
+    }
+
+    size_t i = node - this->onsetLeaves;
+    *onset = this->onsetFrames[i];
+    if(strengthDb != NULL)
+    {
+        *strengthDb = this->onsetStrengths[i];
+    }
+    return true;
+}
+
+/*
+ * Records the peak of the hop just filled and whether it is an onset, then starts the next hop.
+ */
+void EventIndex::closeHop()
+{
+    sf_count_t hop = (sf_count_t) this->hopPeaks.size();
+    double peak = 0.0;
+    for(sf_count_t f = 0; f < this->framesInHop; f++)
+    {
+        peak = max(peak, this->hopLevels[f]);
+    }
+    this->hopPeaks.push_back(encodePeakMax(peak));
+
+    double energy = this->hopSquares / (this->framesInHop * this->numChannels);
+    sf_count_t historyLength = min(this->historyHops, (sf_count_t) ONSET_HISTORY_HOPS);
+    double mean = 0.0;
+    for(sf_count_t h = 0; h < historyLength; h++)
+    {
+        mean += this->history[h];
+    }
+    mean = (historyLength > 0) ? mean / historyLength : 0.0;
+    double rise = 10.0 * log10((energy + ONSET_EPSILON) / (mean + ONSET_EPSILON));
+
+    if(energy >= ONSET_FLOOR_ENERGY && rise >= ONSET_MIN_RISE_DB)
+    {
+        if(!this->onsetFrames.empty() && this->lastOnsetHop == hop - 1)
+        {
+            this->onsetStrengths.back() = max(this->onsetStrengths.back(), (float) rise);
+        }
+        else
+        {
+            sf_count_t f = 0;
+            while(f < this->framesInHop - 1 && this->hopLevels[f] < 0.5 * peak)
+            {
+                f++;
+            }
+            this->onsetFrames.push_back(hop * EVENT_HOP_FRAMES + f);
+            this->onsetStrengths.push_back((float) rise);
+        }
+        this->lastOnsetHop = hop;
+    }
+
+    this->history[this->historyHops % ONSET_HISTORY_HOPS] = energy;
+    this->historyHops++;
+    this->framesInHop = 0;
+    this->hopSquares = 0.0;
+}
+
+/*
+ * Works out the silent spans for the current threshold from the hop peaks.
+ */
+void EventIndex::findSilences()
+{
+    this->silenceStarts.clear();
+    this->silenceEnds.clear();
+
+    double threshold = pow(10.0, this->silenceThresholdDb / 20.0);
+    sf_count_t minFrames = (sf_count_t) ceil(this->minSilenceSeconds * this->sampleRate);
+    sf_count_t numHops = (sf_count_t) this->hopPeaks.size();
+    sf_count_t runStart = -1;
+    for(sf_count_t hop = 0; hop <= numHops; hop++)
+    {
+        bool silent = hop < numHops && decodePeak(this->hopPeaks[hop]) < threshold;
+        if(silent && runStart < 0)
+        {
+            runStart = hop;
+        }
+        else if(!silent && runStart >= 0)
+        {
+            sf_count_t start = runStart * EVENT_HOP_FRAMES;
+            sf_count_t end = min(hop * EVENT_HOP_FRAMES, this->totalFrames);
+            if(end - start >= max(minFrames, (sf_count_t) 1))
+            {
+                this->silenceStarts.push_back(start);
+                this->silenceEnds.push_back(end);
+            }
+            runStart = -1;
+        }
+    }
+}
+
+/*
+ * Builds the tree used by nextOnset(): a complete binary tree over the onset strengths, padded to a power of two,
+ * whose every node holds the largest strength below it.
+ */
+void EventIndex::buildOnsetTree()
+{
+    this->onsetLeaves = 1;
+    while(this->onsetLeaves < this->onsetStrengths.size())
+    {
+        this->onsetLeaves *= 2;
+    }
+    this->onsetTree.assign(2 * this->onsetLeaves, -HUGE_VALF);
+    copy(this->onsetStrengths.begin(), this->onsetStrengths.end(), this->onsetTree.begin() + this->onsetLeaves);
+    for(size_t i = this->onsetLeaves; i-- > 1; )
+    {
+        this->onsetTree[i] = max(this->onsetTree[2*i], this->onsetTree[2*i + 1]);
+    }
+}
+
+/*!
+\brief Writes a complete index to a sidecar file.
+@param indexPath Destination path.
+@param key Identity of the indexed file, checked again by load().
+@return true on success.
+*/
+bool EventIndex::save(string indexPath, SeekIndexKey key)
+{
+    if(!this->isComplete())
+    {
+        return false;
+    }
+
+    string tempPath;
+    FILE *out = createSidecar(indexPath, &tempPath);
+    if(out == NULL)
+    {
+        fprintf(stderr, "failed to write event index \"%s\".\n", indexPath.c_str());
+        return false;
+    }
+
+    int hopFrames = EVENT_HOP_FRAMES;
+    long long numHops = (long long) this->hopPeaks.size();
+    long long numOnsets = (long long) this->onsetFrames.size();
+    bool ok = fwrite(EVENT_INDEX_MAGIC, 1, 8, out) == 8
+            && writeSeekIndexKey(out, key)
+            && fwrite(&hopFrames, sizeof(hopFrames), 1, out) == 1
+            && fwrite(&numHops, sizeof(numHops), 1, out) == 1
+            && fwrite(&numOnsets, sizeof(numOnsets), 1, out) == 1
+            && (numHops == 0 || fwrite(&this->hopPeaks[0], sizeof(int16_t), numHops, out) == (size_t) numHops)
+            && (numOnsets == 0
+                || (fwrite(&this->onsetFrames[0], sizeof(sf_count_t), numOnsets, out) == (size_t) numOnsets
+                    && fwrite(&this->onsetStrengths[0], sizeof(float), numOnsets, out) == (size_t) numOnsets));
+    ok = commitSidecar(out, tempPath, indexPath, ok);
+
+    if(!ok)
+    {
+        fprintf(stderr, "failed to write event index \"%s\".\n", indexPath.c_str());
+    }
+    return ok;
+}
+
+/*!
+\brief Replaces the index with one read from a sidecar file, if it was built from the same file.
+@param indexPath Path of the sidecar file.
+@param key Identity of the file about to be used; the load fails if it does not match the stored one.
+@return true if the index was loaded and is complete, false if the sidecar is missing, stale or damaged, in which
+case the index is left empty.
+*/
+bool EventIndex::load(string indexPath, SeekIndexKey key)
+{
+    FILE *in = fopen(indexPath.c_str(), "rb");
+    if(in == NULL)
+    {
+        return false;
+    }
+
+    char magic[8];
+    SeekIndexKey storedKey;
+    int hopFrames = 0;
+    long long numHops = 0;
+    long long numOnsets = 0;
+    bool ok = fread(magic, 1, 8, in) == 8 && memcmp(magic, EVENT_INDEX_MAGIC, 8) == 0
+            && readSeekIndexKey(in, &storedKey)
+            && sameFile(storedKey, key)
+            && fread(&hopFrames, sizeof(hopFrames), 1, in) == 1 && hopFrames == EVENT_HOP_FRAMES
+            && fread(&numHops, sizeof(numHops), 1, in) == 1
+            && numHops == (key.frames + EVENT_HOP_FRAMES - 1) / EVENT_HOP_FRAMES
+            && fread(&numOnsets, sizeof(numOnsets), 1, in) == 1
+            && numOnsets >= 0 && numOnsets <= numHops;
+
+    if(ok)
+    {
+        this->reset(key.channels, key.frames, key.sampleRate);
+        this->hopPeaks.resize(numHops);
+        this->onsetFrames.resize(numOnsets);
+        this->onsetStrengths.resize(numOnsets);
+        ok = (numHops == 0 || fread(&this->hopPeaks[0], sizeof(int16_t), numHops, in) == (size_t) numHops)
+            && (numOnsets == 0
+                || (fread(&this->onsetFrames[0], sizeof(sf_count_t), numOnsets, in) == (size_t) numOnsets
+                    && fread(&this->onsetStrengths[0], sizeof(float), numOnsets, in) == (size_t) numOnsets));
+    }
+    fclose(in);
+
+    if(!ok)
+    {
+        this->reset(0, 0, 0);
+        return false;
+    }
+    this->framesAdded = this->totalFrames;
+    this->findSilences();
+    this->buildOnsetTree();
+    return true;
+}
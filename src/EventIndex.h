@@ -0,0 +1,102 @@
+#ifndef EVENTINDEX_H
+#define EVENTINDEX_H
+
+#include <sndfile.h>
+
+#include "MemoryAccount.h"
+#include "PeakCodes.h"
+#include "SeekIndex.h"
+
+#include <string>
+#include <vector>
+
+/*!
+    \file EventIndex.h
+    \brief EventIndex header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of frames in each hop of an EventIndex: the resolution of its silent spans and of its onset detector
+(about 11 ms at 48 kHz).
+*/
+#define EVENT_HOP_FRAMES 512
+
+/*!
+\brief Rise in energy over the preceding hops, in dB, from which a hop is recorded as an onset.
+*/
+#define ONSET_MIN_RISE_DB 6.0
+
+/*!
+\brief Level below which a span counts as silent unless set otherwise, in dBFS.
+*/
+#define DEFAULT_SILENCE_THRESHOLD_DB -60.0
+
+/*!
+\brief Shortest silent span reported unless set otherwise, in seconds.
+*/
+#define DEFAULT_MIN_SILENCE_SECONDS 0.5
+
+/*!
+\brief Silent spans and onsets of an audio file, found during a single sequential pass, for navigation.
+
+The index keeps the peak of every hop of EVENT_HOP_FRAMES frames across all channels, as a 16-bit code (see
+PeakCodes.h) rounded up, and a list of onsets.  An onset is a hop whose energy rises by at least ONSET_MIN_RISE_DB
+above the mean of the hops before it; it is placed at the first frame of the hop that reaches half the hop's peak,
+and its strength is the rise, in dB.  Onsets in consecutive hops are merged into the first one.
+
+Silent spans are runs of hops whose peak is below a threshold, lasting at least a minimum duration.  They are worked
+out from the hop peaks, so changing the threshold or the duration with setSilenceThreshold() takes time in
+proportion to the number of hops but never reads the file.  Once the index is complete, nextSilence() and nextOnset()
+answer in logarithmic time: the spans are kept sorted, and a tree over the onset strengths finds the next onset of at
+least a given strength without visiting the weaker ones in between.
+
+The index can be saved to and loaded from a sidecar file, like a SeekIndex.  The sidecar holds 2 bytes per hop and
+12 bytes per onset.
+*/
+class EventIndex
+{
+public:
+    EventIndex();
+    void setMemoryAccount(MemoryAccount *account, MemoryTier tier);
+    void reset(int numChannels, sf_count_t totalFrames, int sampleRate);
+    void addFrames(const double *frames, sf_count_t count);
+    bool isComplete();
+    void setSilenceThreshold(double thresholdDb, double minSeconds);
+    double getSilenceThresholdDb();
+    double getMinSilenceSeconds();
+    sf_count_t getNumSilences();
+    bool nextSilence(sf_count_t frame, sf_count_t *start, sf_count_t *end);
+    sf_count_t getNumOnsets();
+    bool nextOnset(sf_count_t frame, double minStrengthDb, sf_count_t *onset, double *strengthDb);
+    bool save(string indexPath, SeekIndexKey key);
+    bool load(string indexPath, SeekIndexKey key);
+
+private:
+    int numChannels;
+    sf_count_t totalFrames;
+    int sampleRate;
+    sf_count_t framesAdded;
+    sf_count_t framesInHop;
+    double hopSquares;
+    vector<double> hopLevels;
+    vector<double> history;
+    sf_count_t historyHops;
+    CacheVector<int16_t> hopPeaks;
+    CacheVector<sf_count_t> onsetFrames;
+    CacheVector<float> onsetStrengths;
+    CacheVector<float> onsetTree;
+    size_t onsetLeaves;
+    sf_count_t lastOnsetHop;
+    double silenceThresholdDb;
+    double minSilenceSeconds;
+    CacheVector<sf_count_t> silenceStarts;
+    CacheVector<sf_count_t> silenceEnds;
+
+    void closeHop();
+    void findSilences();
+    void buildOnsetTree();
+};
+
+#endif // EVENTINDEX_H
@@ -0,0 +1,213 @@
+#include "FileReadHints.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+/*!
+\file FileReadHints.cpp
+\brief FileReadHints implementation file.
+*/
+
+/*!
+\brief Constructs hints for no file; every hint does nothing until open() is called.
+*/
+FileReadHints::FileReadHints()
+{
+    this->fd = -1;
+    this->dataOffset = 0;
+    this->bytesPerFrame = 0;
+    this->numFrames = 0;
+}
+
+FileReadHints::~FileReadHints()
+{
+    this->close();
+}
+
+/*!
+\brief Opens a file to give hints about.
+@param path Path of the file.
+@param info The layout of the file, as libsndfile reported it.
+@return true if the file could be opened.  Hints about a file that could not be opened do nothing.
+*/
+bool FileReadHints::open(string path, const SF_INFO &info)
+{
+    this->close();
+#ifdef POSIX_FADV_NORMAL
+    this->fd = ::open(path.c_str(), O_RDONLY);
+    if(this->fd < 0)
+    {
+        return false;
+    }
+
+    int bytesPerSample = 0;
+    int majorFormat = info.format & SF_FORMAT_TYPEMASK;
+    if(majorFormat != SF_FORMAT_FLAC && majorFormat != SF_FORMAT_OGG)
+    {
+        switch(info.format & SF_FORMAT_SUBMASK)
+        {
+            case SF_FORMAT_PCM_S8:
+            case SF_FORMAT_PCM_U8:
+            case SF_FORMAT_ULAW:
+            case SF_FORMAT_ALAW:
+                bytesPerSample = 1;
+                break;
+            case SF_FORMAT_PCM_16:
+                bytesPerSample = 2;
+                break;
+            case SF_FORMAT_PCM_24:
+                bytesPerSample = 3;
+                break;
+            case SF_FORMAT_PCM_32:
+            case SF_FORMAT_FLOAT:
+                bytesPerSample = 4;
+                break;
+            case SF_FORMAT_DOUBLE:
+                bytesPerSample = 8;
+                break;
+        }
+    }
+
+    struct stat fileStat;
+    if(bytesPerSample > 0 && info.frames > 0 && fstat(this->fd, &fileStat) == 0)
+    {
+        this->bytesPerFrame = bytesPerSample * info.channels;
+        this->numFrames = info.frames;
+        this->dataOffset = max((off_t) 0, fileStat.st_size - (off_t) (info.frames * this->bytesPerFrame));
+    }
+    return true;
+#else
+    (void) path;
+    (void) info;
+    return false;
+#endif
+}
+
+/*!
+\brief Closes the file.  Pages already asked for stay in the page cache.
+*/
+void FileReadHints::close()
+{
+    if(this->fd >= 0)
+    {
+        ::close(this->fd);
+    }
+    this->fd = -1;
+    this->dataOffset = 0;
+    this->bytesPerFrame = 0;
+    this->numFrames = 0;
+}
+
+/*!
+\brief Whether a file is open.
+*/
+bool FileReadHints::isOpen()
+{
+    return this->fd >= 0;
+}
+
+/*!
+\brief Whether willNeed() and dontNeed() can work on ranges of frames, which requires an uncompressed file.
+*/
+bool FileReadHints::isFrameAddressable()
+{
+    return this->fd >= 0 && this->bytesPerFrame > 0;
+}
+
+/*!
+\brief Tells the kernel whether the file is being read from start to end, in which case it reads further ahead of
+each read and lets pages already read go sooner.
+*/
+void FileReadHints::setSequential(bool sequential)
+{
+#ifdef POSIX_FADV_NORMAL
+    this->advise(0, 0, sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_NORMAL);
+#else
+    (void) sequential;
+#endif
+}
+
+/*!
+\brief Asks the kernel to start reading the frames [startFrame, endFrame) into the page cache.  Returns at once.
+*/
+void FileReadHints::willNeed(sf_count_t startFrame, sf_count_t endFrame)
+{
+#ifdef POSIX_FADV_NORMAL
+    off_t offset, length;
+    if(this->byteRange(startFrame, endFrame, &offset, &length))
+    {
+        this->advise(offset, length, POSIX_FADV_WILLNEED);
+    }
+#else
+    (void) startFrame;
+    (void) endFrame;
+#endif
+}
+
+/*!
+\brief Tells the kernel that the frames [startFrame, endFrame) will not be read again soon.
+*/
+void FileReadHints::dontNeed(sf_count_t startFrame, sf_count_t endFrame)
+{
+#ifdef POSIX_FADV_NORMAL
+    off_t offset, length;
+    if(this->byteRange(startFrame, endFrame, &offset, &length))
+    {
+        this->advise(offset, length, POSIX_FADV_DONTNEED);
+    }
+#else
+    (void) startFrame;
+    (void) endFrame;
+#endif
+}
+
+/*!
+\brief Tells the kernel that no part of the file will be read again soon.
+*/
+void FileReadHints::dontNeedAll()
+{
+#ifdef POSIX_FADV_NORMAL
+    this->advise(0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+/*
+ * The bytes of the frames [startFrame, endFrame), clipped to the file.  False if the file is not
+ * frame addressable or the range is empty.
+ */
+bool FileReadHints::byteRange(sf_count_t startFrame, sf_count_t endFrame, off_t *offset, off_t *length)
+{
+    if(!this->isFrameAddressable())
+    {
+        return false;
+    }
+    startFrame = max((sf_count_t) 0, startFrame);
+    endFrame = min(this->numFrames, endFrame);
+    if(startFrame >= endFrame)
+    {
+        return false;
+    }
+    *offset = this->dataOffset + (off_t) startFrame * this->bytesPerFrame;
+    *length = (off_t) (endFrame - startFrame) * this->bytesPerFrame;
+    return true;
+}
+
+/*
+ * A length of 0 covers the file from offset to its end.
+ */
+void FileReadHints::advise(off_t offset, off_t length, int advice)
+{
+#ifdef POSIX_FADV_NORMAL
+    if(this->fd >= 0)
+    {
+        posix_fadvise(this->fd, offset, length, advice);
+    }
+#else
+    (void) offset;
+    (void) length;
+    (void) advice;
+#endif
+}
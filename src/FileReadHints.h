@@ -0,0 +1,56 @@
+#ifndef FILEREADHINTS_H
+#define FILEREADHINTS_H
+
+#include <sndfile.h>
+#include <sys/types.h>
+
+#include <string>
+
+/*!
+    \file FileReadHints.h
+    \brief FileReadHints header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Tells the kernel how an audio file is about to be read, so that it can fetch it ahead and keep it or let it go.
+
+The hints are given with posix_fadvise() on a descriptor of the file held only for that purpose; libsndfile keeps
+doing the reading.  A hint returns at once: the pages asked for with willNeed() are read by the kernel in the
+background, as many at a time as the device takes, and a later read of them by any decoder finds them in the page
+cache.  dontNeed() lets the kernel drop pages the caller has no more use for, so that a pass over a long file does
+not push everything else out of the page cache.
+
+Frame ranges can only be turned into byte ranges in uncompressed files, where every frame takes the same number of
+bytes (see isFrameAddressable()).  The audio data is taken to end the file, which puts the start of the data a
+trailing chunk too late at worst; hints are advisory, so such an error only costs a few pages.  For compressed files
+only setSequential() and dontNeedAll() have an effect.  On systems without posix_fadvise(), nothing does.
+
+Every function but open() and close() may be called from any thread.
+*/
+class FileReadHints
+{
+public:
+    FileReadHints();
+    ~FileReadHints();
+    bool open(string path, const SF_INFO &info);
+    void close();
+    bool isOpen();
+    bool isFrameAddressable();
+    void setSequential(bool sequential);
+    void willNeed(sf_count_t startFrame, sf_count_t endFrame);
+    void dontNeed(sf_count_t startFrame, sf_count_t endFrame);
+    void dontNeedAll();
+
+private:
+    int fd;
+    off_t dataOffset;
+    int bytesPerFrame;
+    sf_count_t numFrames;
+
+    bool byteRange(sf_count_t startFrame, sf_count_t endFrame, off_t *offset, off_t *length);
+    void advise(off_t offset, off_t length, int advice);
+};
+
+#endif // FILEREADHINTS_H
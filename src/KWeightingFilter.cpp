@@ -0,0 +1,96 @@
+#include "KWeightingFilter.h"
+
+#include <math.h>
+
+/*!
+\file KWeightingFilter.cpp
+\brief KWeightingFilter implementation file.
+*/
+
+/*!
+\brief Constructs a filter with no channels; reset() must be called before use.
+*/
+KWeightingFilter::KWeightingFilter()
+{
+    this->reset(0, 48000);
+}
+
+/*!
+\brief Designs the filter for a sample rate and clears its state.
+@param numChannels Number of interleaved channels to filter.
+@param sampleRate Sample rate of the signal, in Hz.
+*/
+void KWeightingFilter::reset(int numChannels, int sampleRate)
+{
+    this->numChannels = numChannels;
+    this->state.assign(numChannels > 0 ? 4*numChannels : 0, 0.0);
+
+    if(sampleRate <= 0)
+    {
+        sampleRate = 48000;
+    }
+
+    /* Stage 1: high shelf. */
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / sampleRate);
+    double vh = pow(10.0, gain / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    this->shelfB[0] = (vh + vb * k / q + k * k) / a0;
+    this->shelfB[1] = 2.0 * (k * k - vh) / a0;
+    this->shelfB[2] = (vh - vb * k / q + k * k) / a0;
+    this->shelfA[0] = 1.0;
+    this->shelfA[1] = 2.0 * (k * k - 1.0) / a0;
+    this->shelfA[2] = (1.0 - k / q + k * k) / a0;
+
+    /* Stage 2: high-pass. */
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sampleRate);
+    a0 = 1.0 + k / q + k * k;
+    this->highPassB[0] = 1.0;
+    this->highPassB[1] = -2.0;
+    this->highPassB[2] = 1.0;
+    this->highPassA[0] = 1.0;
+    this->highPassA[1] = 2.0 * (k * k - 1.0) / a0;
+    this->highPassA[2] = (1.0 - k / q + k * k) / a0;
+}
+
+/*!
+\brief Filters the next frames of the signal.
+@param frames Interleaved input samples.
+@param count Number of frames.
+@param weighted Receives count frames of interleaved, K-weighted samples.  May be the same buffer as frames.
+*/
+void KWeightingFilter::process(const double *frames, sf_count_t count, double *weighted)
+{
+    for(int c = 0; c < this->numChannels; c++)
+    {
+        /* Transposed direct form II; two state variables per stage. */
+        double s1 = this->state[4*c];
+        double s2 = this->state[4*c + 1];
+        double t1 = this->state[4*c + 2];
+        double t2 = this->state[4*c + 3];
+
+        for(sf_count_t i = c; i < count * this->numChannels; i += this->numChannels)
+        {
+            double x = frames[i];
+            double y = this->shelfB[0] * x + s1;
+            s1 = this->shelfB[1] * x - this->shelfA[1] * y + s2;
+            s2 = this->shelfB[2] * x - this->shelfA[2] * y;
+
+            double z = this->highPassB[0] * y + t1;
+            t1 = this->highPassB[1] * y - this->highPassA[1] * z + t2;
+            t2 = this->highPassB[2] * y - this->highPassA[2] * z;
+
+            weighted[i] = z;
+        }
+
+        this->state[4*c] = s1;
+        this->state[4*c + 1] = s2;
+        this->state[4*c + 2] = t1;
+        this->state[4*c + 3] = t2;
+    }
+}
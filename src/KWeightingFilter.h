@@ -0,0 +1,39 @@
+#ifndef KWEIGHTINGFILTER_H
+#define KWEIGHTINGFILTER_H
+
+#include <sndfile.h>
+
+#include <vector>
+
+/*!
+    \file KWeightingFilter.h
+    \brief KWeightingFilter header file.
+*/
+
+using namespace std;
+
+/*!
+\brief The K-weighting filter of ITU-R BS.1770, the first stage of a loudness measurement.
+
+It is a cascade of two biquads: a high shelf of about +4 dB above 1.5 kHz, modelling the acoustic effect of the head,
+and a high-pass at about 38 Hz.  The coefficients are derived for the sample rate of the file, so the filter matches
+the published 48 kHz coefficients at that rate.  The mean square of the filtered signal, summed over channels, gives
+the loudness: -0.691 + 10 log10(sum) LUFS.
+*/
+class KWeightingFilter
+{
+public:
+    KWeightingFilter();
+    void reset(int numChannels, int sampleRate);
+    void process(const double *frames, sf_count_t count, double *weighted);
+
+private:
+    int numChannels;
+    double shelfB[3];
+    double shelfA[3];
+    double highPassB[3];
+    double highPassA[3];
+    vector<double> state;
+};
+
+#endif // KWEIGHTINGFILTER_H
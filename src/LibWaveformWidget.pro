@@ -9,12 +9,56 @@ CONFIG += dll
 
 INCLUDEPATH += /usr/include
 
+QMAKE_CXXFLAGS += -std=c++11
+
+# Uncomment to compile the PERF_SCOPE/PERF_COUNT timing instrumentation into the
+# library (see PerfStats.h).
+# DEFINES += WAVEFORM_PROFILING
+
 SOURCES += WaveformWidget.cpp \
-    AudioUtil.cpp 
+    WaveformRenderer.cpp \
+    AudioUtil.cpp \
+    PerfStats.cpp \
+    SeekIndex.cpp \
+    ChunkedSampleBuffer.cpp \
+    CompressedSampleBuffer.cpp \
+    KWeightingFilter.cpp \
+    SpectrogramTileCache.cpp \
+    WaveformListWidget.cpp \
+    SampleRing.cpp \
+    LiveAudioSource.cpp \
+    LiveWaveformWidget.cpp \
+    MemoryAccount.cpp \
+    EventIndex.cpp \
+    AudioSource.cpp \
+    AudioProbe.cpp \
+    WaveformOverviewWidget.cpp \
+    EditList.cpp \
+    FileReadHints.cpp
 
 HEADERS += WaveformWidget.h \
+    WaveformRenderer.h \
     AudioUtil.h \
-    MathUtil.h
+    MathUtil.h \
+    PerfStats.h \
+    SeekIndex.h \
+    ChunkedSampleBuffer.h \
+    CompressedSampleBuffer.h \
+    KWeightingFilter.h \
+    SpectrogramTileCache.h \
+    WaveformListWidget.h \
+    SampleKernels.h \
+    SampleRing.h \
+    LiveAudioSource.h \
+    LiveWaveformWidget.h \
+    PeakCodes.h \
+    MemoryAccount.h \
+    EventIndex.h \
+    AudioSource.h \
+    AudioProbe.h \
+    WaveformOverviewWidget.h \
+    EditList.h \
+    FileReadHints.h
 
 LIBS += -lsndfile \
     -L/usr/lib
@@ -0,0 +1,255 @@
+#include "LiveAudioSource.h"
+
+/*!
+\file LiveAudioSource.cpp
+\brief LiveAudioSource implementation file.
+*/
+
+/*!
+\brief Constructs an empty stream.  All memory the stream will use is allocated here.
+@param numChannels Number of interleaved channels the source pushes.
+@param sampleRate Sample rate of the source, in Hz.
+*/
+LiveAudioSource::LiveAudioSource(int numChannels, int sampleRate)
+    : ring(numChannels, (sf_count_t) max(sampleRate, 1) * LIVE_RING_SECONDS)
+{
+    this->numChannels = this->ring.getNumChannels();
+    this->sampleRate = sampleRate;
+    this->totalFrames = 0;
+    this->popBuffer.resize(LIVE_POLL_FRAMES * this->numChannels);
+    this->levelMin.assign(LIVE_LEVELS, vector<int16_t>(LIVE_LEVEL_BUCKETS * this->numChannels, 0));
+    this->levelMax.assign(LIVE_LEVELS, vector<int16_t>(LIVE_LEVEL_BUCKETS * this->numChannels, 0));
+    this->levelBuckets.assign(LIVE_LEVELS, 0);
+    this->pendingMin.assign(this->numChannels, HUGE_VALF);
+    this->pendingMax.assign(this->numChannels, -HUGE_VALF);
+    this->pendingFrames = 0;
+    this->pendingMinCodes.resize(this->numChannels);
+    this->pendingMaxCodes.resize(this->numChannels);
+    this->mergeMin.resize(LIVE_LEVELS * this->numChannels);
+    this->mergeMax.resize(LIVE_LEVELS * this->numChannels);
+}
+
+/*!
+\brief Number of interleaved channels of the stream.
+*/
+int LiveAudioSource::getNumChannels()
+{
+    return this->numChannels;
+}
+
+/*!
+\brief Sample rate of the stream, in Hz.
+*/
+int LiveAudioSource::getSampleRate()
+{
+    return this->sampleRate;
+}
+
+/*!
+\brief Hands frames from the audio thread to the consumer.  Never allocates, locks or waits.
+@param frames Interleaved samples.
+@param count Number of frames.
+@return the number of frames accepted.  If the consumer has fallen more than LIVE_RING_SECONDS behind, the rest
+are dropped (see getDroppedFrames()).
+*/
+sf_count_t LiveAudioSource::push(const float *frames, sf_count_t count)
+{
+    return this->ring.push(frames, count);
+}
+
+/*!
+\brief Like push(const float *, sf_count_t), for a source that delivers doubles.
+*/
+sf_count_t LiveAudioSource::push(const double *frames, sf_count_t count)
+{
+    return this->ring.push(frames, count);
+}
+
+/*!
+\brief Folds the frames pushed since the last call into the pyramid.  Consumer thread only.
+@return true if there were any.
+*/
+bool LiveAudioSource::poll()
+{
+    PERF_SCOPE("LiveAudioSource::poll");
+
+    sf_count_t before = this->totalFrames;
+    sf_count_t count;
+    while((count = this->ring.pop(&this->popBuffer[0], LIVE_POLL_FRAMES)) > 0)
+    {
+        const double *frame = &this->popBuffer[0];
+        for(sf_count_t i = 0; i < count; i++, frame += this->numChannels)
+        {
+            for(int c = 0; c < this->numChannels; c++)
+            {
+                float value = (float) frame[c];
+                this->pendingMin[c] = min(this->pendingMin[c], value);
+                this->pendingMax[c] = max(this->pendingMax[c], value);
+            }
+            if(++this->pendingFrames == LIVE_BUCKET_FRAMES)
+            {
+                for(int c = 0; c < this->numChannels; c++)
+                {
+                    this->pendingMinCodes[c] = encodePeakMin(this->pendingMin[c]);
+                    this->pendingMaxCodes[c] = encodePeakMax(this->pendingMax[c]);
+                }
+                this->addBucket(0, &this->pendingMinCodes[0], &this->pendingMaxCodes[0]);
+                this->pendingMin.assign(this->numChannels, HUGE_VALF);
+                this->pendingMax.assign(this->numChannels, -HUGE_VALF);
+                this->pendingFrames = 0;
+            }
+        }
+        this->totalFrames += count;
+    }
+    return this->totalFrames != before;
+}
+
+/*!
+\brief Number of frames folded into the pyramid so far; the frames of the stream are numbered from 0.
+*/
+sf_count_t LiveAudioSource::getTotalFrames()
+{
+    return this->totalFrames;
+}
+
+/*!
+\brief The first frame still summarized by the pyramid.  0 until the coarsest level starts overwriting buckets.
+*/
+sf_count_t LiveAudioSource::getOldestFrame()
+{
+    return this->oldestBucket(LIVE_LEVELS - 1) * bucketFrames(LIVE_LEVELS - 1);
+}
+
+/*!
+\brief Number of frames the audio thread pushed while the ring was full.
+*/
+long long LiveAudioSource::getDroppedFrames()
+{
+    return this->ring.getDroppedFrames();
+}
+
+/*!
+\brief Minimum and maximum of each channel over a range of frames.  Consumer thread only.
+
+Whole buckets are combined, so the range is widened to the buckets it touches: to multiples of LIVE_BUCKET_FRAMES
+frames for recent audio, and to coarser buckets for audio old enough to have left the finer levels.  The range is
+covered by at most two buckets per level.
+
+@param startFrame First frame of the range
+@param endFrame Frame just past the end of the range
+@param minValues Receives the minimum of each channel
+@param maxValues Receives the maximum of each channel
+@return false if no frame of the range has been received, or is still summarized.
+*/
+bool LiveAudioSource::rangeMinMax(sf_count_t startFrame, sf_count_t endFrame, double *minValues, double *maxValues)
+{
+    sf_count_t start = max(startFrame, this->getOldestFrame());
+    sf_count_t end = min(endFrame, this->totalFrames);
+    if(start >= end)
+    {
+        return false;
+    }
+
+    for(int c = 0; c < this->numChannels; c++)
+    {
+        minValues[c] = HUGE_VAL;
+        maxValues[c] = -HUGE_VAL;
+    }
+
+    /*
+      Cover the range from left to right with the largest buckets that start where the part already
+      covered ends and fit in the range, as in a segment tree: finest buckets at the ends, coarse ones
+      in the middle.  Where the fine buckets have been overwritten, the oldest bucket still holding the
+      frame is used instead, even if it reaches outside the range.  The newest frames, which no finest
+      bucket summarizes yet, are in the pending bucket.
+    */
+    while(start < end)
+    {
+        int level = 0;
+        sf_count_t bucket = start / LIVE_BUCKET_FRAMES;
+        if(bucket >= this->levelBuckets[0])
+        {
+            break;
+        }
+        while(level + 1 < LIVE_LEVELS && bucket < this->oldestBucket(level))
+        {
+            level++;
+            bucket = start / bucketFrames(level);
+        }
+        while(level + 1 < LIVE_LEVELS)
+        {
+            sf_count_t size = bucketFrames(level + 1);
+            if(start % size != 0 || start + size > end || start / size >= this->levelBuckets[level + 1])
+            {
+                break;
+            }
+            level++;
+            bucket = start / size;
+        }
+        this->foldBucket(level, bucket, minValues, maxValues);
+        start = (bucket + 1) * bucketFrames(level);
+    }
+
+    if(start < end && this->pendingFrames > 0)
+    {
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            minValues[c] = min(minValues[c], (double) this->pendingMin[c]);
+            maxValues[c] = max(maxValues[c], (double) this->pendingMax[c]);
+        }
+    }
+    return minValues[0] <= maxValues[0];
+}
+
+sf_count_t LiveAudioSource::bucketFrames(int level)
+{
+    return ((sf_count_t) LIVE_BUCKET_FRAMES) << level;
+}
+
+/* The oldest bucket of a level that has not been overwritten. */
+sf_count_t LiveAudioSource::oldestBucket(int level)
+{
+    return max((sf_count_t) 0, this->levelBuckets[level] - LIVE_LEVEL_BUCKETS);
+}
+
+/*
+  Appends a bucket to a level.  Every second bucket completes a pair, which is merged into a bucket
+  of the level above.
+*/
+void LiveAudioSource::addBucket(int level, const int16_t *minCodes, const int16_t *maxCodes)
+{
+    sf_count_t bucket = this->levelBuckets[level];
+    int16_t *slotMin = &this->levelMin[level][(bucket % LIVE_LEVEL_BUCKETS) * this->numChannels];
+    int16_t *slotMax = &this->levelMax[level][(bucket % LIVE_LEVEL_BUCKETS) * this->numChannels];
+    for(int c = 0; c < this->numChannels; c++)
+    {
+        slotMin[c] = minCodes[c];
+        slotMax[c] = maxCodes[c];
+    }
+    this->levelBuckets[level] = bucket + 1;
+
+    if(bucket % 2 == 1 && level + 1 < LIVE_LEVELS)
+    {
+        const int16_t *prevMin = &this->levelMin[level][((bucket - 1) % LIVE_LEVEL_BUCKETS) * this->numChannels];
+        const int16_t *prevMax = &this->levelMax[level][((bucket - 1) % LIVE_LEVEL_BUCKETS) * this->numChannels];
+        int16_t *mergedMin = &this->mergeMin[level * this->numChannels];
+        int16_t *mergedMax = &this->mergeMax[level * this->numChannels];
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            mergedMin[c] = min(prevMin[c], slotMin[c]);
+            mergedMax[c] = max(prevMax[c], slotMax[c]);
+        }
+        this->addBucket(level + 1, mergedMin, mergedMax);
+    }
+}
+
+void LiveAudioSource::foldBucket(int level, sf_count_t bucket, double *minValues, double *maxValues)
+{
+    const int16_t *slotMin = &this->levelMin[level][(bucket % LIVE_LEVEL_BUCKETS) * this->numChannels];
+    const int16_t *slotMax = &this->levelMax[level][(bucket % LIVE_LEVEL_BUCKETS) * this->numChannels];
+    for(int c = 0; c < this->numChannels; c++)
+    {
+        minValues[c] = min(minValues[c], decodePeak(slotMin[c]));
+        maxValues[c] = max(maxValues[c], decodePeak(slotMax[c]));
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef LIVEAUDIOSOURCE_H
+#define LIVEAUDIOSOURCE_H
+
+#include "PeakCodes.h"
+#include "PerfStats.h"
+#include "SampleRing.h"
+
+#include <sndfile.h>
+
+#include <math.h>
+#include <vector>
+
+/*!
+    \file LiveAudioSource.h
+    \brief LiveAudioSource header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of frames summarized by each bucket of the finest level of a LiveAudioSource.
+*/
+#define LIVE_BUCKET_FRAMES 64
+
+/*!
+\brief Number of buckets each level of a LiveAudioSource keeps.  Older buckets are overwritten.
+*/
+#define LIVE_LEVEL_BUCKETS 4096
+
+/*!
+\brief Number of levels of a LiveAudioSource.  The buckets of each level cover twice as many frames as those of the
+level below, so the coarsest level reaches LIVE_BUCKET_FRAMES * LIVE_LEVEL_BUCKETS * 2^(LIVE_LEVELS-1) frames back:
+about two days at 48 kHz.
+*/
+#define LIVE_LEVELS 16
+
+/*!
+\brief Length, in seconds, of the audio the ring between the audio thread and the consumer can hold.
+*/
+#define LIVE_RING_SECONDS 2
+
+/*!
+\brief Frames a LiveAudioSource takes out of its ring at a time.
+*/
+#define LIVE_POLL_FRAMES 4096
+
+/*!
+\brief A stream of audio pushed by a live source, such as an audio input callback, summarized for drawing.
+
+The audio thread hands its frames to push(), which only copies them into a SampleRing: it never allocates, locks
+or waits.  The consumer, usually the GUI thread of a LiveWaveformWidget, calls poll() to take them out of the ring
+and fold them into a rolling pyramid of minima and maxima.  The finest level summarizes every LIVE_BUCKET_FRAMES
+frames, and each level above summarizes pairs of buckets of the level below.  Every level is a ring of
+LIVE_LEVEL_BUCKETS buckets, so memory stays the same however long the stream runs: recent audio is kept at fine
+resolution and older audio at coarser resolution, until it falls off the coarsest level.  Buckets hold their
+extremes as 16-bit codes (see PeakCodes.h), 256 KB per channel for the whole pyramid.
+
+rangeMinMax() answers for any range of frames from a handful of buckets, at the finest resolution that still covers
+the range.  poll() and rangeMinMax() must be called on the same thread; push() on one other thread.
+*/
+class LiveAudioSource
+{
+public:
+    LiveAudioSource(int numChannels, int sampleRate);
+    int getNumChannels();
+    int getSampleRate();
+    sf_count_t push(const float *frames, sf_count_t count);
+    sf_count_t push(const double *frames, sf_count_t count);
+    bool poll();
+    sf_count_t getTotalFrames();
+    sf_count_t getOldestFrame();
+    long long getDroppedFrames();
+    bool rangeMinMax(sf_count_t startFrame, sf_count_t endFrame, double *minValues, double *maxValues);
+
+private:
+    int numChannels;
+    int sampleRate;
+    SampleRing ring;
+    sf_count_t totalFrames;
+    vector<double> popBuffer;
+    vector< vector<int16_t> > levelMin;
+    vector< vector<int16_t> > levelMax;
+    vector<sf_count_t> levelBuckets;
+    vector<float> pendingMin;
+    vector<float> pendingMax;
+    sf_count_t pendingFrames;
+    vector<int16_t> pendingMinCodes;
+    vector<int16_t> pendingMaxCodes;
+    vector<int16_t> mergeMin;
+    vector<int16_t> mergeMax;
+
+    static sf_count_t bucketFrames(int level);
+    sf_count_t oldestBucket(int level);
+    void addBucket(int level, const int16_t *minCodes, const int16_t *maxCodes);
+    void foldBucket(int level, sf_count_t bucket, double *minValues, double *maxValues);
+};
+
+#endif // LIVEAUDIOSOURCE_H
@@ -0,0 +1,129 @@
+#include "LiveWaveformWidget.h"
+
+/*!
+\file LiveWaveformWidget.cpp
+\brief LiveWaveformWidget implementation file.
+*/
+
+/*!
+\brief Constructs a widget showing an empty stream and starts polling it.
+@param numChannels Number of interleaved channels the audio thread will push.
+@param sampleRate Sample rate of the stream, in Hz.
+*/
+LiveWaveformWidget::LiveWaveformWidget(int numChannels, int sampleRate, QWidget *parent) : QWidget(parent)
+{
+    this->source = new LiveAudioSource(numChannels, sampleRate);
+    this->windowSeconds = DEFAULT_LIVE_WINDOW_SECONDS;
+    this->waveformColor = QColor(Qt::blue);
+    this->columnMin.resize(this->source->getNumChannels());
+    this->columnMax.resize(this->source->getNumChannels());
+    this->refreshTimer = new QTimer(this);
+    this->refreshTimer->setInterval(LIVE_REFRESH_INTERVAL);
+    QObject::connect(this->refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    this->refreshTimer->start();
+}
+
+/*The audio thread must have stopped pushing into the source before the widget is destroyed.*/
+LiveWaveformWidget::~LiveWaveformWidget()
+{
+    this->refreshTimer->stop();
+    delete this->source;
+}
+
+/*!
+\brief The source the audio thread pushes its frames into.  Only push() may be called from the audio thread.
+*/
+LiveAudioSource *LiveWaveformWidget::getSource()
+{
+    return this->source;
+}
+
+/*!
+\brief Sets the length of the stream shown, ending at the newest frame.
+@param seconds Length of the window, in seconds.
+*/
+void LiveWaveformWidget::setWindowSeconds(double seconds)
+{
+    if(seconds > 0.0)
+    {
+        this->windowSeconds = seconds;
+        this->update();
+    }
+}
+
+/*!
+\brief Returns the length of the stream shown, in seconds.
+*/
+double LiveWaveformWidget::getWindowSeconds()
+{
+    return this->windowSeconds;
+}
+
+/*!
+\brief Sets the color of the waveform.
+*/
+void LiveWaveformWidget::setColor(QColor color)
+{
+    this->waveformColor = color;
+    this->update();
+}
+
+/*!
+\brief Returns the color of the waveform.
+*/
+QColor LiveWaveformWidget::getColor()
+{
+    return this->waveformColor;
+}
+
+/*
+    Draws the window ending at the newest frame, one column per pixel, with the newest frames at the
+    right edge.  Columns before the start of the stream are left empty.
+*/
+void LiveWaveformWidget::paintEvent(QPaintEvent *event)
+{
+    PERF_SCOPE("LiveWaveformWidget::paintEvent");
+
+    int numChannels = this->source->getNumChannels();
+    int width = this->width();
+    if(width <= 0)
+    {
+        return;
+    }
+
+    /* Columns start on multiples of their length, so a column keeps its extremes as the view scrolls. */
+    sf_count_t columnFrames = max((sf_count_t) 1, (sf_count_t) (this->windowSeconds * this->source->getSampleRate()) / width);
+    sf_count_t endFrame = (this->source->getTotalFrames() / columnFrames + 1) * columnFrames;
+    sf_count_t startFrame = endFrame - columnFrames*width;
+
+    int extent = this->height()/(2*numChannels);
+    QPainter painter(this);
+    painter.setPen(QPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap));
+
+    int minX = max(0, event->rect().left());
+    int maxX = min(width, event->rect().right() + 1);
+    for(int i = minX; i < maxX; i++)
+    {
+        sf_count_t columnStart = startFrame + columnFrames*i;
+        sf_count_t columnEnd = columnStart + columnFrames;
+        if(columnEnd <= 0 || !this->source->rangeMinMax(max(columnStart, (sf_count_t) 0), columnEnd, &this->columnMin[0], &this->columnMax[0]))
+        {
+            continue;
+        }
+
+        for(int c = 0; c < numChannels; c++)
+        {
+            int channelYMidpoint = this->height()/2 + (2*c + 1 - numChannels)*(this->height()/(2*numChannels));
+            painter.drawLine(i, channelYMidpoint - (int) (extent*this->columnMax[c]), i, channelYMidpoint - (int) (extent*this->columnMin[c]));
+        }
+    }
+}
+
+/* Folds in whatever the audio thread pushed since the last refresh and repaints if there was any. */
+void LiveWaveformWidget::refresh()
+{
+    if(this->source->poll())
+    {
+        this->update();
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef LIVEWAVEFORMWIDGET_H
+#define LIVEWAVEFORMWIDGET_H
+
+#include "LiveAudioSource.h"
+#include "PerfStats.h"
+
+#include <vector>
+
+#include <QColor>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QTimer>
+#include <QWidget>
+
+/*!
+    \file LiveWaveformWidget.h
+    \brief LiveWaveformWidget header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Milliseconds between two refreshes of a LiveWaveformWidget: about the frame interval of a 60 Hz display.
+*/
+#define LIVE_REFRESH_INTERVAL 16
+#define DEFAULT_LIVE_WINDOW_SECONDS 5.0
+
+/*!
+\brief A scrolling view of the last few seconds of a live audio stream, such as an input being recorded.
+
+The audio thread pushes its frames into the widget's LiveAudioSource (getSource()->push()), which never blocks it.
+A timer on the GUI thread polls the source every LIVE_REFRESH_INTERVAL milliseconds and repaints the widget if
+frames arrived, so the view follows the stream at display rate however often, and in however large blocks, the
+audio thread delivers.  Each column shows the minimum and maximum of its slice of the window in every channel's
+lane, looked up in the source's min/max pyramid, so a repaint costs the same whatever the length of the window.
+*/
+class LiveWaveformWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    LiveWaveformWidget(int numChannels, int sampleRate, QWidget *parent = 0);
+    ~LiveWaveformWidget();
+    LiveAudioSource *getSource();
+    void setWindowSeconds(double seconds);
+    double getWindowSeconds();
+    void setColor(QColor color);
+    QColor getColor();
+
+protected:
+    virtual void paintEvent(QPaintEvent *event);
+
+private:
+    LiveAudioSource *source;
+    QTimer *refreshTimer;
+    double windowSeconds;
+    QColor waveformColor;
+    vector<double> columnMin;
+    vector<double> columnMax;
+
+private slots:
+    void refresh();
+};
+
+#endif // LIVEWAVEFORMWIDGET_H
@@ -12,7 +12,7 @@
 using namespace std;
 
 /*!
-    \brief Contains three simple utility functions leveraged by the WaveformWidget class
+    \brief Contains a few simple utility functions leveraged by the WaveformWidget class
 */
 class MathUtil
 {
@@ -47,6 +47,19 @@ public:
         return max;
     }
 
+    /*!\brief Returns the largest absolute value of all elements in a vector of double-precision floating point values, or 0 for an empty vector.*/
+    static double getVAbsMax(const vector<double> &vec)
+    {
+        double max = 0.0;
+
+        for(unsigned int i = 0; i < vec.size(); i++)
+        {
+            if(fabs(vec[i])>max)
+                max = fabs(vec[i]);
+        }
+        return max;
+    }
+
     /*!\brief Rounds a double-precision floating point value to the nearest integer.*/
     static double round(double value)
     {
@@ -0,0 +1,246 @@
+#include "MemoryAccount.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+#include <sstream>
+
+/*!
+\file MemoryAccount.cpp
+\brief MemoryAccount implementation file.
+*/
+
+namespace
+{
+    /*
+     * Takes memory from the global heap.  operator new already aligns to every fundamental alignment; larger
+     * alignments are taken with posix_memalign() and given back with free().
+     */
+    class HeapResource : public MemoryResource
+    {
+    protected:
+        virtual void *doAllocate(size_t bytes, size_t alignment)
+        {
+            if(alignment <= alignof(max_align_t))
+            {
+                return ::operator new(bytes);
+            }
+            void *pointer = NULL;
+            if(posix_memalign(&pointer, alignment, bytes == 0 ? 1 : bytes) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            return pointer;
+        }
+
+        virtual void doDeallocate(void *pointer, size_t bytes, size_t alignment)
+        {
+            (void) bytes;
+            if(alignment <= alignof(max_align_t))
+            {
+                ::operator delete(pointer);
+                return;
+            }
+            free(pointer);
+        }
+    };
+
+    HeapResource heapResource;
+    std::atomic<MemoryResource*> defaultResource(&heapResource);
+    std::atomic<size_t> globalBytes[NUM_MEMORY_TIERS];
+    std::atomic<size_t> globalPeakBytes[NUM_MEMORY_TIERS];
+}
+
+MemoryResource::~MemoryResource()
+{
+}
+
+/*!
+\brief Returns bytes bytes aligned to alignment, or throws std::bad_alloc.
+*/
+void *MemoryResource::allocate(size_t bytes, size_t alignment)
+{
+    return this->doAllocate(bytes, alignment);
+}
+
+/*!
+\brief Gives back memory returned by allocate() with the same size and alignment.
+*/
+void MemoryResource::deallocate(void *pointer, size_t bytes, size_t alignment)
+{
+    this->doDeallocate(pointer, bytes, alignment);
+}
+
+/*!
+\brief Returns the resource new accounts take their memory from.  Unless setDefault() was called, the global heap.
+*/
+MemoryResource *MemoryResource::getDefault()
+{
+    return defaultResource.load();
+}
+
+/*!
+\brief Sets the resource new accounts take their memory from.  Accounts that already exist keep their resource.
+@param resource The new default, or NULL to return to the global heap.
+*/
+void MemoryResource::setDefault(MemoryResource *resource)
+{
+    defaultResource.store(resource == NULL ? &heapResource : resource);
+}
+
+/*!
+\brief Constructs an empty account that takes its memory from the default resource.
+*/
+MemoryAccount::MemoryAccount()
+{
+    this->resource.store(MemoryResource::getDefault());
+    for(int t = 0; t < NUM_MEMORY_TIERS; t++)
+    {
+        this->bytes[t].store(0);
+    }
+}
+
+/*The containers using the account are members of its owner and are destroyed before it.*/
+MemoryAccount::~MemoryAccount()
+{
+}
+
+/*!
+\brief Sets the resource the account takes its memory from.
+\return false, leaving the resource unchanged, if memory taken from the current resource is still held.
+@param resource The new resource, or NULL for the default one.
+*/
+bool MemoryAccount::setResource(MemoryResource *resource)
+{
+    if(this->getTotalBytes() > 0)
+    {
+        fprintf(stderr, "Cannot change the memory resource while %lu bytes are allocated from it.\n", (unsigned long) this->getTotalBytes());
+        return false;
+    }
+    this->resource.store(resource == NULL ? MemoryResource::getDefault() : resource);
+    return true;
+}
+
+/*!
+\brief Returns the resource the account takes its memory from.
+*/
+MemoryResource *MemoryAccount::getResource()
+{
+    return this->resource.load();
+}
+
+/*!
+\brief Returns the bytes held through this account in one tier.
+*/
+size_t MemoryAccount::getBytes(MemoryTier tier)
+{
+    return this->bytes[tier].load(std::memory_order_relaxed);
+}
+
+/*!
+\brief Returns the bytes held through this account in all tiers.
+*/
+size_t MemoryAccount::getTotalBytes()
+{
+    size_t total = 0;
+    for(int t = 0; t < NUM_MEMORY_TIERS; t++)
+    {
+        total += this->bytes[t].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/*!
+\brief Takes memory from the account's resource and counts it in a tier.  Throws std::bad_alloc on failure.
+*/
+void *MemoryAccount::allocate(MemoryTier tier, size_t bytes, size_t alignment)
+{
+    void *pointer = this->resource.load()->allocate(bytes, alignment);
+    this->bytes[tier].fetch_add(bytes, std::memory_order_relaxed);
+
+    size_t total = globalBytes[tier].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = globalPeakBytes[tier].load(std::memory_order_relaxed);
+    while(total > peak && !globalPeakBytes[tier].compare_exchange_weak(peak, total, std::memory_order_relaxed))
+    {
+    }
+    return pointer;
+}
+
+/*!
+\brief Gives back memory taken by allocate() with the same tier, size and alignment.
+*/
+void MemoryAccount::deallocate(MemoryTier tier, void *pointer, size_t bytes, size_t alignment)
+{
+    this->resource.load()->deallocate(pointer, bytes, alignment);
+    this->bytes[tier].fetch_sub(bytes, std::memory_order_relaxed);
+    globalBytes[tier].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+/*!
+\brief Returns the bytes held in one tier by all accounts of the process.
+*/
+size_t MemoryAccount::getGlobalBytes(MemoryTier tier)
+{
+    return globalBytes[tier].load(std::memory_order_relaxed);
+}
+
+/*!
+\brief Returns the bytes held in all tiers by all accounts of the process.
+*/
+size_t MemoryAccount::getGlobalTotalBytes()
+{
+    size_t total = 0;
+    for(int t = 0; t < NUM_MEMORY_TIERS; t++)
+    {
+        total += globalBytes[t].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/*!
+\brief Returns the most bytes ever held at once in one tier by all accounts of the process.
+*/
+size_t MemoryAccount::getGlobalPeakBytes(MemoryTier tier)
+{
+    return globalPeakBytes[tier].load(std::memory_order_relaxed);
+}
+
+/*!
+\brief Returns a short readable name for a tier, as used by report().
+*/
+const char *MemoryAccount::tierName(MemoryTier tier)
+{
+    switch(tier)
+    {
+        case TIER_SAMPLE_CACHE:
+            return "sample cache";
+        case TIER_COMPRESSED_CACHE:
+            return "compressed cache";
+        case TIER_SEEK_INDEX:
+            return "seek index";
+        case TIER_EVENT_INDEX:
+            return "event index";
+        case TIER_READ_AHEAD:
+            return "read-ahead";
+        case TIER_RENDERER:
+            return "renderer";
+        default:
+            return "unknown";
+    }
+}
+
+/*!
+\brief Returns a readable summary of the bytes currently held, and the peak, in every tier across the process.
+*/
+string MemoryAccount::report()
+{
+    ostringstream out;
+    for(int t = 0; t < NUM_MEMORY_TIERS; t++)
+    {
+        MemoryTier tier = (MemoryTier) t;
+        out << tierName(tier) << ": bytes=" << getGlobalBytes(tier) << " peak=" << getGlobalPeakBytes(tier) << "\n";
+    }
+    out << "total: bytes=" << getGlobalTotalBytes() << "\n";
+    return out.str();
+}
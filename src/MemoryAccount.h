@@ -0,0 +1,156 @@
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*!
+    \file MemoryAccount.h
+    \brief MemoryAccount header file.  Contains the memory resources, accounts and allocator used by the caches.
+*/
+
+using namespace std;
+
+/*!
+\brief The kinds of cache memory that are accounted separately.
+*/
+enum MemoryTier
+{
+    TIER_SAMPLE_CACHE,      /*!< Decoded samples of AudioUtil's FULL_CACHE mode. */
+    TIER_COMPRESSED_CACHE,  /*!< Compressed and hot decoded blocks of AudioUtil's COMPRESSED_CACHE mode. */
+    TIER_SEEK_INDEX,        /*!< AudioUtil's seek index. */
+    TIER_EVENT_INDEX,       /*!< AudioUtil's index of silent spans and onsets. */
+    TIER_READ_AHEAD,        /*!< Blocks read ahead of the viewer in DISK_MODE. */
+    TIER_RENDERER,          /*!< Column peaks and samples cached by a WaveformRenderer. */
+    NUM_MEMORY_TIERS
+};
+
+/*!
+\brief A source of memory for the caches, after std::pmr::memory_resource.
+
+The default resource takes memory from the global heap.  To put the caches in an arena, a pool of huge pages or
+any other allocator, derive from this class, implement doAllocate() and doDeallocate(), and give an instance to
+MemoryAccount::setResource() or, before any cache is allocated, to setDefault().  A resource must outlive every
+account that uses it, and may be called from several threads at once.
+*/
+class MemoryResource
+{
+public:
+    virtual ~MemoryResource();
+    void *allocate(size_t bytes, size_t alignment);
+    void deallocate(void *pointer, size_t bytes, size_t alignment);
+    static MemoryResource *getDefault();
+    static void setDefault(MemoryResource *resource);
+
+protected:
+    /*! \brief Returns bytes bytes aligned to alignment, or throws std::bad_alloc. */
+    virtual void *doAllocate(size_t bytes, size_t alignment) = 0;
+    /*! \brief Gives back memory returned by doAllocate() with the same size and alignment. */
+    virtual void doDeallocate(void *pointer, size_t bytes, size_t alignment) = 0;
+};
+
+/*!
+\brief Counts the bytes held by the caches of one owner, such as an AudioUtil instance, in each MemoryTier.
+
+Every allocation made through the account is taken from its MemoryResource and added both to the account and to
+process-wide totals, which getGlobalBytes() and report() read back, so the memory of a whole fleet of viewers can be
+broken down by tier.  The counts are of bytes requested by the containers, including their spare capacity.
+
+All functions are safe to call from any thread.
+*/
+class MemoryAccount
+{
+public:
+    MemoryAccount();
+    ~MemoryAccount();
+    bool setResource(MemoryResource *resource);
+    MemoryResource *getResource();
+    size_t getBytes(MemoryTier tier);
+    size_t getTotalBytes();
+    void *allocate(MemoryTier tier, size_t bytes, size_t alignment);
+    void deallocate(MemoryTier tier, void *pointer, size_t bytes, size_t alignment);
+    static size_t getGlobalBytes(MemoryTier tier);
+    static size_t getGlobalTotalBytes();
+    static size_t getGlobalPeakBytes(MemoryTier tier);
+    static const char *tierName(MemoryTier tier);
+    static string report();
+
+private:
+    std::atomic<MemoryResource*> resource;
+    std::atomic<size_t> bytes[NUM_MEMORY_TIERS];
+
+    MemoryAccount(const MemoryAccount &);
+    MemoryAccount &operator=(const MemoryAccount &);
+};
+
+/*!
+\brief A standard allocator that takes its memory through a MemoryAccount, in one tier.
+
+A default-constructed allocator has no account: its memory comes from the MemoryResource that was the default
+when the allocator was constructed, and is not counted.  Containers that hold cache memory are declared as CacheVector and are given their
+allocator by their owner, while they are still empty.  The allocator follows the container when it is assigned or
+swapped, so a container never hands its memory back to another account.
+*/
+template<typename T>
+class CacheAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    CacheAllocator() : account(NULL), tier(NUM_MEMORY_TIERS), resource(MemoryResource::getDefault()) {}
+    CacheAllocator(MemoryAccount *account, MemoryTier tier) : account(account), tier(tier), resource(NULL) {}
+    template<typename U> CacheAllocator(const CacheAllocator<U> &other)
+        : account(other.account), tier(other.tier), resource(other.resource) {}
+
+    T *allocate(size_t count)
+    {
+        if(this->account == NULL)
+        {
+            return (T *) this->resource->allocate(count * sizeof(T), alignof(T));
+        }
+        return (T *) this->account->allocate(this->tier, count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T *pointer, size_t count)
+    {
+        if(this->account == NULL)
+        {
+            this->resource->deallocate(pointer, count * sizeof(T), alignof(T));
+            return;
+        }
+        this->account->deallocate(this->tier, pointer, count * sizeof(T), alignof(T));
+    }
+
+    MemoryAccount *account;
+    MemoryTier tier;
+    /*! \brief The resource of an allocator without an account, so that a later setDefault() does not separate
+    its blocks from the resource they came from.  NULL when there is an account. */
+    MemoryResource *resource;
+};
+
+template<typename T, typename U>
+bool operator==(const CacheAllocator<T> &a, const CacheAllocator<U> &b)
+{
+    return a.account == b.account && a.tier == b.tier && a.resource == b.resource;
+}
+
+template<typename T, typename U>
+bool operator!=(const CacheAllocator<T> &a, const CacheAllocator<U> &b)
+{
+    return !(a == b);
+}
+
+/*!
+\brief A vector whose memory is accounted.  See CacheAllocator.
+*/
+template<typename T>
+using CacheVector = vector<T, CacheAllocator<T> >;
+
+#endif // MEMORYACCOUNT_H
@@ -0,0 +1,116 @@
+#ifndef PEAKCODES_H
+#define PEAKCODES_H
+
+#include <math.h>
+#include <stdint.h>
+
+/*!
+    \file PeakCodes.h
+    \brief PeakCodes header/implementation file.  Contains the 16-bit encodings of stored summaries: sample extremes
+    and sums of squares.
+*/
+
+/*!
+\brief Codes per unit of scale used to store sample extremes in 16 bits.
+
+Extremes are stored relative to a power-of-two scale, 2^exponent (see peakExponent()), so one code is
+2^exponent/PEAK_CODE_SCALE.  At exponent 0, the full scale, one code is one step of 16-bit audio.  A summary that keeps
+an exponent per block and channel, as SeekIndex does, thus stores the extremes of 8- and 16-bit files exactly, those
+of quieter blocks at a proportionally finer step, and those of floating-point files above full scale without
+clipping.  Summaries that are only drawn or compared against a threshold (LiveAudioSource, EventIndex) use exponent 0
+throughout, and samples above its largest code, 32767/32768, are recorded as that code.
+*/
+#define PEAK_CODE_SCALE 32768.0
+
+/*! \brief Smallest exponent peakExponent() returns, that of silent blocks. */
+#define PEAK_EXPONENT_MIN -120
+/*! \brief Largest exponent peakExponent() returns. */
+#define PEAK_EXPONENT_MAX 120
+
+/*!
+\brief The smallest power-of-two scale at which a minimum and a maximum both have codes, as its exponent.
+*/
+inline int peakExponent(double minValue, double maxValue)
+{
+    double magnitude = fabs(minValue) > fabs(maxValue) ? fabs(minValue) : fabs(maxValue);
+    if(!(magnitude > 0.0))
+    {
+        return PEAK_EXPONENT_MIN;
+    }
+    if(isinf(magnitude))
+    {
+        return PEAK_EXPONENT_MAX;
+    }
+
+    /* magnitude < 2^exponent, so the minimum has a code; the maximum may need the next exponent. */
+    int exponent;
+    frexp(magnitude, &exponent);
+    if(maxValue > ldexp(INT16_MAX, exponent - 15))
+    {
+        exponent++;
+    }
+    return exponent < PEAK_EXPONENT_MIN ? PEAK_EXPONENT_MIN : (exponent > PEAK_EXPONENT_MAX ? PEAK_EXPONENT_MAX : exponent);
+}
+
+/*!
+\brief Encodes a minimum, rounding down, so that the decoded value is never above the true one.  NaN is encoded as
+the lowest code.
+*/
+inline int16_t encodePeakMin(double value, int exponent = 0)
+{
+    double code = floor(ldexp(value, 15 - exponent));
+    return (int16_t) (code > INT16_MAX ? INT16_MAX : (code >= INT16_MIN ? code : INT16_MIN));
+}
+
+/*!
+\brief Encodes a maximum, rounding up, so that the decoded value is never below the true one.  NaN is encoded as
+the highest code.
+*/
+inline int16_t encodePeakMax(double value, int exponent = 0)
+{
+    double code = ceil(ldexp(value, 15 - exponent));
+    return (int16_t) (code < INT16_MIN ? INT16_MIN : (code <= INT16_MAX ? code : INT16_MAX));
+}
+
+/*!
+\brief The sample value of a code.
+*/
+inline double decodePeak(int16_t code, int exponent = 0)
+{
+    return ldexp((double) code, exponent - 15);
+}
+
+/*!
+\brief Codes per octave used to store sums of squares in 16 bits, logarithmically.
+
+A code is rounded to the nearest of 512 steps per octave, so a decoded sum is within 0.07% of the true one, and an
+RMS computed from it within 0.04% (0.003 dB).  Code 0 stands for 0; codes 1 to 65535 cover about 2^-100 to
+2^28.
+*/
+#define SUM_CODE_STEPS_PER_OCTAVE 512
+
+/*! \brief Base-2 logarithm of the bottom of the scale of sum codes, one step below code 1. */
+#define SUM_CODE_LOG2_MIN -100
+
+/*!
+\brief Encodes a sum of squares.
+*/
+inline uint16_t encodeSum(double value)
+{
+    if(!(value > 0.0))
+    {
+        return 0;
+    }
+    double code = floor((log2(value) - SUM_CODE_LOG2_MIN) * SUM_CODE_STEPS_PER_OCTAVE + 0.5);
+    return (uint16_t) (code < 1.0 ? 0.0 : (code > UINT16_MAX ? UINT16_MAX : code));
+}
+
+/*!
+\brief The sum of squares of a code.
+*/
+inline double decodeSum(uint16_t code)
+{
+    return code == 0 ? 0.0 : exp2(SUM_CODE_LOG2_MIN + code / (double) SUM_CODE_STEPS_PER_OCTAVE);
+}
+
+#endif // PEAKCODES_H
@@ -0,0 +1,333 @@
+#include "PerfStats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+/*!
+\file PerfStats.cpp
+\brief PerfStats implementation file.
+*/
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char *name;
+        long long startNs;
+        long long durationNs;
+        int threadIndex;
+    };
+
+    /* All state lives behind a single lock; profiling builds are not expected to be free. */
+    struct PerfState
+    {
+        std::mutex lock;
+        map<string, long long> counters;
+        map<string, PerfHistogram> histograms;
+        vector<TraceEvent> traceEvents;
+        map<std::thread::id, int> threadIndices;
+        bool traceEnabled;
+        long long epochNs;
+
+        PerfState() : traceEnabled(false), epochNs(PerfStats::nowNs()) {}
+    };
+
+    PerfState &state()
+    {
+        static PerfState perfState;
+        return perfState;
+    }
+
+    int bucketFor(long long durationNs)
+    {
+        long long micros = durationNs / 1000;
+        int bucket = 0;
+        while(micros > 0 && bucket < PERF_HISTOGRAM_BUCKETS - 1)
+        {
+            micros >>= 1;
+            bucket++;
+        }
+        return bucket;
+    }
+
+    /* Escapes the characters that may not appear verbatim inside a JSON string. */
+    string jsonEscape(const char *text)
+    {
+        string escaped;
+        for(const char *c = text; *c != '\0'; c++)
+        {
+            if(*c == '"' || *c == '\\')
+            {
+                escaped.push_back('\\');
+            }
+            escaped.push_back(*c);
+        }
+        return escaped;
+    }
+}
+
+/*!
+\brief Adds delta to the named counter, creating it if necessary.
+@param name Counter name.  Must point to storage that outlives the call (a string literal, typically).
+@param delta Amount to add.
+*/
+void PerfStats::addCount(const char *name, long long delta)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.counters[name] += delta;
+}
+
+/*!
+\brief Records one timed execution of the named code path.
+
+The duration is added to the histogram of the same name and, if trace recording is enabled, appended to the
+trace-event log.
+@param name Scope name.  Must point to storage that lives until the trace is written (a string literal, typically).
+@param startNs Start time as returned by nowNs().
+@param durationNs Duration in nanoseconds.
+*/
+void PerfStats::recordDuration(const char *name, long long startNs, long long durationNs)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    map<string, PerfHistogram>::iterator it = s.histograms.find(name);
+    if(it == s.histograms.end())
+    {
+        PerfHistogram empty;
+        memset(&empty, 0, sizeof(empty));
+        empty.minNs = durationNs;
+        it = s.histograms.insert(make_pair(string(name), empty)).first;
+    }
+
+    PerfHistogram &h = it->second;
+    h.count++;
+    h.totalNs += durationNs;
+    if(durationNs < h.minNs)
+        h.minNs = durationNs;
+    if(durationNs > h.maxNs)
+        h.maxNs = durationNs;
+    h.buckets[bucketFor(durationNs)]++;
+
+    if(s.traceEnabled && s.traceEvents.size() < PERF_MAX_TRACE_EVENTS)
+    {
+        std::thread::id tid = std::this_thread::get_id();
+        map<std::thread::id, int>::iterator t = s.threadIndices.find(tid);
+        if(t == s.threadIndices.end())
+        {
+            t = s.threadIndices.insert(make_pair(tid, (int) s.threadIndices.size())).first;
+        }
+
+        TraceEvent event;
+        event.name = name;
+        event.startNs = startNs;
+        event.durationNs = durationNs;
+        event.threadIndex = t->second;
+        s.traceEvents.push_back(event);
+    }
+}
+
+/*!
+\brief Current value of the named counter.
+@return the counter's value, or 0 if it has never been incremented.
+*/
+long long PerfStats::counter(string name)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    map<string, long long>::iterator it = s.counters.find(name);
+    return it == s.counters.end() ? 0 : it->second;
+}
+
+/*!
+\brief Timing histogram of the named scope.
+@return a copy of the histogram.  Its count is 0 if the scope has never been recorded.
+*/
+PerfHistogram PerfStats::histogram(string name)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    map<string, PerfHistogram>::iterator it = s.histograms.find(name);
+    if(it == s.histograms.end())
+    {
+        PerfHistogram empty;
+        memset(&empty, 0, sizeof(empty));
+        return empty;
+    }
+    return it->second;
+}
+
+/*!
+\brief Names of all counters incremented so far, in alphabetical order.
+*/
+vector<string> PerfStats::counterNames()
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    vector<string> names;
+    for(map<string, long long>::iterator it = s.counters.begin(); it != s.counters.end(); ++it)
+    {
+        names.push_back(it->first);
+    }
+    return names;
+}
+
+/*!
+\brief Names of all scopes recorded so far, in alphabetical order.
+*/
+vector<string> PerfStats::histogramNames()
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    vector<string> names;
+    for(map<string, PerfHistogram>::iterator it = s.histograms.begin(); it != s.histograms.end(); ++it)
+    {
+        names.push_back(it->first);
+    }
+    return names;
+}
+
+/*!
+\brief Human-readable summary of all counters and histograms, one line per entry.
+*/
+string PerfStats::report()
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    ostringstream out;
+
+    for(map<string, long long>::iterator it = s.counters.begin(); it != s.counters.end(); ++it)
+    {
+        out << it->first << ": " << it->second << "\n";
+    }
+
+    for(map<string, PerfHistogram>::iterator it = s.histograms.begin(); it != s.histograms.end(); ++it)
+    {
+        const PerfHistogram &h = it->second;
+        double meanUs = h.count > 0 ? (double) h.totalNs / h.count / 1000.0 : 0.0;
+        out << it->first << ": calls=" << h.count
+            << " total=" << h.totalNs / 1000 << "us"
+            << " mean=" << meanUs << "us"
+            << " min=" << h.minNs / 1000 << "us"
+            << " max=" << h.maxNs / 1000 << "us\n";
+    }
+
+    return out.str();
+}
+
+/*!
+\brief Switches recording of individual trace events on or off.  Histograms and counters are always kept.
+*/
+void PerfStats::setTraceEnabled(bool enabled)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.traceEnabled = enabled;
+}
+
+/*!
+\brief Whether trace events are currently being recorded.
+*/
+bool PerfStats::isTraceEnabled()
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.traceEnabled;
+}
+
+/*!
+\brief Writes the recorded trace events to a file in Chrome trace-event JSON format.
+
+Counters are appended as a single counter event at the end of the trace.
+@param filePath Destination path.
+@return true on success, false if the file could not be written.
+*/
+bool PerfStats::writeChromeTrace(string filePath)
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+
+    FILE *out = fopen(filePath.c_str(), "w");
+    if(out == NULL)
+    {
+        fprintf(stderr, "failed to open trace file \"%s\".\n", filePath.c_str());
+        return false;
+    }
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+    for(size_t i = 0; i < s.traceEvents.size(); i++)
+    {
+        const TraceEvent &e = s.traceEvents[i];
+        fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", jsonEscape(e.name).c_str(), e.threadIndex,
+                (e.startNs - s.epochNs) / 1000.0, e.durationNs / 1000.0);
+        first = false;
+    }
+
+    if(!s.counters.empty())
+    {
+        fprintf(out, "%s{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":0,\"args\":{", first ? "" : ",\n");
+        for(map<string, long long>::iterator it = s.counters.begin(); it != s.counters.end(); ++it)
+        {
+            fprintf(out, "%s\"%s\":%lld", it == s.counters.begin() ? "" : ",", jsonEscape(it->first.c_str()).c_str(), it->second);
+        }
+        fprintf(out, "}}");
+    }
+
+    fprintf(out, "\n]}\n");
+    bool ok = (ferror(out) == 0);
+    fclose(out);
+    return ok;
+}
+
+/*!
+\brief Clears all counters, histograms and trace events.
+*/
+void PerfStats::reset()
+{
+    PerfState &s = state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.counters.clear();
+    s.histograms.clear();
+    s.traceEvents.clear();
+    s.epochNs = PerfStats::nowNs();
+}
+
+/*!
+\brief Monotonic timestamp in nanoseconds.
+*/
+long long PerfStats::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+\brief Whether the PERF_SCOPE()/PERF_COUNT() annotations were compiled into this build of the library.
+*/
+bool PerfStats::isCompiledIn()
+{
+#ifdef WAVEFORM_PROFILING
+    return true;
+#else
+    return false;
+#endif
+}
+
+PerfScope::PerfScope(const char *name)
+{
+    this->name = name;
+    this->startNs = PerfStats::nowNs();
+}
+
+PerfScope::~PerfScope()
+{
+    PerfStats::recordDuration(this->name, this->startNs, PerfStats::nowNs() - this->startNs);
+}
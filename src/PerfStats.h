@@ -0,0 +1,94 @@
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <string>
+#include <vector>
+
+/*!
+    \file PerfStats.h
+    \brief PerfStats header file.  Contains the optional timing instrumentation used by AudioUtil and WaveformWidget.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of power-of-two duration buckets kept for each histogram.  Bucket 0 counts durations of less
+than 1 microsecond and bucket i > 0 those of at least 2^(i-1) and less than 2^i microseconds (the last bucket
+also collects everything longer).
+*/
+#define PERF_HISTOGRAM_BUCKETS 32
+
+/*!
+\brief Upper bound on the number of trace events kept in memory for export.  Events recorded once the
+buffer is full are still counted in the histograms, but are dropped from the trace.
+*/
+#define PERF_MAX_TRACE_EVENTS 1000000
+
+/*!
+\brief Accumulated timings for one instrumented code path.
+*/
+struct PerfHistogram
+{
+    long long count;
+    long long totalNs;
+    long long minNs;
+    long long maxNs;
+    long long buckets[PERF_HISTOGRAM_BUCKETS];
+};
+
+/*!
+\brief Process-wide counters, duration histograms and an optional Chrome trace-event log.
+
+The hot paths of AudioUtil and WaveformWidget are annotated with the PERF_SCOPE() and PERF_COUNT() macros.
+These expand to nothing unless the library is compiled with WAVEFORM_PROFILING defined (see LibWaveformWidget.pro),
+so an ordinary build pays nothing for them.  In a profiling build, every annotated scope adds its duration to a
+histogram of the same name and every counter is incremented, and both can be read back through this class.  When
+trace recording is switched on with setTraceEnabled(), each scope is additionally logged as a complete event which
+writeChromeTrace() exports in the JSON format understood by chrome://tracing and Perfetto.
+
+All functions are safe to call from any thread.
+*/
+class PerfStats
+{
+public:
+    static void addCount(const char *name, long long delta);
+    static void recordDuration(const char *name, long long startNs, long long durationNs);
+    static long long counter(string name);
+    static PerfHistogram histogram(string name);
+    static vector<string> counterNames();
+    static vector<string> histogramNames();
+    static string report();
+    static void setTraceEnabled(bool enabled);
+    static bool isTraceEnabled();
+    static bool writeChromeTrace(string filePath);
+    static void reset();
+    static long long nowNs();
+    static bool isCompiledIn();
+};
+
+/*!
+\brief Times the enclosing scope and hands the result to PerfStats::recordDuration().  Use through PERF_SCOPE().
+*/
+class PerfScope
+{
+public:
+    PerfScope(const char *name);
+    ~PerfScope();
+
+private:
+    const char *name;
+    long long startNs;
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+
+#ifdef WAVEFORM_PROFILING
+#define PERF_SCOPE(name) PerfScope PERF_CONCAT(perfScope_, __LINE__)(name)
+#define PERF_COUNT(name) PerfStats::addCount((name), 1)
+#else
+#define PERF_SCOPE(name)
+#define PERF_COUNT(name)
+#endif
+
+#endif // PERFSTATS_H
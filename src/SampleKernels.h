@@ -0,0 +1,148 @@
+#ifndef SAMPLEKERNELS_H
+#define SAMPLEKERNELS_H
+
+#include <sndfile.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+/*!
+    \file SampleKernels.h
+    \brief SampleKernels header/implementation file.  Contains the inner loops over interleaved frames.
+*/
+
+/*!
+\brief The inner loops over interleaved frames, compiled once per channel count and sample type.
+
+The stride between the frames and the number of per-channel accumulators are compile-time constants, so the
+compiler unrolls the channel loop and keeps every accumulator in a register, instead of the loop re-reading the
+channel count for every sample.  Nothing here branches on the data layout: the instantiation is picked once per
+file, by kernelsForChannels().
+*/
+template<int CHANNELS, typename Sample>
+class SampleKernels
+{
+public:
+    /*!\brief Folds count frames into peak: the signed sample of greatest magnitude of each channel.*/
+    static void foldPeaks(const Sample *frames, sf_count_t count, double *peak)
+    {
+        double extreme[CHANNELS];
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            extreme[c] = peak[c];
+        }
+
+        for(const Sample *frame = frames; frame < frames + count*CHANNELS; frame += CHANNELS)
+        {
+            for(int c = 0; c < CHANNELS; c++)
+            {
+                double value = frame[c];
+                if(fabs(value) > fabs(extreme[c]))
+                {
+                    extreme[c] = value;
+                }
+            }
+        }
+
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            peak[c] = extreme[c];
+        }
+    }
+
+    /*!\brief Folds count frames into a running minimum, maximum and sum of squares of each channel.*/
+    static void foldStats(const Sample *frames, sf_count_t count, double *minValue, double *maxValue, double *sumSquares)
+    {
+        double lowest[CHANNELS];
+        double highest[CHANNELS];
+        double squares[CHANNELS];
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            lowest[c] = minValue[c];
+            highest[c] = maxValue[c];
+            squares[c] = 0.0;
+        }
+
+        for(const Sample *frame = frames; frame < frames + count*CHANNELS; frame += CHANNELS)
+        {
+            for(int c = 0; c < CHANNELS; c++)
+            {
+                double value = frame[c];
+                lowest[c] = (value < lowest[c]) ? value : lowest[c];
+                highest[c] = (value > highest[c]) ? value : highest[c];
+                squares[c] += value*value;
+            }
+        }
+
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            minValue[c] = lowest[c];
+            maxValue[c] = highest[c];
+            sumSquares[c] += squares[c];
+        }
+    }
+
+    /*!\brief Copies one frame into CHANNELS doubles.*/
+    static void copyFrame(const Sample *frame, double *values)
+    {
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            values[c] = frame[c];
+        }
+    }
+};
+
+/*!
+\brief The largest channel count kernelsForChannels() has an instantiation for.  Files with more channels are
+refused.  Adding a layout means adding its case below and raising this bound; the per-channel arrays of
+AudioUtil are sized from it.
+*/
+#define SAMPLE_KERNEL_MAX_CHANNELS 2
+
+/*!
+\brief The kernels of one instantiation of SampleKernels, as function pointers.
+
+A table is chosen once, when a file is opened, and every scan calls through it once per contiguous run of frames
+(a block or a cache chunk), so the cost of the indirection is not paid per sample.
+*/
+struct SampleKernelTable
+{
+    /*! \brief The channel count the kernels were compiled for, or 0 for the empty table. */
+    int numChannels;
+    void (*foldPeaks)(const double *frames, sf_count_t count, double *peak);
+    void (*foldStats)(const double *frames, sf_count_t count, double *minValue, double *maxValue, double *sumSquares);
+    void (*copyFrame)(const double *frame, double *values);
+};
+
+/*!
+\brief Returns the kernels for interleaved double-precision frames of numChannels channels, or a table whose
+numChannels is 0 if there is no instantiation for that count.
+*/
+inline SampleKernelTable kernelsForChannels(int numChannels)
+{
+    SampleKernelTable table;
+    switch(numChannels)
+    {
+    case 1:
+        table.numChannels = 1;
+        table.foldPeaks = &SampleKernels<1, double>::foldPeaks;
+        table.foldStats = &SampleKernels<1, double>::foldStats;
+        table.copyFrame = &SampleKernels<1, double>::copyFrame;
+        break;
+    case 2:
+        table.numChannels = 2;
+        table.foldPeaks = &SampleKernels<2, double>::foldPeaks;
+        table.foldStats = &SampleKernels<2, double>::foldStats;
+        table.copyFrame = &SampleKernels<2, double>::copyFrame;
+        break;
+    default:
+        table.numChannels = 0;
+        table.foldPeaks = NULL;
+        table.foldStats = NULL;
+        table.copyFrame = NULL;
+        break;
+    }
+    return table;
+}
+
+#endif // SAMPLEKERNELS_H
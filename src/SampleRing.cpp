@@ -0,0 +1,130 @@
+#include "SampleRing.h"
+
+/*!
+\file SampleRing.cpp
+\brief SampleRing implementation file.
+*/
+
+/*!
+\brief Constructs an empty ring.
+@param numChannels Number of interleaved channels per frame.
+@param capacityFrames Number of frames the ring holds before push() starts dropping frames.
+*/
+SampleRing::SampleRing(int numChannels, sf_count_t capacityFrames)
+{
+    this->numChannels = max(1, numChannels);
+    this->capacity = max((sf_count_t) 1, capacityFrames);
+    this->samples.assign(this->capacity * this->numChannels, 0.0f);
+    this->writeCount = 0;
+    this->readCount = 0;
+    this->droppedFrames = 0;
+}
+
+/*!
+\brief Number of interleaved channels per frame.
+*/
+int SampleRing::getNumChannels()
+{
+    return this->numChannels;
+}
+
+/*!
+\brief Number of frames the ring can hold.
+*/
+sf_count_t SampleRing::getCapacity()
+{
+    return this->capacity;
+}
+
+/*!
+\brief Appends frames.  Producer thread only; wait-free.
+@param frames Interleaved samples.
+@param count Number of frames.
+@return the number of frames stored; the remaining count minus that number were dropped.
+*/
+sf_count_t SampleRing::push(const float *frames, sf_count_t count)
+{
+    sf_count_t n = this->writableFrames(count);
+    sf_count_t written = this->writeCount.load(std::memory_order_relaxed);
+    for(sf_count_t i = 0; i < n; i++)
+    {
+        float *slot = &this->samples[((written + i) % this->capacity) * this->numChannels];
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            slot[c] = frames[i * this->numChannels + c];
+        }
+    }
+    this->writeCount.store(written + n, std::memory_order_release);
+    return n;
+}
+
+/*!
+\brief Appends frames given as doubles.  Producer thread only; wait-free.
+*/
+sf_count_t SampleRing::push(const double *frames, sf_count_t count)
+{
+    sf_count_t n = this->writableFrames(count);
+    sf_count_t written = this->writeCount.load(std::memory_order_relaxed);
+    for(sf_count_t i = 0; i < n; i++)
+    {
+        float *slot = &this->samples[((written + i) % this->capacity) * this->numChannels];
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            slot[c] = (float) frames[i * this->numChannels + c];
+        }
+    }
+    this->writeCount.store(written + n, std::memory_order_release);
+    return n;
+}
+
+/*!
+\brief Takes the oldest frames out of the ring.  Consumer thread only.
+@param frames Receives up to maxCount interleaved frames.
+@param maxCount Number of frames that fit in frames.
+@return the number of frames taken.
+*/
+sf_count_t SampleRing::pop(double *frames, sf_count_t maxCount)
+{
+    sf_count_t read = this->readCount.load(std::memory_order_relaxed);
+    sf_count_t n = min(maxCount, this->writeCount.load(std::memory_order_acquire) - read);
+    for(sf_count_t i = 0; i < n; i++)
+    {
+        const float *slot = &this->samples[((read + i) % this->capacity) * this->numChannels];
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            frames[i * this->numChannels + c] = slot[c];
+        }
+    }
+    this->readCount.store(read + n, std::memory_order_release);
+    return n;
+}
+
+/*!
+\brief Number of frames waiting to be popped.  Exact on the consumer thread, a lower bound elsewhere.
+*/
+sf_count_t SampleRing::getAvailableFrames()
+{
+    return this->writeCount.load(std::memory_order_acquire) - this->readCount.load(std::memory_order_acquire);
+}
+
+/*!
+\brief Number of frames push() has dropped because the ring was full.
+*/
+long long SampleRing::getDroppedFrames()
+{
+    return this->droppedFrames.load(std::memory_order_relaxed);
+}
+
+/*
+ * How many of count frames fit; the rest are counted as dropped.
+ */
+sf_count_t SampleRing::writableFrames(sf_count_t count)
+{
+    sf_count_t used = this->writeCount.load(std::memory_order_relaxed) - this->readCount.load(std::memory_order_acquire);
+    sf_count_t n = min(count, this->capacity - used);
+    if(n < count)
+    {
+        this->droppedFrames.fetch_add(count - n, std::memory_order_relaxed);
+    }
+    return max((sf_count_t) 0, n);
+}
@@ -0,0 +1,47 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <sndfile.h>
+
+#include <atomic>
+#include <vector>
+
+/*!
+    \file SampleRing.h
+    \brief SampleRing header file.
+*/
+
+using namespace std;
+
+/*!
+\brief A fixed-size queue of interleaved frames between exactly one producer thread and one consumer thread.
+
+The producer is meant to be a real-time audio callback: push() never allocates, locks or waits.  It copies what
+fits and returns at once, and frames that do not fit because the consumer has fallen behind are dropped and counted
+(getDroppedFrames()) rather than overwriting frames the consumer may be reading.  Samples are stored as floats, the
+native format of most audio callbacks.  All memory is allocated by the constructor.
+*/
+class SampleRing
+{
+public:
+    SampleRing(int numChannels, sf_count_t capacityFrames);
+    int getNumChannels();
+    sf_count_t getCapacity();
+    sf_count_t push(const float *frames, sf_count_t count);
+    sf_count_t push(const double *frames, sf_count_t count);
+    sf_count_t pop(double *frames, sf_count_t maxCount);
+    sf_count_t getAvailableFrames();
+    long long getDroppedFrames();
+
+private:
+    int numChannels;
+    sf_count_t capacity;
+    vector<float> samples;
+    std::atomic<sf_count_t> writeCount;
+    std::atomic<sf_count_t> readCount;
+    std::atomic<long long> droppedFrames;
+
+    sf_count_t writableFrames(sf_count_t count);
+};
+
+#endif // SAMPLERING_H
@@ -0,0 +1,700 @@
+#include "SeekIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+/*!
+\file SeekIndex.cpp
+\brief SeekIndex implementation file.
+*/
+
+#define SEEK_INDEX_MAGIC "WFIDX007"
+
+/*!
+\brief Whether two keys identify the same file.
+*/
+bool sameFile(const SeekIndexKey &a, const SeekIndexKey &b)
+{
+    return a.fileSize == b.fileSize && a.inode == b.inode && a.modificationTime == b.modificationTime
+            && a.modificationNanoseconds == b.modificationNanoseconds && a.frames == b.frames
+            && a.channels == b.channels && a.sampleRate == b.sampleRate && a.format == b.format;
+}
+
+/*!
+\brief Writes a key field by field, so that sidecar files do not depend on the layout of the struct.
+@return true on success.
+*/
+bool writeSeekIndexKey(FILE *out, const SeekIndexKey &key)
+{
+    long long identity[5] = {key.fileSize, key.inode, key.modificationTime, key.modificationNanoseconds, key.frames};
+    int layout[3] = {key.channels, key.sampleRate, key.format};
+    return fwrite(identity, sizeof(identity), 1, out) == 1 && fwrite(layout, sizeof(layout), 1, out) == 1;
+}
+
+/*!
+\brief Reads a key written by writeSeekIndexKey().
+@return true on success.
+*/
+bool readSeekIndexKey(FILE *in, SeekIndexKey *key)
+{
+    long long identity[5];
+    int layout[3];
+    if(fread(identity, sizeof(identity), 1, in) != 1 || fread(layout, sizeof(layout), 1, in) != 1)
+    {
+        return false;
+    }
+    key->fileSize = identity[0];
+    key->inode = identity[1];
+    key->modificationTime = identity[2];
+    key->modificationNanoseconds = identity[3];
+    key->frames = identity[4];
+    key->channels = layout[0];
+    key->sampleRate = layout[1];
+    key->format = layout[2];
+    return true;
+}
+
+/*!
+\brief Opens a new temporary file next to a sidecar, to be renamed over it by commitSidecar() once it is complete.
+Readers of the sidecar, and other writers of it, such as another viewer of the same file, thus never see it half
+written.
+@param path Path of the sidecar.
+@param tempPath Receives the path of the temporary file.
+@return The open file, or NULL if it could not be created.
+*/
+FILE *createSidecar(string path, string *tempPath)
+{
+    vector<char> name(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    name.insert(name.end(), suffix, suffix + sizeof(suffix));
+    int fd = mkstemp(&name[0]);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    *tempPath = &name[0];
+    fchmod(fd, 0644);
+    FILE *out = fdopen(fd, "wb");
+    if(out == NULL)
+    {
+        close(fd);
+        remove(tempPath->c_str());
+    }
+    return out;
+}
+
+/*!
+\brief Closes a file opened by createSidecar() and, if it was written completely, moves it into place.
+@param written Whether every write succeeded.  If not, the temporary file is removed and the sidecar left as it was.
+@return true if the sidecar was replaced.
+*/
+bool commitSidecar(FILE *out, string tempPath, string path, bool written)
+{
+    bool ok = (fclose(out) == 0) && written && rename(tempPath.c_str(), path.c_str()) == 0;
+    if(!ok)
+    {
+        remove(tempPath.c_str());
+    }
+    return ok;
+}
+
+/*!
+\brief Constructs an empty index.
+*/
+SeekIndex::SeekIndex()
+{
+    this->reset(0, 0, 0);
+}
+
+/*!
+\brief Discards all entries and counts the memory of the index from now on in an account.
+@param account The account, or NULL not to count the index.
+@param tier The tier of the account the index is counted in.
+*/
+void SeekIndex::setMemoryAccount(MemoryAccount *account, MemoryTier tier)
+{
+    CacheAllocator<int8_t> exponentAllocator(account, tier);
+    CacheAllocator<int16_t> peakAllocator(account, tier);
+    CacheAllocator<uint16_t> sumAllocator(account, tier);
+    CacheAllocator<double> totalAllocator(account, tier);
+    this->blockExponents = CacheVector<int8_t>(exponentAllocator);
+    this->blockMin = CacheVector<int16_t>(peakAllocator);
+    this->blockMax = CacheVector<int16_t>(peakAllocator);
+    this->blockSquares = CacheVector<uint16_t>(sumAllocator);
+    this->blockWeightedSquares = CacheVector<uint16_t>(sumAllocator);
+    this->strideSquares = CacheVector<double>(totalAllocator);
+    this->strideWeightedSquares = CacheVector<double>(totalAllocator);
+    this->treeExponents = CacheVector<int8_t>(exponentAllocator);
+    this->treeMin = CacheVector<int16_t>(peakAllocator);
+    this->treeMax = CacheVector<int16_t>(peakAllocator);
+    this->reset(0, 0, 0);
+}
+
+/*!
+\brief Discards all entries and prepares the index for a file with the given layout.
+@param numChannels Number of channels of the file to be indexed.
+@param totalFrames Length of the file to be indexed, in frames.
+@param sampleRate Sample rate of the file to be indexed, which the K-weighting filter is designed for.
+*/
+void SeekIndex::reset(int numChannels, sf_count_t totalFrames, int sampleRate)
+{
+    this->numChannels = numChannels;
+    this->totalFrames = totalFrames;
+    this->framesAdded = 0;
+    this->framesInBlock = 0;
+    this->exactExtremes = true;
+    this->blockExponents.clear();
+    this->blockMin.clear();
+    this->blockMax.clear();
+    this->blockSquares.clear();
+    this->blockWeightedSquares.clear();
+    this->openMin.assign(numChannels > 0 ? numChannels : 0, 0.0);
+    this->openMax.assign(numChannels > 0 ? numChannels : 0, 0.0);
+    this->openSquares.assign(numChannels > 0 ? numChannels : 0, 0.0);
+    this->openWeightedSquares.assign(numChannels > 0 ? numChannels : 0, 0.0);
+    if(numChannels > 0 && totalFrames > 0)
+    {
+        /*
+          Reserved up front so that the blocks already added never move: AudioUtil::loadedPeaks() reads
+          them from another thread while the rest of the file is being added.
+        */
+        size_t numBlocks = (size_t) ((totalFrames + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES);
+        this->blockExponents.reserve(numBlocks * numChannels);
+        this->blockMin.reserve(numBlocks * numChannels);
+        this->blockMax.reserve(numBlocks * numChannels);
+        this->blockSquares.reserve(numBlocks * numChannels);
+        this->blockWeightedSquares.reserve(numBlocks * numChannels);
+    }
+    this->weightingFilter.reset(numChannels, sampleRate);
+    this->strideSquares.clear();
+    this->strideWeightedSquares.clear();
+    this->treeExponents.clear();
+    this->treeMin.clear();
+    this->treeMax.clear();
+}
+
+/*!
+\brief Feeds the next frames of the file, in order, into the index.
+@param frames Interleaved, normalized samples.
+@param count Number of frames in frames.
+*/
+void SeekIndex::addFrames(const double *frames, sf_count_t count)
+{
+    if(count <= 0)
+    {
+        return;
+    }
+    this->weighted.resize(count*this->numChannels);
+    this->weightingFilter.process(frames, count, &this->weighted[0]);
+
+    for(sf_count_t f = 0; f < count; f++)
+    {
+        const double *frame = &frames[f*this->numChannels];
+        const double *weightedFrame = &this->weighted[f*this->numChannels];
+        if(this->framesInBlock == 0)
+        {
+            /* blockMin goes last: its size is the number of blocks other threads may read. */
+            for(int c = 0; c < this->numChannels; c++)
+            {
+                this->blockExponents.push_back(PEAK_EXPONENT_MIN);
+                this->blockMax.push_back(0);
+                this->blockSquares.push_back(0);
+                this->blockWeightedSquares.push_back(0);
+                this->blockMin.push_back(0);
+                this->openMin[c] = frame[c];
+                this->openMax[c] = frame[c];
+                this->openSquares[c] = 0.0;
+                this->openWeightedSquares[c] = 0.0;
+            }
+        }
+
+        for(int c = 0; c < this->numChannels; c++)
+        {
+            double value = frame[c];
+            if(value < this->openMin[c])
+                this->openMin[c] = value;
+            if(value > this->openMax[c])
+                this->openMax[c] = value;
+            this->openSquares[c] += value*value;
+            this->openWeightedSquares[c] += weightedFrame[c]*weightedFrame[c];
+        }
+
+        this->framesInBlock++;
+        if(this->framesInBlock == SEEK_INDEX_BLOCK_FRAMES)
+        {
+            this->storeOpenBlock();
+            this->framesInBlock = 0;
+        }
+    }
+    this->framesAdded += count;
+
+    /* The block still being filled is readable too, with the frames added so far. */
+    if(this->framesInBlock > 0)
+    {
+        this->storeOpenBlock();
+    }
+
+    if(this->isComplete() && this->treeMin.empty())
+    {
+        this->buildTree();
+    }
+}
+
+/*!
+\brief Whether every frame of the file has been fed into the index.
+*/
+bool SeekIndex::isComplete()
+{
+    return this->numChannels > 0 && this->framesAdded >= this->totalFrames;
+}
+
+/*!
+\brief Number of channels of the indexed file.
+*/
+int SeekIndex::getNumChannels()
+{
+    return this->numChannels;
+}
+
+/*!
+\brief Length of the indexed file, in frames.
+*/
+sf_count_t SeekIndex::getTotalFrames()
+{
+    return this->totalFrames;
+}
+
+/*!
+\brief Number of blocks indexed so far.
+*/
+sf_count_t SeekIndex::getNumBlocks()
+{
+    return this->numChannels > 0 ? (sf_count_t) (this->blockMin.size() / this->numChannels) : 0;
+}
+
+/*!
+\brief Whether every stored block minimum and maximum is the exact sample, as for 8- and 16-bit files.  If not,
+blockRange() and rangeMinMax() give bounds, and blocksBeyond() names the blocks to read for the exact values.
+*/
+bool SeekIndex::hasExactExtremes()
+{
+    return this->exactExtremes;
+}
+
+/*!
+\brief Bounds on the smallest and largest sample of one channel within one block, exact if hasExactExtremes().
+@param block Block number; block b covers frames [b*SEEK_INDEX_BLOCK_FRAMES, (b+1)*SEEK_INDEX_BLOCK_FRAMES).
+@param channel Channel number.
+@param minValue Receives the smallest sample, rounded down.
+@param maxValue Receives the largest sample, rounded up.
+*/
+void SeekIndex::blockRange(sf_count_t block, int channel, double *minValue, double *maxValue)
+{
+    size_t index = block*this->numChannels + channel;
+    int exponent = this->blockExponents[index];
+    *minValue = decodePeak(this->blockMin[index], exponent);
+    *maxValue = decodePeak(this->blockMax[index], exponent);
+}
+
+/*!
+\brief Bounds on the smallest and largest sample of one channel within the blocks [firstBlock, endBlock), in
+O(log n) time.  The bounds are rounded outwards by less than one code of the tree nodes they are taken from.
+
+Only available once the index is complete.
+@param firstBlock First block of the run.
+@param endBlock Block just past the run; must be greater than firstBlock.
+@param channel Channel number.
+@param minValue Receives the smallest sample, rounded down.
+@param maxValue Receives the largest sample, rounded up.
+*/
+void SeekIndex::rangeMinMax(sf_count_t firstBlock, sf_count_t endBlock, int channel, double *minValue, double *maxValue)
+{
+    /*
+      Bottom-up segment tree: node i (1 <= i < n) covers nodes 2i and 2i+1, and node n+b is block b,
+      which is stored in the block arrays rather than duplicated in the tree.
+    */
+    size_t n = (size_t) this->getNumBlocks();
+    size_t lo = (size_t) firstBlock + n;
+    size_t hi = (size_t) endBlock + n;
+    double lowest = HUGE_VAL;
+    double highest = -HUGE_VAL;
+
+    while(lo < hi)
+    {
+        size_t nodes[2];
+        int numNodes = 0;
+        if(lo & 1)
+            nodes[numNodes++] = lo++;
+        if(hi & 1)
+            nodes[numNodes++] = --hi;
+
+        for(int i = 0; i < numNodes; i++)
+        {
+            double nodeMin, nodeMax;
+            this->nodeRange(nodes[i], channel, &nodeMin, &nodeMax);
+            lowest = min(lowest, nodeMin);
+            highest = max(highest, nodeMax);
+        }
+        lo >>= 1;
+        hi >>= 1;
+    }
+
+    *minValue = lowest;
+    *maxValue = highest;
+}
+
+/*!
+\brief The block of [firstBlock, endBlock) with the lowest stored minimum of one channel: where the exact minimum
+is most likely to be.  Only available once the index is complete.
+*/
+sf_count_t SeekIndex::lowestBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel)
+{
+    return this->extremeBlock(firstBlock, endBlock, channel, false);
+}
+
+/*!
+\brief The block of [firstBlock, endBlock) with the highest stored maximum of one channel.  See lowestBlock().
+*/
+sf_count_t SeekIndex::highestBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel)
+{
+    return this->extremeBlock(firstBlock, endBlock, channel, true);
+}
+
+/*!
+\brief Lists the blocks of [firstBlock, endBlock) that may hold a sample of one channel below lowest or above highest,
+because their stored minimum is below lowest or their stored maximum above highest.
+
+Once the exact extremes of lowestBlock() and highestBlock() are known, these are the only other blocks that can
+hold the exact extremes of the run, and they are usually few: those whose stored bounds are within one code of them.
+Only available once the index is complete.
+@param blocks Receives the blocks, in increasing order.
+*/
+void SeekIndex::blocksBeyond(sf_count_t firstBlock, sf_count_t endBlock, int channel, double lowest, double highest, vector<sf_count_t> *blocks)
+{
+    size_t n = (size_t) this->getNumBlocks();
+    vector<size_t> pending;
+    this->rangeNodes(firstBlock, endBlock, &pending);
+    blocks->clear();
+    while(!pending.empty())
+    {
+        size_t node = pending.back();
+        pending.pop_back();
+        double minValue, maxValue;
+        this->nodeRange(node, channel, &minValue, &maxValue);
+        if(minValue >= lowest && maxValue <= highest)
+        {
+            continue;
+        }
+        if(node >= n)
+        {
+            blocks->push_back((sf_count_t) (node - n));
+        }
+        else
+        {
+            pending.push_back(2*node);
+            pending.push_back(2*node + 1);
+        }
+    }
+    sort(blocks->begin(), blocks->end());
+}
+
+/*!
+\brief The sum of the squares of the samples of one channel within the blocks [firstBlock, endBlock), in O(1) time.
+@param firstBlock First block of the run.
+@param endBlock Block just past the run.
+@param channel Channel number.
+*/
+double SeekIndex::rangeSumOfSquares(sf_count_t firstBlock, sf_count_t endBlock, int channel)
+{
+    return this->rangeSum(this->blockSquares, this->strideSquares, firstBlock, endBlock, channel);
+}
+
+/*!
+\brief The sum of the squares of the K-weighted samples of one channel within the blocks [firstBlock, endBlock), in
+O(1) time.
+@param firstBlock First block of the run.
+@param endBlock Block just past the run.
+@param channel Channel number.
+*/
+double SeekIndex::rangeWeightedSumOfSquares(sf_count_t firstBlock, sf_count_t endBlock, int channel)
+{
+    return this->rangeSum(this->blockWeightedSquares, this->strideWeightedSquares, firstBlock, endBlock, channel);
+}
+
+/*
+ * Decodes the bounds of a node of the segment tree, or of a block for nodes n and above.
+ */
+void SeekIndex::nodeRange(size_t node, int channel, double *minValue, double *maxValue)
+{
+    size_t n = (size_t) this->getNumBlocks();
+    if(node >= n)
+    {
+        this->blockRange((sf_count_t) (node - n), channel, minValue, maxValue);
+        return;
+    }
+    size_t index = node*this->numChannels + channel;
+    int exponent = this->treeExponents[index];
+    *minValue = decodePeak(this->treeMin[index], exponent);
+    *maxValue = decodePeak(this->treeMax[index], exponent);
+}
+
+/*
+ * Branch and bound over the tree: descends into the more promising child first, and skips any node
+ * whose bound cannot beat the best block found so far.
+ */
+sf_count_t SeekIndex::extremeBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel, bool highest)
+{
+    size_t n = (size_t) this->getNumBlocks();
+    vector<size_t> pending;
+    this->rangeNodes(firstBlock, endBlock, &pending);
+    sf_count_t best = -1;
+    double bestValue = 0.0;
+    while(!pending.empty())
+    {
+        size_t node = pending.back();
+        pending.pop_back();
+        double minValue, maxValue;
+        this->nodeRange(node, channel, &minValue, &maxValue);
+        double value = highest ? maxValue : minValue;
+        if(best >= 0 && (highest ? value <= bestValue : value >= bestValue))
+        {
+            continue;
+        }
+        if(node >= n)
+        {
+            best = (sf_count_t) (node - n);
+            bestValue = value;
+            continue;
+        }
+
+        double leftMin, leftMax, rightMin, rightMax;
+        this->nodeRange(2*node, channel, &leftMin, &leftMax);
+        this->nodeRange(2*node + 1, channel, &rightMin, &rightMax);
+        bool leftFirst = highest ? leftMax >= rightMax : leftMin <= rightMin;
+        pending.push_back(leftFirst ? 2*node + 1 : 2*node);
+        pending.push_back(leftFirst ? 2*node : 2*node + 1);
+    }
+    return best;
+}
+
+/*
+ * The nodes of the segment tree that together cover the blocks [firstBlock, endBlock) exactly.
+ */
+void SeekIndex::rangeNodes(sf_count_t firstBlock, sf_count_t endBlock, vector<size_t> *nodes)
+{
+    size_t n = (size_t) this->getNumBlocks();
+    size_t lo = (size_t) firstBlock + n;
+    size_t hi = (size_t) endBlock + n;
+    nodes->clear();
+    while(lo < hi)
+    {
+        if(lo & 1)
+            nodes->push_back(lo++);
+        if(hi & 1)
+            nodes->push_back(--hi);
+        lo >>= 1;
+        hi >>= 1;
+    }
+}
+
+/*
+ * The sum of the decoded block sums of one channel over [firstBlock, endBlock).
+ */
+double SeekIndex::rangeSum(const CacheVector<uint16_t> &sums, const CacheVector<double> &totals, sf_count_t firstBlock, sf_count_t endBlock, int channel)
+{
+    return this->sumBefore(sums, totals, endBlock, channel) - this->sumBefore(sums, totals, firstBlock, channel);
+}
+
+/*
+ * The sum of the decoded block sums of one channel before a block: the running total at the last
+ * stride boundary plus the blocks after it.
+ */
+double SeekIndex::sumBefore(const CacheVector<uint16_t> &sums, const CacheVector<double> &totals, sf_count_t block, int channel)
+{
+    sf_count_t stride = block / SEEK_INDEX_SUM_STRIDE;
+    double total = totals[stride*this->numChannels + channel];
+    for(sf_count_t b = stride*SEEK_INDEX_SUM_STRIDE; b < block; b++)
+    {
+        total += decodeSum(sums[b*this->numChannels + channel]);
+    }
+    return total;
+}
+
+/*
+ * Encodes the extremes and sums of the block being filled, which is the last one.
+ */
+void SeekIndex::storeOpenBlock()
+{
+    size_t base = this->blockMin.size() - this->numChannels;
+    for(int c = 0; c < this->numChannels; c++)
+    {
+        int exponent = peakExponent(this->openMin[c], this->openMax[c]);
+        int16_t minCode = encodePeakMin(this->openMin[c], exponent);
+        int16_t maxCode = encodePeakMax(this->openMax[c], exponent);
+        if(decodePeak(minCode, exponent) != this->openMin[c] || decodePeak(maxCode, exponent) != this->openMax[c])
+        {
+            this->exactExtremes = false;
+        }
+        this->blockExponents[base + c] = (int8_t) exponent;
+        this->blockMin[base + c] = minCode;
+        this->blockMax[base + c] = maxCode;
+        this->blockSquares[base + c] = encodeSum(this->openSquares[c]);
+        this->blockWeightedSquares[base + c] = encodeSum(this->openWeightedSquares[c]);
+    }
+}
+
+/*
+ * Builds the internal nodes of the segment tree used by rangeMinMax(), and the running totals of the
+ * sums of squares.  A node's bounds are those of its children, encoded at a scale of its own; as all
+ * scales are powers of two, re-encoding only ever rounds to a coarser grid that contains the finer one,
+ * so the bounds do not loosen from level to level.
+ */
+void SeekIndex::buildTree()
+{
+    size_t n = (size_t) this->getNumBlocks();
+    int channels = this->numChannels;
+    this->treeExponents.assign(n * channels, PEAK_EXPONENT_MIN);
+    this->treeMin.assign(n * channels, 0);
+    this->treeMax.assign(n * channels, 0);
+
+    for(size_t i = n; i-- > 1; )
+    {
+        for(int c = 0; c < channels; c++)
+        {
+            double leftMin, leftMax, rightMin, rightMax;
+            this->nodeRange(2*i, c, &leftMin, &leftMax);
+            this->nodeRange(2*i + 1, c, &rightMin, &rightMax);
+            double minValue = min(leftMin, rightMin);
+            double maxValue = max(leftMax, rightMax);
+            int exponent = peakExponent(minValue, maxValue);
+            this->treeExponents[i*channels + c] = (int8_t) exponent;
+            this->treeMin[i*channels + c] = encodePeakMin(minValue, exponent);
+            this->treeMax[i*channels + c] = encodePeakMax(maxValue, exponent);
+        }
+    }
+
+    size_t numStrides = n / SEEK_INDEX_SUM_STRIDE + 1;
+    this->strideSquares.assign(numStrides * channels, 0.0);
+    this->strideWeightedSquares.assign(numStrides * channels, 0.0);
+    for(size_t s = 1; s < numStrides; s++)
+    {
+        for(int c = 0; c < channels; c++)
+        {
+            double squares = this->strideSquares[(s - 1)*channels + c];
+            double weightedSquares = this->strideWeightedSquares[(s - 1)*channels + c];
+            for(size_t b = (s - 1)*SEEK_INDEX_SUM_STRIDE; b < s*SEEK_INDEX_SUM_STRIDE; b++)
+            {
+                squares += decodeSum(this->blockSquares[b*channels + c]);
+                weightedSquares += decodeSum(this->blockWeightedSquares[b*channels + c]);
+            }
+            this->strideSquares[s*channels + c] = squares;
+            this->strideWeightedSquares[s*channels + c] = weightedSquares;
+        }
+    }
+}
+
+/*!
+\brief Writes a complete index to a sidecar file.
+@param indexPath Destination path.
+@param key Identity of the indexed file, checked again by load().
+@return true on success.
+*/
+bool SeekIndex::save(string indexPath, SeekIndexKey key)
+{
+    if(!this->isComplete())
+    {
+        return false;
+    }
+
+    string tempPath;
+    FILE *out = createSidecar(indexPath, &tempPath);
+    if(out == NULL)
+    {
+        fprintf(stderr, "failed to write seek index \"%s\".\n", indexPath.c_str());
+        return false;
+    }
+
+    int blockFrames = SEEK_INDEX_BLOCK_FRAMES;
+    int exact = this->exactExtremes ? 1 : 0;
+    long long numBlocks = this->getNumBlocks();
+    size_t numValues = this->blockMin.size();
+    bool ok = fwrite(SEEK_INDEX_MAGIC, 1, 8, out) == 8
+            && writeSeekIndexKey(out, key)
+            && fwrite(&blockFrames, sizeof(blockFrames), 1, out) == 1
+            && fwrite(&exact, sizeof(exact), 1, out) == 1
+            && fwrite(&numBlocks, sizeof(numBlocks), 1, out) == 1
+            && (numBlocks == 0
+                || (fwrite(&this->blockExponents[0], sizeof(int8_t), numValues, out) == numValues
+                    && fwrite(&this->blockMin[0], sizeof(int16_t), numValues, out) == numValues
+                    && fwrite(&this->blockMax[0], sizeof(int16_t), numValues, out) == numValues
+                    && fwrite(&this->blockSquares[0], sizeof(uint16_t), numValues, out) == numValues
+                    && fwrite(&this->blockWeightedSquares[0], sizeof(uint16_t), numValues, out) == numValues));
+    ok = commitSidecar(out, tempPath, indexPath, ok);
+
+    if(!ok)
+    {
+        fprintf(stderr, "failed to write seek index \"%s\".\n", indexPath.c_str());
+    }
+    return ok;
+}
+
+/*!
+\brief Loads an index previously written by save().
+@param indexPath Path of the sidecar file.
+@param key Identity of the file being opened.  The sidecar is rejected unless it was built from an identical file.
+@return true if a matching index was loaded.  On failure the index is left empty.
+*/
+bool SeekIndex::load(string indexPath, SeekIndexKey key)
+{
+    FILE *in = fopen(indexPath.c_str(), "rb");
+    if(in == NULL)
+    {
+        return false;
+    }
+
+    char magic[8];
+    SeekIndexKey storedKey;
+    int blockFrames = 0;
+    int exact = 0;
+    long long numBlocks = 0;
+    bool ok = fread(magic, 1, 8, in) == 8 && memcmp(magic, SEEK_INDEX_MAGIC, 8) == 0
+            && readSeekIndexKey(in, &storedKey)
+            && sameFile(storedKey, key)
+            && fread(&blockFrames, sizeof(blockFrames), 1, in) == 1 && blockFrames == SEEK_INDEX_BLOCK_FRAMES
+            && fread(&exact, sizeof(exact), 1, in) == 1
+            && fread(&numBlocks, sizeof(numBlocks), 1, in) == 1
+            && numBlocks == (key.frames + SEEK_INDEX_BLOCK_FRAMES - 1) / SEEK_INDEX_BLOCK_FRAMES;
+
+    if(ok)
+    {
+        this->reset(key.channels, key.frames, key.sampleRate);
+        size_t numValues = (size_t) (numBlocks*key.channels);
+        this->blockExponents.resize(numValues);
+        this->blockMin.resize(numValues);
+        this->blockMax.resize(numValues);
+        this->blockSquares.resize(numValues);
+        this->blockWeightedSquares.resize(numValues);
+        ok = (numBlocks == 0)
+            || (fread(&this->blockExponents[0], sizeof(int8_t), numValues, in) == numValues
+                && fread(&this->blockMin[0], sizeof(int16_t), numValues, in) == numValues
+                && fread(&this->blockMax[0], sizeof(int16_t), numValues, in) == numValues
+                && fread(&this->blockSquares[0], sizeof(uint16_t), numValues, in) == numValues
+                && fread(&this->blockWeightedSquares[0], sizeof(uint16_t), numValues, in) == numValues);
+    }
+    fclose(in);
+
+    if(!ok)
+    {
+        this->reset(0, 0, 0);
+        return false;
+    }
+    this->exactExtremes = (exact != 0);
+    this->framesAdded = this->totalFrames;
+    this->buildTree();
+    return true;
+}
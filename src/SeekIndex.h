@@ -0,0 +1,135 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <sndfile.h>
+#include <stdio.h>
+
+#include "KWeightingFilter.h"
+#include "MemoryAccount.h"
+#include "PeakCodes.h"
+
+#include <string>
+#include <vector>
+
+/*!
+    \file SeekIndex.h
+    \brief SeekIndex header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of frames summarized by each entry of a SeekIndex.  This is also the unit in which DISK_MODE
+AudioUtil instances position and buffer their reads.
+*/
+#define SEEK_INDEX_BLOCK_FRAMES 4096
+
+/*!
+\brief Identifies the exact file a persisted SeekIndex was built from.  An index file is only used when every
+field matches the file being opened.  The inode and the nanoseconds of the modification time catch a file that is
+rewritten with the same size within the same second.
+*/
+struct SeekIndexKey
+{
+    long long fileSize;
+    long long inode;
+    long long modificationTime;
+    long long modificationNanoseconds;
+    sf_count_t frames;
+    int channels;
+    int sampleRate;
+    int format;
+};
+
+bool sameFile(const SeekIndexKey &a, const SeekIndexKey &b);
+bool writeSeekIndexKey(FILE *out, const SeekIndexKey &key);
+bool readSeekIndexKey(FILE *in, SeekIndexKey *key);
+FILE *createSidecar(string path, string *tempPath);
+bool commitSidecar(FILE *out, string tempPath, string path, bool written);
+
+/*!
+\brief Number of blocks between the running totals a SeekIndex keeps of its sums of squares.  A sum over any run of
+blocks adds up at most twice this many block sums on top of two totals.
+*/
+#define SEEK_INDEX_SUM_STRIDE 64
+
+/*!
+\brief A block-by-block summary of an audio file, built during a single sequential pass.
+
+The file is divided into blocks of SEEK_INDEX_BLOCK_FRAMES frames and the index records the minimum and maximum
+sample, the sum of squares and the sum of squares after K-weighting (see KWeightingFilter) of each channel in each
+block.  Once complete, it also keeps a segment tree over the block minima and maxima and running totals of the sums
+of squares every SEEK_INDEX_SUM_STRIDE blocks, so that the minimum, maximum and sum of squares of any run of whole
+blocks are found in logarithmic and constant time respectively.  The K-weighted sums give the loudness of any run of
+blocks in constant time.  AudioUtil uses it in DISK_MODE so that random access into a file only ever has to decode
+the blocks at the edges of a request: whole blocks inside a region are answered from the index, and reads are
+aligned to block starts so that the decoder is repositioned as rarely as possible.  This matters most for compressed
+formats (FLAC, Ogg/Vorbis), where libsndfile can only seek by searching from a sync point.
+
+Everything is stored as 16-bit codes (see PeakCodes.h).  The minimum and maximum of each block and of each node of
+the tree are codes of a power-of-two scale of their own, kept as an 8-bit exponent, rounded outwards: the minimum
+down and the maximum up, by less than 1/32768 of the scale.  The extremes of 8- and 16-bit files are thus stored
+exactly (see hasExactExtremes()), and those of deeper files closely enough for drawing; callers that need them exact
+read the few blocks blocksBeyond() names.  Sums of squares are logarithmic codes, within 0.07%.  With the running
+totals, the index takes 14.25 bytes per channel per block, against 48 for double-precision extremes, tree and
+totals: 3.4 times less.
+
+The index can be saved to and loaded from a small sidecar file so that the first pass is only paid once per file.
+The sidecar holds the codes of the blocks, 9 bytes per channel per block, against 24 for double-precision extremes
+and single-precision sums: 2.7 times less.
+*/
+class SeekIndex
+{
+public:
+    SeekIndex();
+    void setMemoryAccount(MemoryAccount *account, MemoryTier tier);
+    void reset(int numChannels, sf_count_t totalFrames, int sampleRate);
+    void addFrames(const double *frames, sf_count_t count);
+    bool isComplete();
+    int getNumChannels();
+    sf_count_t getTotalFrames();
+    sf_count_t getNumBlocks();
+    bool hasExactExtremes();
+    void blockRange(sf_count_t block, int channel, double *minValue, double *maxValue);
+    void rangeMinMax(sf_count_t firstBlock, sf_count_t endBlock, int channel, double *minValue, double *maxValue);
+    sf_count_t lowestBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel);
+    sf_count_t highestBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel);
+    void blocksBeyond(sf_count_t firstBlock, sf_count_t endBlock, int channel, double lowest, double highest, vector<sf_count_t> *blocks);
+    double rangeSumOfSquares(sf_count_t firstBlock, sf_count_t endBlock, int channel);
+    double rangeWeightedSumOfSquares(sf_count_t firstBlock, sf_count_t endBlock, int channel);
+    bool save(string indexPath, SeekIndexKey key);
+    bool load(string indexPath, SeekIndexKey key);
+
+private:
+    int numChannels;
+    sf_count_t totalFrames;
+    sf_count_t framesAdded;
+    sf_count_t framesInBlock;
+    bool exactExtremes;
+    CacheVector<int8_t> blockExponents;
+    CacheVector<int16_t> blockMin;
+    CacheVector<int16_t> blockMax;
+    CacheVector<uint16_t> blockSquares;
+    CacheVector<uint16_t> blockWeightedSquares;
+    vector<double> openMin;
+    vector<double> openMax;
+    vector<double> openSquares;
+    vector<double> openWeightedSquares;
+    CacheVector<double> strideSquares;
+    CacheVector<double> strideWeightedSquares;
+    KWeightingFilter weightingFilter;
+    vector<double> weighted;
+    CacheVector<int8_t> treeExponents;
+    CacheVector<int16_t> treeMin;
+    CacheVector<int16_t> treeMax;
+
+    void nodeRange(size_t node, int channel, double *minValue, double *maxValue);
+    sf_count_t extremeBlock(sf_count_t firstBlock, sf_count_t endBlock, int channel, bool highest);
+    void rangeNodes(sf_count_t firstBlock, sf_count_t endBlock, vector<size_t> *nodes);
+    double rangeSum(const CacheVector<uint16_t> &sums, const CacheVector<double> &totals, sf_count_t firstBlock, sf_count_t endBlock, int channel);
+    double sumBefore(const CacheVector<uint16_t> &sums, const CacheVector<double> &totals, sf_count_t block, int channel);
+    void storeOpenBlock();
+    void buildTree();
+};
+
+#endif // SEEKINDEX_H
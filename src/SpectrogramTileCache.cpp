@@ -0,0 +1,431 @@
+#include "SpectrogramTileCache.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <QThreadPool>
+
+/*!
+\file SpectrogramTileCache.cpp
+\brief SpectrogramTileCache implementation file.
+*/
+
+/* Most spectra averaged into one column when the hop is longer than the FFT. */
+#define SPECTROGRAM_MAX_WINDOWS 4
+/* Level shown in the darkest color; 0 dBFS, a full-scale sine, is shown in the brightest. */
+#define SPECTROGRAM_FLOOR_DB -120.0
+/* A running tile checks whether it is still wanted every this many columns. */
+#define SPECTROGRAM_CANCEL_CHECK_COLUMNS 8
+
+/* Sorted array of (position, r, g, b) stops the palette is interpolated from. */
+static const int paletteStops[][4] = {
+    {0, 0, 0, 0},
+    {40, 0, 0, 96},
+    {100, 96, 0, 160},
+    {160, 208, 32, 64},
+    {210, 255, 160, 0},
+    {255, 255, 255, 224}
+};
+
+/*
+ * In-place iterative radix-2 FFT.  n must be a power of two; cosTable and sinTable hold cos(2 pi k/n) and
+ * sin(2 pi k/n) for k < n/2.
+ */
+static void fft(double *re, double *im, int n, const double *cosTable, const double *sinTable)
+{
+    for(int i = 1, j = 0; i < n; i++)
+    {
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if(i < j)
+        {
+            swap(re[i], re[j]);
+            swap(im[i], im[j]);
+        }
+    }
+
+    for(int length = 2; length <= n; length <<= 1)
+    {
+        int step = n / length;
+        for(int i = 0; i < n; i += length)
+        {
+            for(int k = 0; k < length / 2; k++)
+            {
+                double wr = cosTable[k * step];
+                double wi = -sinTable[k * step];
+                int a = i + k;
+                int b = i + k + length / 2;
+                double tr = re[b] * wr - im[b] * wi;
+                double ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+bool SpectrogramTileCache::TileKey::operator<(const TileKey &other) const
+{
+    if(this->fftSize != other.fftSize)
+        return this->fftSize < other.fftSize;
+    if(this->hop != other.hop)
+        return this->hop < other.hop;
+    return this->index < other.index;
+}
+
+/*!
+\brief Constructs an empty cache for the audio file wrapped by audioFile.
+@param audioFile The AudioUtil instance to read samples from.  It is not owned by the cache and must outlive it.
+*/
+SpectrogramTileCache::SpectrogramTileCache(AudioUtil *audioFile)
+{
+    this->srcAudioFile = audioFile;
+    this->fftSize = DEFAULT_FFT_SIZE;
+    this->tileBytes = 0;
+    this->useCounter = 0;
+    this->activeWorkers = 0;
+
+    int numStops = sizeof(paletteStops) / sizeof(paletteStops[0]);
+    for(int i = 0, s = 0; i < 256; i++)
+    {
+        while(s < numStops - 2 && i > paletteStops[s+1][0])
+        {
+            s++;
+        }
+        double t = ((double) (i - paletteStops[s][0])) / (paletteStops[s+1][0] - paletteStops[s][0]);
+        this->palette.push_back(qRgb((int) (paletteStops[s][1] + t * (paletteStops[s+1][1] - paletteStops[s][1])),
+                                     (int) (paletteStops[s][2] + t * (paletteStops[s+1][2] - paletteStops[s][2])),
+                                     (int) (paletteStops[s][3] + t * (paletteStops[s+1][3] - paletteStops[s][3]))));
+    }
+}
+
+SpectrogramTileCache::~SpectrogramTileCache()
+{
+    this->cancel();
+    this->waitForDone();
+}
+
+/*!
+\brief Sets the FFT size, and with it the frequency resolution, of the tiles requested from now on.
+
+Tiles queued for the old size are cancelled; tiles already computed for it stay cached.
+@param size A power of two between MIN_FFT_SIZE and MAX_FFT_SIZE; other values are rounded up to one.
+*/
+void SpectrogramTileCache::setFFTSize(int size)
+{
+    int rounded = MIN_FFT_SIZE;
+    while(rounded < size && rounded < MAX_FFT_SIZE)
+    {
+        rounded <<= 1;
+    }
+
+    if(rounded != this->fftSize)
+    {
+        this->cancel();
+        QMutexLocker locker(&this->mutex);
+        this->fftSize = rounded;
+    }
+}
+
+/*!
+\brief Accessor for the FFT size.
+*/
+int SpectrogramTileCache::getFFTSize()
+{
+    return this->fftSize;
+}
+
+/*!
+\brief The hop, in frames, of the tiles to draw at a zoom level.
+@param framesPerPixel Number of frames one pixel of the view covers.
+@return the smallest power of two not below framesPerPixel.
+*/
+sf_count_t SpectrogramTileCache::hopForZoom(double framesPerPixel)
+{
+    sf_count_t hop = 1;
+    while(hop < framesPerPixel)
+    {
+        hop <<= 1;
+    }
+    return hop;
+}
+
+/*!
+\brief A finished tile of the current FFT size.
+
+Tile index of hop covers the frames [index*SPECTROGRAM_TILE_COLUMNS*hop, (index+1)*SPECTROGRAM_TILE_COLUMNS*hop).
+Its image is SPECTROGRAM_TILE_COLUMNS pixels wide and getFFTSize()/2 pixels high, with the lowest frequency in the
+bottom row.  Columns past the end of the file are left in the darkest color.
+@return false if the tile has not been computed.
+*/
+bool SpectrogramTileCache::getTile(sf_count_t hop, sf_count_t index, QImage *tile)
+{
+    QMutexLocker locker(&this->mutex);
+
+    TileKey key = {hop, index, this->fftSize};
+    map<TileKey, Tile>::iterator found = this->tiles.find(key);
+    if(found == this->tiles.end())
+    {
+        return false;
+    }
+    found->second.lastUse = ++this->useCounter;
+    *tile = found->second.image;
+    return true;
+}
+
+/*!
+\brief Names the tiles in view, from firstTile to lastTile inclusive, and has the missing ones computed.
+
+Tiles that are queued or being computed but not named are cancelled.  Requesting tiles that are already cached,
+queued or running costs nothing, so this can be called on every paint.
+*/
+void SpectrogramTileCache::request(sf_count_t hop, sf_count_t firstTile, sf_count_t lastTile)
+{
+    QMutexLocker locker(&this->mutex);
+
+    this->wanted.clear();
+    this->queue.clear();
+    for(sf_count_t index = max((sf_count_t) 0, firstTile); index <= lastTile; index++)
+    {
+        TileKey key = {hop, index, this->fftSize};
+        this->wanted.insert(key);
+        if(this->tiles.find(key) == this->tiles.end() && this->running.find(key) == this->running.end())
+        {
+            this->queue.push_back(key);
+        }
+    }
+
+    /* Workers that have finished are not waited for again. */
+    for(size_t i = this->workers.size(); i-- > 0; )
+    {
+        if(this->workers[i].isFinished())
+        {
+            this->workers.erase(this->workers.begin() + i);
+        }
+    }
+
+    int maxWorkers = max(1, QThreadPool::globalInstance()->maxThreadCount());
+    while(this->activeWorkers < maxWorkers && this->activeWorkers < (int) this->queue.size())
+    {
+        this->activeWorkers++;
+        this->workers.push_back(QtConcurrent::run(this, &SpectrogramTileCache::work));
+    }
+}
+
+/*!
+\brief Drops the queued tiles and has the running ones stop at their next check.  Does not wait for them.
+*/
+void SpectrogramTileCache::cancel()
+{
+    QMutexLocker locker(&this->mutex);
+    this->queue.clear();
+    this->wanted.clear();
+}
+
+/*!
+\brief Blocks until no worker is running.
+*/
+void SpectrogramTileCache::waitForDone()
+{
+    this->mutex.lock();
+    vector< QFuture<void> > pending = this->workers;
+    this->workers.clear();
+    this->mutex.unlock();
+
+    for(size_t i = 0; i < pending.size(); i++)
+    {
+        pending[i].waitForFinished();
+    }
+}
+
+/*!
+\brief Cancels all work, waits for it to stop and discards every tile.
+*/
+void SpectrogramTileCache::clear()
+{
+    this->cancel();
+    this->waitForDone();
+
+    QMutexLocker locker(&this->mutex);
+    this->tiles.clear();
+    this->tileBytes = 0;
+}
+
+/*
+ * Runs on a worker thread: computes queued tiles until the queue is empty.
+ */
+void SpectrogramTileCache::work()
+{
+    PERF_SCOPE("SpectrogramTileCache::work");
+
+    this->mutex.lock();
+    while(!this->queue.empty())
+    {
+        TileKey key = this->queue.front();
+        this->queue.pop_front();
+        this->running.insert(key);
+        this->mutex.unlock();
+
+        QImage image;
+        bool finished = this->computeTile(key, &image);
+
+        this->mutex.lock();
+        this->running.erase(key);
+        if(finished)
+        {
+            Tile &tile = this->tiles[key];
+            tile.image = image;
+            tile.lastUse = ++this->useCounter;
+            this->tileBytes += image.bytesPerLine() * image.height();
+            this->evict();
+
+            this->mutex.unlock();
+            emit tileReady();
+            this->mutex.lock();
+        }
+        else
+        {
+            PERF_COUNT("SpectrogramTileCache::cancelledTile");
+        }
+    }
+    this->activeWorkers--;
+    this->mutex.unlock();
+}
+
+/*
+ * Computes one tile.  Returns false if the tile was cancelled before it was finished.
+ */
+bool SpectrogramTileCache::computeTile(const TileKey &key, QImage *image)
+{
+    PERF_SCOPE("SpectrogramTileCache::computeTile");
+
+    int n = key.fftSize;
+    int bins = n / 2;
+
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    int numChannels = this->srcAudioFile->getNumChannels();
+    if(numChannels <= 0)
+    {
+        return false;
+    }
+
+    vector<double> window(n);
+    vector<double> cosTable(bins);
+    vector<double> sinTable(bins);
+    for(int i = 0; i < n; i++)
+    {
+        window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / n);
+    }
+    for(int k = 0; k < bins; k++)
+    {
+        cosTable[k] = cos(2.0 * M_PI * k / n);
+        sinTable[k] = sin(2.0 * M_PI * k / n);
+    }
+
+    /* With the Hann window, a full-scale sine gives a magnitude of n/4. */
+    double normalization = 16.0 / ((double) n * n);
+    int windows = (int) min((sf_count_t) SPECTROGRAM_MAX_WINDOWS, max((sf_count_t) 1, key.hop / n));
+
+    vector<double> re(n);
+    vector<double> im(n);
+    vector<double> power(bins);
+
+    QImage tile(SPECTROGRAM_TILE_COLUMNS, bins, QImage::Format_RGB32);
+    tile.fill(this->palette[0]);
+
+    for(int column = 0; column < SPECTROGRAM_TILE_COLUMNS; column++)
+    {
+        if(column % SPECTROGRAM_CANCEL_CHECK_COLUMNS == 0 && !this->isWanted(key))
+        {
+            return false;
+        }
+
+        sf_count_t columnStart = (key.index * SPECTROGRAM_TILE_COLUMNS + column) * key.hop;
+        if(columnStart >= totalFrames)
+        {
+            break;
+        }
+
+        power.assign(bins, 0.0);
+        for(int w = 0; w < windows; w++)
+        {
+            sf_count_t center = columnStart + (sf_count_t) ((w + 0.5) * key.hop / windows);
+            sf_count_t start = center - n / 2;
+            sf_count_t skipped = max((sf_count_t) 0, -start);
+
+            vector<double> frames = this->srcAudioFile->getFrames(start + skipped, n - skipped);
+
+            re.assign(n, 0.0);
+            im.assign(n, 0.0);
+            sf_count_t count = (sf_count_t) frames.size() / numChannels;
+            for(sf_count_t i = 0; i < count; i++)
+            {
+                double mono = 0.0;
+                for(int c = 0; c < numChannels; c++)
+                {
+                    mono += frames[i * numChannels + c];
+                }
+                re[skipped + i] = mono / numChannels * window[skipped + i];
+            }
+
+            fft(&re[0], &im[0], n, &cosTable[0], &sinTable[0]);
+            for(int b = 0; b < bins; b++)
+            {
+                power[b] += re[b] * re[b] + im[b] * im[b];
+            }
+        }
+
+        for(int b = 0; b < bins; b++)
+        {
+            double decibels = 10.0 * log10(power[b] / windows * normalization + 1e-30);
+            double level = 1.0 - decibels / SPECTROGRAM_FLOOR_DB;
+            int shade = (int) (255.0 * min(1.0, max(0.0, level)));
+            ((QRgb *) tile.scanLine(bins - 1 - b))[column] = this->palette[shade];
+        }
+    }
+
+    *image = tile;
+    return true;
+}
+
+/*
+ * Whether a queued or running tile is still part of the last request.
+ */
+bool SpectrogramTileCache::isWanted(const TileKey &key)
+{
+    QMutexLocker locker(&this->mutex);
+    return this->wanted.find(key) != this->wanted.end();
+}
+
+/*
+ * Drops least recently used tiles that are out of view until the cache fits in SPECTROGRAM_CACHE_BYTES.
+ * Called with the mutex held.
+ */
+void SpectrogramTileCache::evict()
+{
+    while(this->tileBytes > SPECTROGRAM_CACHE_BYTES)
+    {
+        map<TileKey, Tile>::iterator victim = this->tiles.end();
+        for(map<TileKey, Tile>::iterator i = this->tiles.begin(); i != this->tiles.end(); ++i)
+        {
+            if(this->wanted.find(i->first) == this->wanted.end() &&
+               (victim == this->tiles.end() || i->second.lastUse < victim->second.lastUse))
+            {
+                victim = i;
+            }
+        }
+        if(victim == this->tiles.end())
+        {
+            break;
+        }
+        this->tileBytes -= victim->second.image.bytesPerLine() * victim->second.image.height();
+        this->tiles.erase(victim);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef SPECTROGRAMTILECACHE_H
+#define SPECTROGRAMTILECACHE_H
+
+#include "AudioUtil.h"
+#include "PerfStats.h"
+
+#include <sndfile.h>
+
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QFuture>
+#include <QtConcurrentRun>
+
+/*!
+    \file SpectrogramTileCache.h
+    \brief SpectrogramTileCache header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Number of columns (short-time spectra) in one spectrogram tile.
+*/
+#define SPECTROGRAM_TILE_COLUMNS 256
+
+/*!
+\brief FFT size used by a SpectrogramTileCache unless setFFTSize() is called.
+*/
+#define DEFAULT_FFT_SIZE 1024
+#define MIN_FFT_SIZE 64
+#define MAX_FFT_SIZE 16384
+
+/*!
+\brief Memory, in bytes, a SpectrogramTileCache may spend on tiles that are not in view.
+*/
+#define SPECTROGRAM_CACHE_BYTES (64 << 20)
+
+/*!
+\brief Spectrogram images of an audio file, computed in tiles on worker threads.
+
+The spectrogram is cut into tiles of SPECTROGRAM_TILE_COLUMNS columns.  Every column is the Hann-windowed power
+spectrum of the channels mixed down to mono, and the columns of a tile are hop frames apart.  The hop is a power of
+two, chosen with hopForZoom() to be just above the number of frames a pixel covers, so a tile is drawn at between
+one and two columns per pixel and stays usable while the view is zoomed by up to a factor of two.  At overview zoom
+levels the hop is far larger than the FFT and a column is the average of up to four spectra spread across it: a
+lower-resolution picture of the file, at a cost that depends on the number of pixels rather than the length of
+the file.
+
+Nothing is computed until it is requested.  request() names the tiles in view; the missing ones are queued, tiles
+queued or being computed for an earlier view are cancelled, and tileReady() is emitted from a worker thread each
+time a tile is finished.  Tiles are cached by hop, index and FFT size, so returning to a zoom level or switching
+back to an FFT size is free until the tiles are evicted, least recently used first, beyond SPECTROGRAM_CACHE_BYTES.
+
+The workers read samples through the AudioUtil given to the constructor, in parallel with each other and with the
+owner, which AudioUtil allows once its file is loaded.  The owner must call clear() before the AudioUtil is set to
+another file or file-handling mode.
+*/
+class SpectrogramTileCache : public QObject
+{
+    Q_OBJECT
+public:
+    SpectrogramTileCache(AudioUtil *audioFile);
+    ~SpectrogramTileCache();
+    void setFFTSize(int size);
+    int getFFTSize();
+    static sf_count_t hopForZoom(double framesPerPixel);
+    bool getTile(sf_count_t hop, sf_count_t index, QImage *tile);
+    void request(sf_count_t hop, sf_count_t firstTile, sf_count_t lastTile);
+    void cancel();
+    void waitForDone();
+    void clear();
+
+signals:
+    void tileReady();
+
+private:
+    struct TileKey
+    {
+        sf_count_t hop;
+        sf_count_t index;
+        int fftSize;
+        bool operator<(const TileKey &other) const;
+    };
+
+    struct Tile
+    {
+        QImage image;
+        unsigned long long lastUse;
+    };
+
+    AudioUtil *srcAudioFile;
+    int fftSize;
+    vector<QRgb> palette;
+    map<TileKey, Tile> tiles;
+    size_t tileBytes;
+    unsigned long long useCounter;
+    deque<TileKey> queue;
+    set<TileKey> wanted;
+    set<TileKey> running;
+    int activeWorkers;
+    vector< QFuture<void> > workers;
+    QMutex mutex;
+
+    void work();
+    bool computeTile(const TileKey &key, QImage *image);
+    bool isWanted(const TileKey &key);
+    void evict();
+};
+
+#endif // SPECTROGRAMTILECACHE_H
@@ -0,0 +1,452 @@
+#include "WaveformListWidget.h"
+
+#include <QMetaObject>
+#include <QRunnable>
+
+/*!
+\file WaveformListWidget.cpp
+\brief WaveformListWidget implementation file.
+*/
+
+#define ROW_PLACEHOLDER_COLOR QColor(Qt::lightGray)
+#define ROW_LABEL_COLOR QColor(Qt::darkGray)
+
+/*
+  Draws one row on a worker of the list's thread pool.
+*/
+class WaveformRowLoader : public QRunnable
+{
+public:
+    WaveformRowLoader(WaveformListWidget *list, int row, int generation, string filePath, QSize size, QColor color)
+    {
+        this->list = list;
+        this->row = row;
+        this->generation = generation;
+        this->filePath = filePath;
+        this->size = size;
+        this->color = color;
+    }
+
+    void run()
+    {
+        PERF_SCOPE("WaveformListWidget::loadRow");
+
+        /* The row may have been scrolled away, or the list changed, while the job was queued. */
+        if(!this->list->isWanted(this->row, this->generation))
+        {
+            PERF_COUNT("WaveformListWidget::skippedRow");
+            this->list->rowLoaded(this->row, this->generation, WaveformListWidget::ROW_EMPTY, QImage());
+            return;
+        }
+
+        AudioUtil audioFile;
+        audioFile.setFileHandlingMode(AudioUtil::DISK_MODE);
+        audioFile.setSeekIndexPolicy(AudioUtil::INDEX_ALWAYS);
+        audioFile.setSeekIndexPersistence(true);
+        audioFile.setReadHints(true);
+        if(!audioFile.setFile(this->filePath))
+        {
+            this->list->rowLoaded(this->row, this->generation, WaveformListWidget::ROW_FAILED, QImage());
+            return;
+        }
+
+        QImage image(this->size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(0);
+
+        WaveformRenderer renderer(&audioFile);
+        renderer.setSize(this->size);
+        renderer.setColor(this->color);
+
+        QPainter painter(&image);
+        renderer.render(&painter, QRect(0, 0, this->size.width(), this->size.height()));
+        painter.end();
+
+        this->list->rowLoaded(this->row, this->generation, WaveformListWidget::ROW_LOADED, image);
+    }
+
+private:
+    WaveformListWidget *list;
+    int row;
+    int generation;
+    string filePath;
+    QSize size;
+    QColor color;
+};
+
+/*!
+\brief Constructs an empty list.
+*/
+WaveformListWidget::WaveformListWidget(QWidget *parent) : QAbstractScrollArea(parent)
+{
+    this->rowHeight = DEFAULT_ROW_HEIGHT;
+    this->waveformColor = QColor(Qt::blue);
+    this->generation = 0;
+    this->wantedFirst = 0;
+    this->wantedLast = -1;
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+}
+
+/* Queued jobs see that they are no longer wanted and return at once. */
+WaveformListWidget::~WaveformListWidget()
+{
+    this->invalidateRows();
+    this->mutex.lock();
+    this->wantedFirst = 0;
+    this->wantedLast = -1;
+    this->mutex.unlock();
+    this->loaders.waitForDone();
+}
+
+/*!
+\brief Replaces the files shown by the list.  No file is opened until its row comes into view.
+@param filePaths Paths of the audio files, one per row, in order.
+*/
+void WaveformListWidget::setFiles(vector<string> filePaths)
+{
+    this->rows.clear();
+    this->invalidateRows();
+    for(size_t i = 0; i < filePaths.size(); i++)
+    {
+        this->addFile(filePaths[i]);
+    }
+}
+
+/*!
+\brief Adds a row for a file at the end of the list.
+*/
+void WaveformListWidget::addFile(string filePath)
+{
+    Row row;
+    row.filePath = filePath;
+    row.state = ROW_EMPTY;
+    row.generation = -1;
+    this->rows.push_back(row);
+    this->updateScrollBar();
+    this->viewport()->update();
+}
+
+/*!
+\brief Removes every row.
+*/
+void WaveformListWidget::clear()
+{
+    this->setFiles(vector<string>());
+}
+
+/*!
+\brief Number of rows in the list.
+*/
+int WaveformListWidget::getRowCount()
+{
+    return (int) this->rows.size();
+}
+
+/*!
+\brief Path of the file shown in a row, or an empty string for an invalid row.
+*/
+string WaveformListWidget::getFilePath(int row)
+{
+    if(row < 0 || row >= this->getRowCount())
+    {
+        return string();
+    }
+    return this->rows[row].filePath;
+}
+
+/*!
+\brief The row under a y coordinate of the viewport, or -1 if there is none.
+*/
+int WaveformListWidget::rowAt(int y)
+{
+    int row = (y + this->verticalScrollBar()->value()) / this->rowHeight;
+    if(y < 0 || row >= this->getRowCount())
+    {
+        return -1;
+    }
+    return row;
+}
+
+/*!
+\brief Sets the height of every row, in pixels.  Loaded rows are drawn again.
+*/
+void WaveformListWidget::setRowHeight(int height)
+{
+    if(height <= ROW_SPACING || height == this->rowHeight)
+    {
+        return;
+    }
+    this->rowHeight = height;
+    this->invalidateRows();
+    this->updateScrollBar();
+    this->viewport()->update();
+}
+
+/*!
+\brief Accessor for the row height.
+*/
+int WaveformListWidget::getRowHeight()
+{
+    return this->rowHeight;
+}
+
+/*!
+\brief Mutator for the waveform color.  Loaded rows are drawn again.
+*/
+void WaveformListWidget::setColor(QColor color)
+{
+    this->waveformColor = color;
+    this->invalidateRows();
+    this->viewport()->update();
+}
+
+/*!
+\brief Accessor for the waveform color.
+*/
+QColor WaveformListWidget::getColor()
+{
+    return this->waveformColor;
+}
+
+/*!
+\brief Sets the number of rows that may be loaded at the same time, and so the number of files open at once.
+The default is the number of processor cores.
+*/
+void WaveformListWidget::setMaxLoaders(int count)
+{
+    this->loaders.setMaxThreadCount(max(1, count));
+}
+
+/*!
+\brief Accessor for the number of rows that may be loaded at the same time.
+*/
+int WaveformListWidget::getMaxLoaders()
+{
+    return this->loaders.maxThreadCount();
+}
+
+void WaveformListWidget::paintEvent(QPaintEvent *event)
+{
+    PERF_SCOPE("WaveformListWidget::paintEvent");
+
+    QPainter painter(this->viewport());
+    QRect exposed = event->rect();
+    int offset = this->verticalScrollBar()->value();
+    int width = this->viewport()->width();
+
+    int first, last;
+    this->visibleRows(&first, &last);
+    for(int i = first; i <= last; i++)
+    {
+        QRect area(0, i * this->rowHeight - offset, width, this->rowHeight - ROW_SPACING);
+        if(!area.intersects(exposed))
+        {
+            continue;
+        }
+
+        Row &row = this->rows[i];
+        if(!row.image.isNull())
+        {
+            /* Stretched if the row was drawn before the last resize; it is being drawn again. */
+            painter.drawImage(area, row.image);
+        }
+        else
+        {
+            painter.setPen(ROW_PLACEHOLDER_COLOR);
+            painter.drawLine(area.left(), area.top() + area.height()/2, area.right(), area.top() + area.height()/2);
+        }
+
+        size_t slash = row.filePath.rfind('/');
+        string name = (slash == string::npos) ? row.filePath : row.filePath.substr(slash + 1);
+        if(row.state == ROW_FAILED)
+        {
+            name += " (cannot be read)";
+        }
+        painter.setPen(ROW_LABEL_COLOR);
+        painter.drawText(area.left() + 4, area.top() + 12, QString::fromStdString(name));
+    }
+    painter.end();
+
+    this->scheduleLoads();
+}
+
+void WaveformListWidget::resizeEvent(QResizeEvent *event)
+{
+    if(event->oldSize().width() != event->size().width())
+    {
+        this->invalidateRows();
+    }
+    this->updateScrollBar();
+}
+
+void WaveformListWidget::scrollContentsBy(int, int dy)
+{
+    this->viewport()->scroll(0, dy);
+}
+
+void WaveformListWidget::updateScrollBar()
+{
+    int contentHeight = this->getRowCount() * this->rowHeight;
+    int viewHeight = this->viewport()->height();
+    this->verticalScrollBar()->setRange(0, max(0, contentHeight - viewHeight));
+    this->verticalScrollBar()->setPageStep(viewHeight);
+    this->verticalScrollBar()->setSingleStep(max(1, this->rowHeight / 4));
+}
+
+/* The rows that intersect the viewport; last < first if there are none. */
+void WaveformListWidget::visibleRows(int *first, int *last)
+{
+    int offset = this->verticalScrollBar()->value();
+    *first = offset / this->rowHeight;
+    *last = min(this->getRowCount() - 1, (offset + this->viewport()->height()) / this->rowHeight);
+}
+
+/*
+    Queues the rows within ROW_LOAD_MARGIN of the view that have no up-to-date image, the visible
+    ones first, and discards the images of rows beyond ROW_EVICT_MARGIN.
+*/
+void WaveformListWidget::scheduleLoads()
+{
+    int first, last;
+    this->visibleRows(&first, &last);
+    if(last < first)
+    {
+        return;
+    }
+
+    int loadFirst = max(0, first - ROW_LOAD_MARGIN);
+    int loadLast = min(this->getRowCount() - 1, last + ROW_LOAD_MARGIN);
+    this->mutex.lock();
+    this->wantedFirst = loadFirst;
+    this->wantedLast = loadLast;
+    this->mutex.unlock();
+
+    QSize size(this->viewport()->width(), this->rowHeight - ROW_SPACING);
+    for(int distance = 0; distance <= loadLast - loadFirst; distance++)
+    {
+        /* Visible rows in order, then the margins, nearest first. */
+        int i = first + distance;
+        if(i > last)
+        {
+            int beyond = i - last;
+            i = (beyond % 2 == 1) ? last + (beyond + 1)/2 : first - beyond/2;
+        }
+        if(i < loadFirst || i > loadLast)
+        {
+            continue;
+        }
+
+        Row &row = this->rows[i];
+        if(row.state == ROW_EMPTY || (row.state != ROW_QUEUED && row.generation != this->generation))
+        {
+            row.state = ROW_QUEUED;
+            row.generation = this->generation;
+            this->loaders.start(new WaveformRowLoader(this, i, this->generation, row.filePath, size, this->waveformColor));
+        }
+    }
+
+    for(int i = 0; i < this->getRowCount(); i++)
+    {
+        if(i >= first - ROW_EVICT_MARGIN && i <= last + ROW_EVICT_MARGIN)
+        {
+            continue;
+        }
+        Row &row = this->rows[i];
+        if(!row.image.isNull() || row.state == ROW_LOADED || row.state == ROW_FAILED)
+        {
+            PERF_COUNT("WaveformListWidget::evictedRow");
+            row.image = QImage();
+            row.state = ROW_EMPTY;
+        }
+    }
+}
+
+/*
+    Marks every image as out of date.  Rows keep showing their old image until the new one arrives;
+    queued jobs for the old generation are skipped or their results dropped.
+*/
+void WaveformListWidget::invalidateRows()
+{
+    this->mutex.lock();
+    this->generation++;
+    this->mutex.unlock();
+
+    for(size_t i = 0; i < this->rows.size(); i++)
+    {
+        if(this->rows[i].state != ROW_QUEUED)
+        {
+            this->rows[i].state = ROW_EMPTY;
+        }
+    }
+}
+
+/*
+    Called by the loaders, on their own threads.
+*/
+bool WaveformListWidget::isWanted(int row, int generation)
+{
+    QMutexLocker locker(&this->mutex);
+    return generation == this->generation && row >= this->wantedFirst && row <= this->wantedLast;
+}
+
+void WaveformListWidget::rowLoaded(int row, int generation, RowState state, QImage image)
+{
+    LoadedRow result;
+    result.row = row;
+    result.generation = generation;
+    result.state = state;
+    result.image = image;
+
+    this->mutex.lock();
+    bool first = this->loaded.empty();
+    this->loaded.push_back(result);
+    this->mutex.unlock();
+
+    if(first)
+    {
+        QMetaObject::invokeMethod(this, "deliverLoadedRows", Qt::QueuedConnection);
+    }
+}
+
+/*
+    Takes the images the loaders have finished, on the GUI thread.
+*/
+void WaveformListWidget::deliverLoadedRows()
+{
+    this->mutex.lock();
+    vector<LoadedRow> results;
+    results.swap(this->loaded);
+    this->mutex.unlock();
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        LoadedRow &result = results[i];
+        if(result.row >= this->getRowCount())
+        {
+            continue;
+        }
+
+        Row &row = this->rows[result.row];
+        if(row.state == ROW_QUEUED && row.generation == result.generation)
+        {
+            row.state = result.state;
+            if(result.state == ROW_LOADED && result.generation == this->generation)
+            {
+                row.image = result.image;
+            }
+            else if(result.state == ROW_LOADED)
+            {
+                /* Drawn for an older size; still a better stand-in than nothing, but out of date. */
+                row.image = result.image;
+                row.state = ROW_EMPTY;
+            }
+            else if(result.state == ROW_FAILED && result.generation != this->generation)
+            {
+                /* Failed for an older size or color; it is tried again rather than shown as failed for good. */
+                row.state = ROW_EMPTY;
+            }
+        }
+    }
+
+    this->viewport()->update();
+}
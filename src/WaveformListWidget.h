@@ -0,0 +1,124 @@
+#ifndef WAVEFORMLISTWIDGET_H
+#define WAVEFORMLISTWIDGET_H
+
+#include "AudioUtil.h"
+#include "PerfStats.h"
+#include "WaveformRenderer.h"
+
+#include <string>
+#include <vector>
+
+#include <QAbstractScrollArea>
+#include <QColor>
+#include <QImage>
+#include <QMutex>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QResizeEvent>
+#include <QScrollBar>
+#include <QSize>
+#include <QThreadPool>
+
+/*!
+    \file WaveformListWidget.h
+    \brief WaveformListWidget header file.
+*/
+
+using namespace std;
+
+#define DEFAULT_ROW_HEIGHT 80
+#define ROW_SPACING 4
+/*!
+\brief Rows beyond either edge of the view that are loaded ahead of scrolling.
+*/
+#define ROW_LOAD_MARGIN 4
+/*!
+\brief Rows beyond either edge of the view past which a loaded row is discarded.
+*/
+#define ROW_EVICT_MARGIN 32
+
+/*!
+\brief A scrolling list of the waveforms of many audio files, one row per file.
+
+Unlike a column of WaveformWidget instances, which open and cache their file when they are constructed, the list
+only stores the paths it is given: setFiles() takes constant time per file, however long the files are.  A row is
+loaded when it comes within ROW_LOAD_MARGIN rows of the view.  Loading happens on the list's own thread pool,
+whose size bounds the number of files open at once: a job opens its file in DISK_MODE, draws the row with a
+WaveformRenderer into an image and closes the file again, so a loaded row only holds its image.  Jobs for rows that
+have scrolled out of range by the time a worker picks them up are skipped.  Rows more than ROW_EVICT_MARGIN rows
+from the view give up their image.
+
+The jobs build a seek index of every file (AudioUtil::INDEX_ALWAYS) and save it next to the file
+(AudioUtil::setSeekIndexPersistence()), so the first load of a file makes one pass over it, and a row that is loaded
+again, after eviction, a resize or in this list or another, is drawn from the saved index: only the blocks at the
+edges of its columns are read, not the whole file.  A file whose directory is not writable gets no saved index and
+is read in full on every load.  When the list is resized, rows keep showing their old image, stretched, until they
+have been drawn at the new width.
+*/
+class WaveformListWidget : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    WaveformListWidget(QWidget *parent = 0);
+    ~WaveformListWidget();
+    void setFiles(vector<string> filePaths);
+    void addFile(string filePath);
+    void clear();
+    int getRowCount();
+    string getFilePath(int row);
+    int rowAt(int y);
+    void setRowHeight(int height);
+    int getRowHeight();
+    void setColor(QColor color);
+    QColor getColor();
+    void setMaxLoaders(int count);
+    int getMaxLoaders();
+
+protected:
+    virtual void paintEvent(QPaintEvent *event);
+    virtual void resizeEvent(QResizeEvent *event);
+    virtual void scrollContentsBy(int dx, int dy);
+
+private:
+    enum RowState {ROW_EMPTY, ROW_QUEUED, ROW_LOADED, ROW_FAILED};
+
+    struct Row
+    {
+        string filePath;
+        RowState state;
+        QImage image;
+        int generation;
+    };
+
+    struct LoadedRow
+    {
+        int row;
+        int generation;
+        RowState state;
+        QImage image;
+    };
+
+    vector<Row> rows;
+    int rowHeight;
+    QColor waveformColor;
+    QThreadPool loaders;
+    QMutex mutex;
+    int generation;
+    int wantedFirst;
+    int wantedLast;
+    vector<LoadedRow> loaded;
+
+    friend class WaveformRowLoader;
+
+    void updateScrollBar();
+    void visibleRows(int *first, int *last);
+    void scheduleLoads();
+    void invalidateRows();
+    bool isWanted(int row, int generation);
+    void rowLoaded(int row, int generation, RowState state, QImage image);
+
+private slots:
+    void deliverLoadedRows();
+};
+
+#endif // WAVEFORMLISTWIDGET_H
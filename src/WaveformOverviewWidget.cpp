@@ -0,0 +1,221 @@
+#include "WaveformOverviewWidget.h"
+
+/*!
+\file WaveformOverviewWidget.cpp
+\brief WaveformOverviewWidget implementation file.
+*/
+
+/*!
+\brief Constructs an overview of the file shown by target.
+@param target The zoomed view to follow.  It must outlive the overview.
+@param parent Parent widget.
+*/
+WaveformOverviewWidget::WaveformOverviewWidget(WaveformWidget *target, QWidget *parent) : QWidget(parent)
+{
+    this->target = target;
+    /* Only used to draw the columns; it never computes peaks of its own. */
+    this->renderer = new WaveformRenderer(target->getAudioUtil());
+    this->exactColumns = 0;
+    this->layerValid = false;
+    this->viewportColor = DEFAULT_VIEWPORT_COLOR;
+    this->dragOffset = 0;
+    QObject::connect(target, SIGNAL(viewChanged()), this, SLOT(targetViewChanged()));
+    QObject::connect(target, SIGNAL(peaksChanged()), this, SLOT(targetPeaksChanged()));
+}
+
+WaveformOverviewWidget::~WaveformOverviewWidget()
+{
+    delete this->renderer;
+}
+
+/*!
+\brief The WaveformWidget the overview follows.
+*/
+WaveformWidget *WaveformOverviewWidget::getTarget()
+{
+    return this->target;
+}
+
+/*!
+\brief Mutator for the waveform color.
+*/
+void WaveformOverviewWidget::setColor(QColor color)
+{
+    this->renderer->setColor(color);
+    this->layerValid = false;
+    this->update();
+}
+
+/*!
+\brief Accessor for the waveform color.
+*/
+QColor WaveformOverviewWidget::getColor()
+{
+    return this->renderer->getColor();
+}
+
+/*!
+\brief Mutator for the color the part of the file in view is shaded with.  Its outline is drawn in the same color,
+opaque.
+*/
+void WaveformOverviewWidget::setViewportColor(QColor color)
+{
+    this->viewportColor = color;
+    this->update();
+}
+
+/*!
+\brief Accessor for the viewport color.
+*/
+QColor WaveformOverviewWidget::getViewportColor()
+{
+    return this->viewportColor;
+}
+
+void WaveformOverviewWidget::paintEvent(QPaintEvent *event)
+{
+    PERF_SCOPE("WaveformOverviewWidget::paintEvent");
+
+    QRect exposed = event->region().boundingRect();
+    QPainter painter(this);
+
+    if(!this->layerValid)
+    {
+        this->updateLayer();
+    }
+    painter.drawImage(exposed, this->layer, exposed);
+
+    this->viewportRect = this->viewportArea();
+    if(!this->viewportRect.isEmpty())
+    {
+        QColor outline = this->viewportColor;
+        outline.setAlpha(255);
+        painter.fillRect(this->viewportRect, this->viewportColor);
+        painter.setPen(QPen(outline, 1));
+        painter.drawRect(this->viewportRect.adjusted(0, 0, -1, -1));
+    }
+}
+
+void WaveformOverviewWidget::resizeEvent(QResizeEvent *)
+{
+    this->layerValid = false;
+}
+
+/* A press outside the rectangle centers it on the pointer; either way, the rectangle follows the pointer from there. */
+void WaveformOverviewWidget::mousePressEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton)
+    {
+        return;
+    }
+    QRect viewport = this->viewportArea();
+    if(viewport.contains(event->pos()))
+    {
+        this->dragOffset = event->x() - viewport.left();
+    }
+    else
+    {
+        this->dragOffset = viewport.width() / 2;
+    }
+    this->target->scrollToFrame(this->xToFrame(event->x() - this->dragOffset));
+}
+
+void WaveformOverviewWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if(event->buttons() & Qt::LeftButton)
+    {
+        this->target->scrollToFrame(this->xToFrame(event->x() - this->dragOffset));
+    }
+}
+
+/*
+    Looks the peaks of every column up in the target's seek index and draws them.  Columns the
+    index does not cover yet are sketched, unless the target is loading its file, in which case
+    its AudioUtil instance belongs to the load and they are left empty until the next peaksChanged().
+*/
+void WaveformOverviewWidget::updateLayer()
+{
+    PERF_SCOPE("WaveformOverviewWidget::updateLayer");
+
+    AudioUtil *audioFile = this->target->getAudioUtil();
+    sf_count_t totalFrames = audioFile->getTotalFrames();
+    int numColumns = this->width();
+
+    this->columnPeaks.clear();
+    this->exactColumns = 0;
+    if(numColumns > 0 && totalFrames > 0)
+    {
+        this->exactColumns = audioFile->loadedPeaks(0, totalFrames, numColumns, &this->columnPeaks);
+        if(this->exactColumns < numColumns && !this->target->isLoading())
+        {
+            vector<double> sketch = audioFile->approximatePeaks(0, totalFrames, numColumns);
+            if(sketch.size() == this->columnPeaks.size())
+            {
+                int numChannels = audioFile->getNumChannels();
+                copy(this->columnPeaks.begin(), this->columnPeaks.begin() + this->exactColumns * numChannels, sketch.begin());
+                this->columnPeaks.swap(sketch);
+            }
+        }
+    }
+
+    this->layer = QImage(this->size(), QImage::Format_ARGB32_Premultiplied);
+    this->layer.fill(0);
+    if(!this->columnPeaks.empty())
+    {
+        QPainter painter(&this->layer);
+        this->renderer->renderSketch(&painter, this->size(), this->columnPeaks, audioFile->getNumChannels(), this->exactColumns);
+        painter.end();
+    }
+    this->layerValid = true;
+}
+
+/*
+    The columns of the overview under the part of the file in view, at least three wide so that
+    the rectangle stays visible and can be grabbed however far the target is zoomed in.
+*/
+QRect WaveformOverviewWidget::viewportArea()
+{
+    sf_count_t totalFrames = this->target->getAudioUtil()->getTotalFrames();
+    if(totalFrames <= 0 || this->width() <= 0)
+    {
+        return QRect();
+    }
+    sf_count_t startFrame, endFrame;
+    this->target->getVisibleFrames(&startFrame, &endFrame);
+    int x1 = (int) (((double) startFrame) * this->width() / totalFrames);
+    int x2 = (int) (((double) endFrame) * this->width() / totalFrames);
+    int w = max(3, x2 - x1);
+    return QRect(min(x1, this->width() - w), 0, w, this->height());
+}
+
+/*
+    The frame under column x.
+*/
+sf_count_t WaveformOverviewWidget::xToFrame(int x)
+{
+    if(this->width() <= 0)
+    {
+        return 0;
+    }
+    return (sf_count_t) (((double) max(0, x)) * this->target->getAudioUtil()->getTotalFrames() / this->width());
+}
+
+/*
+    Repaints the columns under the old and the new rectangle.
+*/
+void WaveformOverviewWidget::targetViewChanged()
+{
+    QRect viewport = this->viewportArea();
+    if(viewport != this->viewportRect)
+    {
+        this->update(this->viewportRect);
+        this->update(viewport);
+        this->viewportRect = viewport;
+    }
+}
+
+void WaveformOverviewWidget::targetPeaksChanged()
+{
+    this->layerValid = false;
+    this->update();
+}
@@ -0,0 +1,80 @@
+#ifndef WAVEFORMOVERVIEWWIDGET_H
+#define WAVEFORMOVERVIEWWIDGET_H
+
+#include "WaveformWidget.h"
+#include "WaveformRenderer.h"
+#include "PerfStats.h"
+
+#include <vector>
+
+#include <QColor>
+#include <QImage>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QRect>
+#include <QResizeEvent>
+#include <QWidget>
+
+/*!
+    \file WaveformOverviewWidget.h
+    \brief WaveformOverviewWidget header file.
+*/
+
+using namespace std;
+
+#define DEFAULT_VIEWPORT_COLOR QColor(0, 0, 0, 40)
+
+/*!
+\brief A strip showing the whole file of a zoomed WaveformWidget, with a rectangle around the part in view that can
+be dragged to move it.
+
+The overview does not open the file: it reads the peaks of the whole file from the AudioUtil instance of the
+WaveformWidget it follows, out of the seek index that instance builds while loading, one lookup per index block.
+It holds nothing but one peak per column and the image they are drawn into.  While the file loads, the columns
+already indexed are drawn as they come in; in the modes that keep no index, the rest are sketched from a sparse
+sample of the file once it is loaded (see AudioUtil::approximatePeaks()), drawn translucent.
+
+The two views are kept in sync through the WaveformWidget's viewChanged() and peaksChanged() signals: scrolling or
+zooming the waveform only repaints the columns of the overview under the old and new rectangles, and dragging the
+rectangle calls WaveformWidget::scrollToFrame().  The WaveformWidget must outlive the overview.
+*/
+class WaveformOverviewWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    WaveformOverviewWidget(WaveformWidget *target, QWidget *parent = 0);
+    ~WaveformOverviewWidget();
+    WaveformWidget *getTarget();
+    void setColor(QColor color);
+    QColor getColor();
+    void setViewportColor(QColor color);
+    QColor getViewportColor();
+
+protected:
+    virtual void paintEvent(QPaintEvent *event);
+    virtual void resizeEvent(QResizeEvent *event);
+    virtual void mousePressEvent(QMouseEvent *event);
+    virtual void mouseMoveEvent(QMouseEvent *event);
+
+private:
+    WaveformWidget *target;
+    WaveformRenderer *renderer;
+    vector<double> columnPeaks;
+    int exactColumns;
+    QImage layer;
+    bool layerValid;
+    QRect viewportRect;
+    QColor viewportColor;
+    int dragOffset;
+
+    void updateLayer();
+    QRect viewportArea();
+    sf_count_t xToFrame(int x);
+
+private slots:
+    void targetViewChanged();
+    void targetPeaksChanged();
+};
+
+#endif // WAVEFORMOVERVIEWWIDGET_H
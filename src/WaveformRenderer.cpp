@@ -0,0 +1,831 @@
+#include "WaveformRenderer.h"
+
+#define DEFAULT_PADDING 0.3
+#define LINE_WIDTH 1
+#define POINT_SIZE 5
+#define DEFAULT_COLOR Qt::blue
+#define INDIVIDUAL_SAMPLE_DRAW_TOGGLE_POINT 9.0
+#define MACRO_MODE_TOGGLE_CONSTANT 100.0
+#define DEFAULT_ENVELOPE_COLOR QColor(255, 140, 0)
+#define ENVELOPE_LANE_FRACTION 0.25
+#define ENVELOPE_LANE_FLOOR_DB -60.0
+#define SKETCH_ALPHA 96
+#define COLUMN_CODE_MAX 65535.0
+
+/*!
+\file WaveformRenderer.cpp
+\brief WaveformRenderer implementation file.
+*/
+
+/*!
+\brief Constructs a renderer for the audio file wrapped by audioFile.
+@param audioFile The AudioUtil instance to draw.  It is not owned by the renderer and must outlive it.
+*/
+WaveformRenderer::WaveformRenderer(AudioUtil *audioFile)
+{
+    this->srcAudioFile = audioFile;
+    this->currentDrawingMode = NO_MODE;
+    this->padding = DEFAULT_PADDING;
+    this->scaleFactor = -1.0;
+    this->columnStep = 0.0;
+    this->waveformColor = DEFAULT_COLOR;
+    this->envelopeMode = NO_ENVELOPE;
+    this->envelopeColor = DEFAULT_ENVELOPE_COLOR;
+    this->viewMode = WAVEFORM_VIEW;
+    this->peakVector = CacheVector<uint16_t>(CacheAllocator<uint16_t>(&this->memoryAccount, TIER_RENDERER));
+    this->rmsVector = CacheVector<uint16_t>(CacheAllocator<uint16_t>(&this->memoryAccount, TIER_RENDERER));
+    this->dataVector = CacheVector<double>(CacheAllocator<double>(&this->memoryAccount, TIER_RENDERER));
+    this->spectrogramTiles = new SpectrogramTileCache(audioFile);
+}
+
+/* The tile cache is the renderer's only dynamically allocated object. */
+WaveformRenderer::~WaveformRenderer()
+{
+    delete this->spectrogramTiles;
+}
+
+/*!
+\brief Discards all peak and sample data.  Must be called whenever the wrapped AudioUtil is set to a new file.
+*/
+void WaveformRenderer::reset()
+{
+    this->spectrogramTiles->clear();
+    this->peakVector.clear();
+    this->rmsVector.clear();
+    this->dataVector.clear();
+    this->currentDrawingMode = NO_MODE;
+    this->lastSize = QSize();
+}
+
+/*!
+\brief Sets the size, in pixels, of the area the waveform is drawn into.
+*/
+void WaveformRenderer::setSize(QSize size)
+{
+    this->size = size;
+}
+
+/*!
+\brief Accessor for the size of the area the waveform is drawn into.
+*/
+QSize WaveformRenderer::getSize()
+{
+    return this->size;
+}
+
+/*!
+    \brief Mutator for waveform color.
+
+    @param color The desired color for the waveform visualization.
+*/
+void WaveformRenderer::setColor(QColor color)
+{
+    this->waveformColor = color;
+}
+
+/*!
+    \brief Accessor for waveform color.
+*/
+QColor WaveformRenderer::getColor()
+{
+    return this->waveformColor;
+}
+
+/*!
+\brief The drawing mode chosen by the last call to render().
+*/
+WaveformRenderer::DrawingMode WaveformRenderer::getDrawingMode()
+{
+    return this->currentDrawingMode;
+}
+
+/*!
+\brief Chooses how loudness is shown alongside the peaks.
+
+INNER_ENVELOPE draws the RMS of each column inside its peak bar, in the envelope color.  ENVELOPE_LANE takes the
+bottom quarter of the drawing area for a lane that plots the short-term loudness (LUFS, in the envelope color) and
+the RMS level of the loudest channel (dBFS, in the waveform color) from ENVELOPE_LANE_FLOOR_DB up to 0 dB.  The
+RMS is only shown in overview mode, where every column covers many samples.  The lane requires AudioUtil to have a
+seek index, which it always has in the cached modes.
+
+@param mode NO_ENVELOPE (the default), INNER_ENVELOPE or ENVELOPE_LANE
+*/
+void WaveformRenderer::setEnvelopeMode(EnvelopeMode mode)
+{
+    this->envelopeMode = mode;
+    /* The RMS is gathered along with the peaks, so they have to be calculated again. */
+    this->lastSize = QSize();
+    this->rmsVector.clear();
+}
+
+/*!
+\brief Accessor for the envelope mode.
+*/
+WaveformRenderer::EnvelopeMode WaveformRenderer::getEnvelopeMode()
+{
+    return this->envelopeMode;
+}
+
+/*!
+\brief Mutator for the color of the RMS envelope and the loudness curve.
+*/
+void WaveformRenderer::setEnvelopeColor(QColor color)
+{
+    this->envelopeColor = color;
+}
+
+/*!
+\brief Accessor for the envelope color.
+*/
+QColor WaveformRenderer::getEnvelopeColor()
+{
+    return this->envelopeColor;
+}
+
+/*!
+\brief Chooses between the waveform and the spectrogram of the file.
+
+In SPECTROGRAM_VIEW the drawing mode is SPECTROGRAM whatever the zoom level.  Envelope lanes are drawn in both
+views.
+@param mode WAVEFORM_VIEW (the default) or SPECTROGRAM_VIEW
+*/
+void WaveformRenderer::setViewMode(ViewMode mode)
+{
+    if(mode == this->viewMode)
+    {
+        return;
+    }
+    if(mode == WAVEFORM_VIEW)
+    {
+        /* The waveform reads samples on this thread, so the tile workers have to be out of the way. */
+        this->cancelSpectrogram();
+    }
+    this->viewMode = mode;
+    this->currentDrawingMode = NO_MODE;
+    this->lastSize = QSize();
+}
+
+/*!
+\brief Accessor for the view mode.
+*/
+WaveformRenderer::ViewMode WaveformRenderer::getViewMode()
+{
+    return this->viewMode;
+}
+
+/*!
+\brief Sets the FFT size of the spectrogram.  See SpectrogramTileCache::setFFTSize().
+*/
+void WaveformRenderer::setFFTSize(int size)
+{
+    this->spectrogramTiles->setFFTSize(size);
+}
+
+/*!
+\brief Accessor for the FFT size of the spectrogram.
+*/
+int WaveformRenderer::getFFTSize()
+{
+    return this->spectrogramTiles->getFFTSize();
+}
+
+/*!
+\brief The tile cache behind the spectrogram view, whose tileReady() signal tells when to render again.
+*/
+SpectrogramTileCache *WaveformRenderer::getSpectrogramTiles()
+{
+    return this->spectrogramTiles;
+}
+
+/*!
+\brief Cancels the spectrogram tiles being computed and waits for the workers to stop.
+
+Must be called before the wrapped AudioUtil is set to another file-handling mode.  reset() does this itself.
+*/
+void WaveformRenderer::cancelSpectrogram()
+{
+    this->spectrogramTiles->cancel();
+    this->spectrogramTiles->waitForDone();
+}
+
+/*!
+\brief Whether render() can draw at the current size without calculating anything for the whole file first.
+
+When it can, drawing a part of the area takes time in proportion to the width of the part, so a large area can be
+drawn a few columns at a time.  When it cannot (the size changed in overview mode, or the drawing mode changes),
+the first call to render() calculates the peaks of the whole file, which takes time in proportion to its length.
+*/
+bool WaveformRenderer::isPrepared()
+{
+    if(this->viewMode == SPECTROGRAM_VIEW)
+    {
+        return true;
+    }
+    if(this->currentDrawingMode == NO_MODE)
+    {
+        return false;
+    }
+
+    bool macro = (this->width() >= this->srcAudioFile->getTotalFrames()/MACRO_MODE_TOGGLE_CONSTANT);
+    if(macro != (this->currentDrawingMode == MACRO))
+    {
+        return false;
+    }
+    return macro || this->size == this->lastSize;
+}
+
+/*!
+\brief The account the renderer's column peaks and samples are counted in, in TIER_RENDERER.
+*/
+MemoryAccount *WaveformRenderer::getMemoryAccount()
+{
+    return &this->memoryAccount;
+}
+
+/*!
+\brief Draws the part of the waveform that falls inside exposed.
+
+@param painter An active painter on the target device.  The waveform is drawn in the rectangle (0, 0, getSize()).
+@param exposed The region that needs painting, in the same coordinates.
+*/
+void WaveformRenderer::render(QPainter *painter, QRect exposed)
+{
+    if(this->width() <= 0 || this->height() <= 0 || this->srcAudioFile->getTotalFrames() <= 0)
+    {
+        return;
+    }
+
+    this->establishDrawingMode();
+
+    int minX = exposed.x();
+    int maxX = exposed.x() + exposed.width();
+
+    if(this->currentDrawingMode == OVERVIEW)
+    {
+        this->overviewDraw(painter, minX, maxX);
+    }
+    else if(this->currentDrawingMode == MACRO)
+    {
+        this->macroDraw(painter, minX, maxX);
+    }
+    else if(this->currentDrawingMode == SPECTROGRAM)
+    {
+        this->spectrogramDraw(painter, minX, maxX);
+    }
+
+    if(this->envelopeMode == ENVELOPE_LANE)
+    {
+        this->laneDraw(painter, minX, maxX);
+    }
+}
+
+/*!
+\brief Draws column peaks computed by the caller, such as the sketch AudioUtil::approximatePeaks() gives before the
+file is loaded.
+
+The peaks are drawn like the overview, one column per pixel, without reading anything from the audio file, so this
+can be called while the file is being loaded on another thread.  The columns from exactColumns on are drawn
+translucent, to show that they are approximate.  The peaks are scaled to the largest of them.
+
+@param painter An active painter on the target device.  The sketch is drawn in the rectangle (0, 0, size).
+@param size Size of the area to draw into; its width should be the number of columns.
+@param columnPeaks Peaks of each channel for every column, interleaved.
+@param numChannels Number of channels, 1 or 2.
+@param exactColumns Number of leading columns whose peaks are exact.
+*/
+void WaveformRenderer::renderSketch(QPainter *painter, QSize size, const vector<double> &columnPeaks, int numChannels, int exactColumns)
+{
+    PERF_SCOPE("WaveformRenderer::renderSketch");
+
+    if(numChannels != 1 && numChannels != 2)
+    {
+        return;
+    }
+
+    double peak = 0.0;
+    for(size_t i = 0; i < columnPeaks.size(); i++)
+    {
+        peak = max(peak, fabs(columnPeaks[i]));
+    }
+    double scale = (peak > 0.0) ? (1.0/peak) * (1.0 - this->padding) : 0.0;
+
+    QColor approximateColor = this->waveformColor;
+    approximateColor.setAlpha(SKETCH_ALPHA);
+    QPen exactPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap);
+    QPen approximatePen(approximateColor, 1, Qt::SolidLine, Qt::RoundCap);
+    painter->setPen(exactPen);
+
+    int numColumns = min(size.width(), (int) columnPeaks.size() / numChannels);
+    int channelHeight = size.height() / 4;
+    for(int x = 0; x < numColumns; x++)
+    {
+        if(x == exactColumns)
+        {
+            painter->setPen(approximatePen);
+        }
+        for(int c = 0; c < numChannels; c++)
+        {
+            int yMidpoint = (2 * c + 1) * size.height() / (2 * numChannels);
+            int extent = (int) (channelHeight * fabs(columnPeaks[x * numChannels + c]) * scale);
+            painter->drawLine(x, yMidpoint - extent, x, yMidpoint + extent);
+        }
+    }
+}
+
+int WaveformRenderer::width()
+{
+    return this->size.width();
+}
+
+/* Height of the waveform itself, which is the whole drawing area unless a lane is shown below it. */
+int WaveformRenderer::height()
+{
+    return this->size.height() - this->laneHeight();
+}
+
+int WaveformRenderer::laneHeight()
+{
+    if(this->envelopeMode != ENVELOPE_LANE)
+    {
+        return 0;
+    }
+    return (int) (this->size.height() * ENVELOPE_LANE_FRACTION);
+}
+
+/*
+Derives the vertical scale factor from the loudest value the waveform has to show.  In overview
+mode the peak is taken from the peaks just computed instead of asking libsndfile for a separate
+pass over the file.
+*/
+void WaveformRenderer::setScaleForPeak(double peak)
+{
+    if(peak <= 0.0)
+    {
+        peak = 1.0;
+    }
+    this->scaleFactor = 1.0/peak;
+    this->scaleFactor = scaleFactor - scaleFactor * this->padding;
+}
+
+void WaveformRenderer::recalculatePeaks()
+{
+    PERF_SCOPE("WaveformRenderer::recalculatePeaks");
+
+    if(this->currentDrawingMode == MACRO)
+    {
+        return;
+    }
+
+    vector<double> peaks;
+    vector<double> rms;
+    double peak = 0.0;
+    switch(this->srcAudioFile->getNumChannels())
+    {
+    case 2:
+        peak = this->collectPeaks<2>(&peaks, &rms);
+        break;
+    case 1:
+        peak = this->collectPeaks<1>(&peaks, &rms);
+        break;
+    }
+
+    /*
+      The columns are kept as 16-bit fractions of the largest peak, the scale they are drawn at, which
+      is finer than any pixel and a quarter of the size of doubles.
+    */
+    this->columnStep = peak / COLUMN_CODE_MAX;
+    this->encodeColumns(peaks, &this->peakVector);
+    this->encodeColumns(rms, &this->rmsVector);
+    this->setScaleForPeak(peak);
+}
+
+/*
+  Stores values between 0 and the largest peak as codes of columnStep each.
+*/
+void WaveformRenderer::encodeColumns(const vector<double> &values, CacheVector<uint16_t> *codes)
+{
+    codes->resize(values.size());
+    for(size_t i = 0; i < values.size(); i++)
+    {
+        double code = (this->columnStep > 0.0) ? floor(values[i] / this->columnStep + 0.5) : 0.0;
+        (*codes)[i] = (uint16_t) min(code, COLUMN_CODE_MAX);
+    }
+}
+
+/*
+  Fills peaks with the peak of each channel for each region of the source audio file to be
+  represented by a single pixel of the widget, and rms with their RMS if an envelope is shown, and
+  returns the largest peak.
+*/
+template<int CHANNELS>
+double WaveformRenderer::collectPeaks(vector<double> *peaks, vector<double> *rms)
+{
+    /*calculate frame-grab increments*/
+    sf_count_t totalFrames = srcAudioFile->getTotalFrames();
+    sf_count_t frameIncrement = totalFrames/this->width();
+
+    if(frameIncrement < 1)
+    {
+        frameIncrement = 1;
+    }
+
+    double peak = 0.0;
+    vector<double> regionMax;
+    RegionStats stats;
+
+    for(sf_count_t i = 0; i < totalFrames; i += frameIncrement)
+    {
+        /* The RMS is gathered in the same pass as the peak.  A pixel does not need exact peaks, so the
+           seek index's bounds are used as they are. */
+        if(this->envelopeMode != NO_ENVELOPE)
+        {
+            if(!srcAudioFile->statsForRegion(i, min(i+frameIncrement, totalFrames), &stats, false))
+            {
+                break;
+            }
+            regionMax.assign(stats.peak, stats.peak + CHANNELS);
+            rms->insert(rms->end(), stats.rms, stats.rms + CHANNELS);
+        }
+        else
+        {
+            regionMax = srcAudioFile->peakForRegion(i, min(i+frameIncrement, totalFrames), false);
+        }
+        if((int) regionMax.size() < CHANNELS)
+        {
+            break;
+        }
+
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            double frameAbs = fabs(regionMax[c]);
+            peaks->push_back(frameAbs);
+            peak = max(peak, frameAbs);
+        }
+    }
+
+    return peak;
+}
+
+/*
+the macroDraw drawing function takes into account every single sample in the region of
+the source audio file to be drawn in the body of the widget.  It maintains an optimal position
+for every sample, and rounds this to the nearest integer (because there are no pixels with
+non-integer indices) for drawing.
+*/
+void WaveformRenderer::macroDraw(QPainter *painter, int minX, int maxX)
+{
+    PERF_SCOPE("WaveformRenderer::macroDraw");
+
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    sf_count_t startFrame = (sf_count_t) (((double)totalFrames)*(((double)minX)/((double)this->width())));
+    sf_count_t endFrame = (sf_count_t) (((double)totalFrames)*(((double)maxX)/((double)this->width())));
+
+    /*
+      Only the frames behind the exposed area are read.  Reading a frame before startFrame and a
+      couple past endFrame allows us to graph points just out of frame so that the line crosses
+      both edges of the area, rather than stop short of them; the area is often one strip of a
+      larger redraw, whose neighbours draw the rest of those lines.
+    */
+    sf_count_t firstFrame = max((sf_count_t) 0, startFrame - 1);
+    sf_count_t endFrameWithMargin = min(endFrame + 2, totalFrames);
+    vector<double> frames = this->srcAudioFile->getFrames(firstFrame, endFrameWithMargin - firstFrame);
+    this->dataVector.assign(frames.begin(), frames.end());
+    double optimalSpacing = ((double)this->width())/((double)totalFrames);
+    double firstPosition = firstFrame*optimalSpacing;
+
+    bool drawIndividualSamples = false;
+
+    QPen linePen(this->waveformColor, LINE_WIDTH, Qt::SolidLine, Qt::RoundCap);
+    QPen pointPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap);
+
+    if(optimalSpacing > INDIVIDUAL_SAMPLE_DRAW_TOGGLE_POINT)
+    {
+        pointPen = QPen(this->waveformColor, POINT_SIZE, Qt::SolidLine, Qt::SquareCap);
+        drawIndividualSamples = true;
+    }
+
+    switch(this->srcAudioFile->getNumChannels())
+    {
+    case 2:
+        this->macroLines<2>(painter, firstPosition, optimalSpacing, linePen, pointPen, drawIndividualSamples);
+        break;
+    case 1:
+        this->macroLines<1>(painter, firstPosition, optimalSpacing, linePen, pointPen, drawIndividualSamples);
+        break;
+    }
+
+#ifdef DEBUG
+    qDebug()<<"width: "<<this->width()<<" \nv size: "<<this->dataVector.size()<<"\noptimal spacing "<<optimalSpacing;
+    qDebug()<<"audio file size: "<<this->srcAudioFile->getTotalFrames();
+#endif
+}
+
+/*
+  Meat of the macro drawing routine: steps through the frames of the dataVector, one optimal
+  position apart, and draws a line from the previous sample to the current one in the lane of
+  each channel.
+*/
+template<int CHANNELS>
+void WaveformRenderer::macroLines(QPainter *painter, double optimalPosition, double optimalSpacing, QPen linePen, QPen pointPen, bool drawIndividualSamples)
+{
+    int extent = this->height()/(2*CHANNELS);
+    int channelYMidpoint[CHANNELS];
+    for(int c = 0; c < CHANNELS; c++)
+    {
+        channelYMidpoint[c] = this->height()/2 + (2*c + 1 - CHANNELS)*extent;
+    }
+
+    sf_count_t endFrame = (sf_count_t) this->dataVector.size()/CHANNELS;
+    if(endFrame < 1)
+    {
+        return;
+    }
+
+    const double *frame = &this->dataVector[0];
+    const double *prevFrame = frame;
+    double prevOptimalPosition = optimalPosition;
+
+    for(sf_count_t i = 0; i < endFrame; i++, frame += CHANNELS)
+    {
+        /*
+            If our zoom-level is such that it would be useful to see blocks
+            representing individual samples, draw such blocks:
+        */
+        if(drawIndividualSamples == true)
+        {
+            painter->setPen(pointPen);
+            for(int c = 0; c < CHANNELS; c++)
+            {
+                painter->drawPoint(QPoint(MathUtil::round(optimalPosition), channelYMidpoint[c]+(extent*frame[c]*scaleFactor)));
+            }
+        }
+
+        /*
+            Draw lines from previous samples to current samples:
+        */
+        painter->setPen(linePen);
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            painter->drawLine(MathUtil::round(prevOptimalPosition), channelYMidpoint[c]+(extent*prevFrame[c]*scaleFactor), MathUtil::round(optimalPosition), channelYMidpoint[c]+(extent*frame[c]*scaleFactor));
+        }
+
+        prevFrame = frame;
+        prevOptimalPosition = optimalPosition;
+        optimalPosition += optimalSpacing;
+    }
+}
+
+/*
+    The overview drawing function works with the peakVector, which contains the peak value
+    for every region (and each channel) of the source audio file to be represented by a single
+    pixel of the widget.  The function steps through this vector and draws two vertical bars
+    for each such value -- one above the Y-axis midpoint for the channel, and one below.
+*/
+void WaveformRenderer::overviewDraw(QPainter *painter, int minX, int maxX)
+{
+    PERF_SCOPE("WaveformRenderer::overviewDraw");
+
+    QPen waveformPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap);
+    QPen envelopePen(this->envelopeColor, 1, Qt::SolidLine, Qt::RoundCap);
+    painter->setPen(waveformPen);
+
+    switch(this->srcAudioFile->getNumChannels())
+    {
+    case 2:
+        this->overviewColumns<2>(painter, minX, maxX, waveformPen, envelopePen);
+        break;
+    case 1:
+        this->overviewColumns<1>(painter, minX, maxX, waveformPen, envelopePen);
+        break;
+    }
+}
+
+/*
+    Grabs the peak values of each channel for each region to be represented by a pixel in the
+    visible portion of the widget, scales them, and draws them around the midpoint of the
+    channel's lane.
+*/
+template<int CHANNELS>
+void WaveformRenderer::overviewColumns(QPainter *painter, int minX, int maxX, QPen waveformPen, QPen envelopePen)
+{
+    int extent = this->height()/4;
+    int channelYMidpoint[CHANNELS];
+    for(int c = 0; c < CHANNELS; c++)
+    {
+        channelYMidpoint[c] = this->height()/2 + (2*c + 1 - CHANNELS)*(this->height()/(2*CHANNELS));
+    }
+
+    int endIndex = min(maxX, (int) this->peakVector.size()/CHANNELS);
+    bool drawEnvelope = (this->envelopeMode == INNER_ENVELOPE);
+
+    for(int i = minX; i < endIndex; i++)
+    {
+        const uint16_t *peak = &this->peakVector[i*CHANNELS];
+        for(int c = 0; c < CHANNELS; c++)
+        {
+            double height = extent*peak[c]*this->columnStep*scaleFactor;
+            painter->drawLine(i, channelYMidpoint[c], i, channelYMidpoint[c]+height);
+            painter->drawLine(i, channelYMidpoint[c], i, channelYMidpoint[c]-height);
+        }
+
+        if(drawEnvelope && (i + 1)*CHANNELS <= (int) this->rmsVector.size())
+        {
+            const uint16_t *rms = &this->rmsVector[i*CHANNELS];
+            painter->setPen(envelopePen);
+            for(int c = 0; c < CHANNELS; c++)
+            {
+                double height = extent*rms[c]*this->columnStep*scaleFactor;
+                painter->drawLine(i, channelYMidpoint[c]-height, i, channelYMidpoint[c]+height);
+            }
+            painter->setPen(waveformPen);
+        }
+    }
+}
+
+/*
+    The lane under the waveform plots, for every column, the short-term loudness at the middle of
+    the column and, in overview mode, the RMS level of the loudest channel, on a decibel scale from
+    ENVELOPE_LANE_FLOOR_DB at the bottom of the lane to 0 dB at its top.  The loudness is looked up
+    per column in constant time, so nothing is cached for it.
+*/
+void WaveformRenderer::laneDraw(QPainter *painter, int minX, int maxX)
+{
+    PERF_SCOPE("WaveformRenderer::laneDraw");
+
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    int numChannels = this->srcAudioFile->getNumChannels();
+    sf_count_t halfWindow = (sf_count_t) SHORT_TERM_LOUDNESS_SECONDS * this->srcAudioFile->getSampleRate() / 2;
+    maxX = min(maxX, this->width());
+
+    painter->setPen(QPen(this->waveformColor.lighter(), 1, Qt::DotLine));
+    painter->drawLine(minX, this->height(), maxX, this->height());
+
+    QPen rmsPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap);
+    QPen loudnessPen(this->envelopeColor, 1, Qt::SolidLine, Qt::RoundCap);
+    int prevRmsY = -1;
+    int prevLoudnessY = -1;
+
+    for(int x = max(minX - 1, 0); x < maxX; x++)
+    {
+        if(this->currentDrawingMode == OVERVIEW && (x + 1) * numChannels <= (int) this->rmsVector.size())
+        {
+            double rms = this->rmsVector.at(x * numChannels) * this->columnStep;
+            if(numChannels == 2)
+            {
+                rms = max(rms, this->rmsVector.at(x * numChannels + 1) * this->columnStep);
+            }
+            int y = this->laneY(rms > 0.0 ? 20.0 * log10(rms) : ENVELOPE_LANE_FLOOR_DB);
+            if(prevRmsY >= 0)
+            {
+                painter->setPen(rmsPen);
+                painter->drawLine(x - 1, prevRmsY, x, y);
+            }
+            prevRmsY = y;
+        }
+
+        double lufs;
+        sf_count_t centerFrame = (sf_count_t) ((x + 0.5) * totalFrames / this->width());
+        if(this->srcAudioFile->shortTermLoudness(min(centerFrame + halfWindow, totalFrames), &lufs))
+        {
+            int y = this->laneY(lufs);
+            if(prevLoudnessY >= 0)
+            {
+                painter->setPen(loudnessPen);
+                painter->drawLine(x - 1, prevLoudnessY, x, y);
+            }
+            prevLoudnessY = y;
+        }
+        else
+        {
+            /* No seek index: there is no loudness to show. */
+            break;
+        }
+    }
+}
+
+/* Maps a level in dB to a y coordinate inside the lane. */
+int WaveformRenderer::laneY(double decibels)
+{
+    double position = min(1.0, max(0.0, decibels / ENVELOPE_LANE_FLOOR_DB));
+    return this->height() + 1 + (int) (position * (this->laneHeight() - 2));
+}
+
+/*
+    Draws the spectrogram tiles covering the exposed columns and requests them from the cache, which
+    cancels whatever it was computing for another part of the file or another zoom level.  Where a
+    tile is not ready yet, the first cached tile with a hop 2, 4, 8 or 16 times as long is stretched
+    over its place, so zooming in shows a blurred picture at once rather than a blank.
+*/
+void WaveformRenderer::spectrogramDraw(QPainter *painter, int minX, int maxX)
+{
+    PERF_SCOPE("WaveformRenderer::spectrogramDraw");
+
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    double framesPerPixel = ((double) totalFrames) / this->width();
+    sf_count_t hop = SpectrogramTileCache::hopForZoom(framesPerPixel);
+    sf_count_t tileFrames = hop * SPECTROGRAM_TILE_COLUMNS;
+
+    minX = max(minX, 0);
+    maxX = min(maxX, this->width());
+    if(minX >= maxX)
+    {
+        return;
+    }
+    sf_count_t firstTile = (sf_count_t) (minX * framesPerPixel) / tileFrames;
+    sf_count_t lastTile = min((sf_count_t) (maxX * framesPerPixel), totalFrames - 1) / tileFrames;
+    this->spectrogramTiles->request(hop, firstTile, lastTile);
+
+    for(sf_count_t t = firstTile; t <= lastTile; t++)
+    {
+        double left = max((double) minX, t * tileFrames / framesPerPixel);
+        double right = min((double) maxX, (t + 1) * tileFrames / framesPerPixel);
+
+        if(this->drawSpectrogramTile(painter, hop, t, left, right))
+        {
+            continue;
+        }
+        PERF_COUNT("WaveformRenderer::spectrogramTileMiss");
+        for(int level = 1; level <= 4; level++)
+        {
+            sf_count_t coarseHop = hop << level;
+            if(this->drawSpectrogramTile(painter, coarseHop, t * tileFrames / (coarseHop * SPECTROGRAM_TILE_COLUMNS), left, right))
+            {
+                break;
+            }
+        }
+    }
+}
+
+/*
+    Draws the part of a cached tile that falls between the columns left and right.  Returns false,
+    drawing nothing, if the tile is not cached.
+*/
+bool WaveformRenderer::drawSpectrogramTile(QPainter *painter, sf_count_t hop, sf_count_t index, double left, double right)
+{
+    QImage tile;
+    if(!this->spectrogramTiles->getTile(hop, index, &tile))
+    {
+        return false;
+    }
+
+    double framesPerPixel = ((double) this->srcAudioFile->getTotalFrames()) / this->width();
+    double tileLeft = index * hop * SPECTROGRAM_TILE_COLUMNS / framesPerPixel;
+    double columnsPerPixel = framesPerPixel / hop;
+    QRectF source((left - tileLeft) * columnsPerPixel, 0, (right - left) * columnsPerPixel, tile.height());
+    painter->drawImage(QRectF(left, 0, right - left, this->height()), tile, source);
+    return true;
+}
+
+/*
+This function determines which drawing mode the renderer should be operating in based on
+the size of its drawing area and the size of the audio file that it visualizes.
+*/
+void WaveformRenderer::establishDrawingMode()
+{
+    PERF_SCOPE("WaveformRenderer::establishDrawingMode");
+
+    sf_count_t audioFileSize = this->srcAudioFile->getTotalFrames();
+
+    if(this->viewMode == SPECTROGRAM_VIEW)
+    {
+        this->currentDrawingMode = SPECTROGRAM;
+        this->lastSize = this->size;
+        return;
+    }
+
+    if(this->currentDrawingMode == NO_MODE)
+    {
+        if(this->width() < audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
+        {
+            PERF_COUNT("WaveformRenderer::transitionToOverview");
+            this->currentDrawingMode = OVERVIEW;
+            this->recalculatePeaks();
+        }else
+        {
+            PERF_COUNT("WaveformRenderer::transitionToMacro");
+            this->currentDrawingMode = MACRO;
+            this->setScaleForPeak(MathUtil::getVAbsMax(this->srcAudioFile->calculateNormalizedPeaks()));
+        }
+    }
+
+    if(this->currentDrawingMode != MACRO && this->width() >= audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
+    {
+        PERF_COUNT("WaveformRenderer::transitionToMacro");
+        this->currentDrawingMode = MACRO;
+        this->setScaleForPeak(MathUtil::getVAbsMax(this->srcAudioFile->calculateNormalizedPeaks()));
+    }
+
+    if(this->currentDrawingMode == MACRO && this->width() < audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
+    {
+        PERF_COUNT("WaveformRenderer::transitionToOverview");
+        this->currentDrawingMode = OVERVIEW;
+    }
+
+    if(this->size!=this->lastSize && this->currentDrawingMode != MACRO)
+    {
+        this->recalculatePeaks();
+    }
+
+    this->lastSize = this->size;
+
+}
@@ -0,0 +1,114 @@
+#ifndef WAVEFORMRENDERER_H
+#define WAVEFORMRENDERER_H
+
+#include "AudioUtil.h"
+#include "MathUtil.h"
+#include "PerfStats.h"
+#include "SpectrogramTileCache.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include <QSize>
+#include <QRect>
+#include <QColor>
+#include <QPainter>
+#include <QPoint>
+#include <QImage>
+#include <QRectF>
+#include <QDebug>
+
+/*!
+    \file WaveformRenderer.h
+    \brief WaveformRenderer header file.
+*/
+
+using namespace std;
+
+/*!
+\brief Draws the waveform of an audio file onto any QPainter.
+
+WaveformRenderer holds the drawing state and routines behind WaveformWidget, but does not depend on a widget or
+a display: it can paint into a QImage just as well as into a widget, which is what the headless batch renderer
+does.  A renderer draws the audio file wrapped by an AudioUtil instance that it does not own.
+
+To draw, give the renderer the size of the target area with setSize() and call render() with the region that
+needs painting.  The renderer picks its drawing mode and (re)calculates its peak data on demand.
+
+With setEnvelopeMode(), the renderer also shows how loud the audio is rather than just how high its peaks are: the
+RMS of each column, drawn inside the peaks, or a separate lane under the waveform with the short-term loudness and
+the RMS level on a decibel scale.  Both come from the data AudioUtil gathers while reading the file, so they cost a
+few lookups per column.
+
+With setViewMode(SPECTROGRAM_VIEW), the renderer draws a spectrogram instead of the waveform.  The spectrogram is
+computed lazily, in tiles, on worker threads by a SpectrogramTileCache: render() draws the tiles that are ready
+(or, in their place, coarser tiles computed at a lower zoom level) and requests the rest.  The owner is told that a
+tile is ready through the cache's tileReady() signal, and should render again.
+*/
+class WaveformRenderer
+{
+public:
+    WaveformRenderer(AudioUtil *audioFile);
+    ~WaveformRenderer();
+    enum DrawingMode {OVERVIEW, MACRO, SPECTROGRAM, NO_MODE};
+    enum ViewMode {WAVEFORM_VIEW, SPECTROGRAM_VIEW};
+    enum EnvelopeMode {NO_ENVELOPE, INNER_ENVELOPE, ENVELOPE_LANE};
+    void reset();
+    void setSize(QSize size);
+    QSize getSize();
+    void setColor(QColor color);
+    QColor getColor();
+    DrawingMode getDrawingMode();
+    void setEnvelopeMode(EnvelopeMode mode);
+    EnvelopeMode getEnvelopeMode();
+    void setEnvelopeColor(QColor color);
+    QColor getEnvelopeColor();
+    void setViewMode(ViewMode mode);
+    ViewMode getViewMode();
+    void setFFTSize(int size);
+    int getFFTSize();
+    SpectrogramTileCache *getSpectrogramTiles();
+    void cancelSpectrogram();
+    bool isPrepared();
+    MemoryAccount *getMemoryAccount();
+    void render(QPainter *painter, QRect exposed);
+    void renderSketch(QPainter *painter, QSize size, const vector<double> &columnPeaks, int numChannels, int exactColumns);
+
+private:
+    AudioUtil *srcAudioFile;
+    DrawingMode currentDrawingMode;
+    MemoryAccount memoryAccount;
+    CacheVector<uint16_t> peakVector;
+    CacheVector<uint16_t> rmsVector;
+    double columnStep;
+    CacheVector<double> dataVector;
+    double padding;
+    double scaleFactor;
+    QSize size;
+    QSize lastSize;
+    QColor waveformColor;
+    EnvelopeMode envelopeMode;
+    QColor envelopeColor;
+    ViewMode viewMode;
+    SpectrogramTileCache *spectrogramTiles;
+
+    int width();
+    int height();
+    int laneHeight();
+    void setScaleForPeak(double peak);
+    void recalculatePeaks();
+    template<int CHANNELS> double collectPeaks(vector<double> *peaks, vector<double> *rms);
+    void encodeColumns(const vector<double> &values, CacheVector<uint16_t> *codes);
+    void establishDrawingMode();
+    void macroDraw(QPainter *painter, int minX, int maxX);
+    template<int CHANNELS> void macroLines(QPainter *painter, double optimalPosition, double optimalSpacing, QPen linePen, QPen pointPen, bool drawIndividualSamples);
+    void overviewDraw(QPainter *painter, int minX, int maxX);
+    template<int CHANNELS> void overviewColumns(QPainter *painter, int minX, int maxX, QPen waveformPen, QPen envelopePen);
+    void laneDraw(QPainter *painter, int minX, int maxX);
+    void spectrogramDraw(QPainter *painter, int minX, int maxX);
+    bool drawSpectrogramTile(QPainter *painter, sf_count_t hop, sf_count_t index, double left, double right);
+    int laneY(double decibels);
+};
+
+#endif // WAVEFORMRENDERER_H
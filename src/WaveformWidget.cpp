@@ -1,12 +1,5 @@
 #include "WaveformWidget.h"
 
-#define DEFAULT_PADDING 0.3
-#define LINE_WIDTH 1
-#define POINT_SIZE 5
-#define DEFAULT_COLOR Qt::blue
-#define INDIVIDUAL_SAMPLE_DRAW_TOGGLE_POINT 9.0
-#define MACRO_MODE_TOGGLE_CONSTANT 100.0
-
 /*!
 \file WaveformWidget.cpp
 \brief WaveformWidget implementation file.
@@ -32,73 +25,140 @@
 WaveformWidget::WaveformWidget(string filePath)
 {
     this->srcAudioFile = new AudioUtil();
+    this->renderer = new WaveformRenderer(this->srcAudioFile);
     this->audioFilePath = filePath;
-    this->currentFileHandlingMode = FULL_CACHE;
+    this->backgroundValid = false;
+    this->interimWidth = 0;
+    this->backgroundGeneration = 0;
+    this->refinedGeneration = 0;
+    this->pendingGeneration = -1;
+    this->pendingLeft = 0;
+    this->pendingRight = 0;
+    this->renderTimer = new QTimer(this);
+    this->renderTimer->setSingleShot(true);
+    this->renderTimer->setInterval(RENDER_FRAME_INTERVAL);
+    QObject::connect(this->renderTimer, SIGNAL(timeout()), this, SLOT(renderFrame()));
+    this->refinementWatcher = new QFutureWatcher<void>(this);
+    QObject::connect(this->refinementWatcher, SIGNAL(finished()), this, SLOT(refinementFinished()));
+    QObject::connect(this->renderer->getSpectrogramTiles(), SIGNAL(tileReady()), this, SLOT(spectrogramTileReady()));
+    this->loadWatcher = new QFutureWatcher<void>(this);
+    QObject::connect(this->loadWatcher, SIGNAL(finished()), this, SLOT(loadFinished()));
+    this->loadProgressTimer = new QTimer(this);
+    this->loadProgressTimer->setInterval(LOAD_PROGRESS_INTERVAL);
+    QObject::connect(this->loadProgressTimer, SIGNAL(timeout()), this, SLOT(loadProgress()));
+    this->loadPending = false;
+    this->loading = false;
+    this->sketchExactColumns = 0;
+    this->sketchWidth = 0;
+    this->sketchStartFrame = 0;
+    this->sketchEndFrame = 0;
+    this->playheadFrame = -1;
+    this->selectionStart = 0;
+    this->selectionEnd = 0;
+    this->playheadColor = DEFAULT_PLAYHEAD_COLOR;
+    this->selectionColor = DEFAULT_SELECTION_COLOR;
+    this->markerColor = DEFAULT_MARKER_COLOR;
+    this->srcAudioFile->setReadAhead(true);
+    this->srcAudioFile->setReadHints(true);
+    this->setFileHandlingMode(FULL_CACHE);
     this->resetFile(this->audioFilePath);
-    this->scaleFactor = -1.0;
-    this->lastSize = this->size();
-    this->padding = DEFAULT_PADDING;
-    this->waveformColor = DEFAULT_COLOR;
 }
 
-/*The AudioUtil instance "srcAudioFile" is our only dynamically allocated object*/
+/*The AudioUtil instance "srcAudioFile" and the renderer drawing it are our only dynamically allocated objects*/
 WaveformWidget::~WaveformWidget()
 {
+    this->waitForRefinement();
+    this->waitForLoad();
+    delete this->renderer;
     delete this->srcAudioFile;
 }
 
 /*!
 \brief Reset the audio file to be visualized by this instance of WaveformWidget.
 
-An important consideration when invoking this function is the file-handling mode that you
-have set for the current instance of WaveformWidget.  If the instance of WaveformWidget is in FULL_CACHE mode,
-this function will take considerably longer to execute (posssibly as long as a few seconds for an audio file of several
-minutes' duration) as the entirety of the audio file to be visualized
-by the widget must be loaded into memory.
+Only the header of the file is read here.  The file is loaded, in FULL_CACHE or COMPRESSED_CACHE mode into memory,
+on a worker thread when the widget is first painted, and a sketch of the waveform is shown until it is done.  If a
+previous file is still loading, this function waits for it first.
 @param fileName Valid path to a WAV file
 */
 void WaveformWidget::resetFile(string fileName)
 {
+    this->waitForRefinement();
+    this->waitForLoad();
+    this->renderer->cancelSpectrogram();
     this->audioFilePath = fileName;
-    this->srcAudioFile->setFile(audioFilePath);
-
-    switch(this->currentFileHandlingMode)
-    {
-        case FULL_CACHE:
-            this->srcAudioFile->setFileHandlingMode(AudioUtil::FULL_CACHE);
+    this->renderer->reset();
+    this->loadPending = this->srcAudioFile->openFile(audioFilePath);
 
-        case DISK_MODE:
-            this->srcAudioFile->setFileHandlingMode(AudioUtil::DISK_MODE);
-    }
-
-    this->peakVector.clear();
-    this->dataVector.clear();
-    this->currentDrawingMode = NO_MODE;
-    this->establishDrawingMode();
+    this->invalidateBackground();
+    this->interimLayer = QImage();
     this->repaint();
+    emit peaksChanged();
+    emit viewChanged();
  }
 
+/*!
+  \brief Shows the file through an edit list, as cut, spliced and scaled by it (see AudioUtil::setEdits()).
+
+The peaks are looked up again through the list, from the cache and seek index the file already has, so nothing is
+read or loaded again.  The playhead, selection and markers are left where they are, in frames of the edited file.
+
+@param edits A list made for the file shown.
+@return false if the list was made for a file of another length.
+*/
+bool WaveformWidget::setEdits(EditList edits)
+{
+    this->waitForRefinement();
+    this->waitForLoad();
+    this->renderer->cancelSpectrogram();
+    if(!this->srcAudioFile->setEdits(edits))
+    {
+        return false;
+    }
+    this->renderer->reset();
+
+    this->invalidateBackground();
+    this->interimLayer = QImage();
+    this->update();
+    emit peaksChanged();
+    emit viewChanged();
+    return true;
+}
+
 /*!
   \brief Mutator for the file-handling mode of a given instance of WaveformWidget.
 
 An instance of WaveformWidget relies on an AudioUtil object to do much of the analysis of the audio file
-that it visualizes.  This AudioUtil object can function in one of two modes: DISK_MODE or FULL_CACHE.
+that it visualizes.  This AudioUtil object can function in one of three modes: DISK_MODE, FULL_CACHE or
+COMPRESSED_CACHE.
 For a comprehensive outline of the benefits and drawbacks of each mode, see the documentation for
 AudioUtil::setFileHandlingMode(FileHandlingMode mode).
 
-@param mode The desired file-handling mode.  Valid options: WaveformWidget::FULL_CACHE, WaveformWidget::DISK_MODE
+Changing the mode of a widget that already shows a file loads the file's cache for the new mode right away.
+
+@param mode The desired file-handling mode.  Valid options: WaveformWidget::FULL_CACHE, WaveformWidget::DISK_MODE,
+WaveformWidget::COMPRESSED_CACHE
 */
 void WaveformWidget::setFileHandlingMode(FileHandlingMode mode)
 {
+    this->waitForRefinement();
+    this->waitForLoad();
+    this->renderer->cancelSpectrogram();
     this->currentFileHandlingMode = mode;
 
     switch (this->currentFileHandlingMode)
     {
         case FULL_CACHE:
             this->srcAudioFile->setFileHandlingMode(AudioUtil::FULL_CACHE);
+            break;
 
         case DISK_MODE:
             this->srcAudioFile->setFileHandlingMode(AudioUtil::DISK_MODE);
+            break;
+
+        case COMPRESSED_CACHE:
+            this->srcAudioFile->setFileHandlingMode(AudioUtil::COMPRESSED_CACHE);
+            break;
     }
 }
 
@@ -112,353 +172,845 @@ WaveformWidget::FileHandlingMode WaveformWidget::getFileHandlingMode()
     return this->currentFileHandlingMode;
 }
 
-void WaveformWidget::recalculatePeaks()
+/*!
+\brief Bytes of memory held by the caches of the widget's file and renderer.
+
+The breakdown by MemoryTier, across every widget of the process, is given by MemoryAccount::report().
+*/
+size_t WaveformWidget::getCacheBytes()
+{
+    return this->srcAudioFile->getMemoryAccount()->getTotalBytes() + this->renderer->getMemoryAccount()->getTotalBytes();
+}
+
+void WaveformWidget::paintEvent( QPaintEvent * event )
 {
-    /*calculate scale factor*/
-    vector<double> normPeak = srcAudioFile->calculateNormalizedPeaks();
-    double peak = MathUtil::getVMax(normPeak);
-    this->scaleFactor = 1.0/peak;
-    this->scaleFactor = scaleFactor - scaleFactor * this->padding;
+    PERF_SCOPE("WaveformWidget::paintEvent");
 
-    /*calculate frame-grab increments*/
-    int totalFrames = srcAudioFile->getTotalFrames();
-    int frameIncrement = totalFrames/this->width();
+#ifdef DEBUG
+    char m[200];
+    sprintf(m, "widget width: %d\naudio file size in frames:%lld\n", this->width(), (long long) this->srcAudioFile->getTotalFrames());
+    qDebug()<<m;
+#endif
+
+    QRect exposed = event->region().boundingRect();
+    QPainter painter(this);
 
+    /* In DISK_MODE, the file is read ahead in the direction the exposed area is moving. */
+    this->srcAudioFile->hintAccess(this->xToFrame(exposed.center().x()));
 
-    if(this->currentDrawingMode != MACRO)
+    if(this->loadPending)
     {
-        if(srcAudioFile->getNumChannels() == 2)
-        {
-            this->peakVector.clear();
+        this->startLoad(exposed);
+    }
+    if(this->loading)
+    {
+        this->drawSketch(&painter, exposed);
+        this->drawOverlay(&painter, exposed);
+        return;
+    }
 
-            vector<double> regionMax;
+    this->renderExposed = exposed;
+    if(this->backgroundValid && this->backgroundRect.contains(exposed))
+    {
+        PERF_COUNT("WaveformWidget::backgroundHit");
+        painter.drawImage(exposed, this->backgroundLayer, exposed.translated(-this->backgroundRect.x(), -this->backgroundRect.y()));
+        this->drawOverlay(&painter, exposed);
+        return;
+    }
 
-            /*
-              Populate the peakVector with peak values for each region of the source audio
-              file to be represented by a single pixel of the widget.
-            */
+    /*
+      The layer is stale, or was scrolled out of: show the strips the scheduler has drawn so far and
+      the previous layer in place of the rest, and leave the drawing to the scheduler.
+    */
+    if(this->backgroundValid)
+    {
+        this->invalidateBackground();
+    }
+    this->scheduleRender();
 
-            for(int i = 0; i < totalFrames; i += frameIncrement)
+    QRect drawn;
+    if(!this->pendingLayer.isNull() && this->pendingGeneration == this->backgroundGeneration)
+    {
+        drawn = QRect(this->pendingLeft, 0, this->pendingRight - this->pendingLeft, this->height()).intersected(exposed);
+    }
+    if(!this->interimLayer.isNull())
+    {
+        if(drawn.isEmpty())
+        {
+            this->drawInterim(&painter, exposed);
+        }
+        else
+        {
+            if(drawn.left() > exposed.left())
             {
-                regionMax = srcAudioFile->peakForRegion(i, i+frameIncrement);
-                double frameAbsL = fabs(regionMax[0]);
-                double frameAbsR = fabs(regionMax[1]);
-
-                this->peakVector.push_back(frameAbsL);
-                this->peakVector.push_back(frameAbsR);
+                this->drawInterim(&painter, QRect(exposed.left(), exposed.top(), drawn.left() - exposed.left(), exposed.height()));
+            }
+            if(drawn.right() < exposed.right())
+            {
+                this->drawInterim(&painter, QRect(drawn.right() + 1, exposed.top(), exposed.right() - drawn.right(), exposed.height()));
             }
         }
+    }
+    if(!drawn.isEmpty())
+    {
+        painter.drawImage(drawn, this->pendingLayer, drawn.translated(-this->pendingRect.x(), -this->pendingRect.y()));
+    }
+    this->drawOverlay(&painter, exposed);
 
-        if(this->srcAudioFile->getNumChannels() == 1)
-        {
+#ifdef DEBUG
+    if(this->renderer->getDrawingMode() == WaveformRenderer::MACRO)
+        qDebug()<<"mode : MACRO\n";
+    if(this->renderer->getDrawingMode() == WaveformRenderer::OVERVIEW)
+       qDebug()<<"mode: OVERVIEW\n";
+#endif
+}
+
+/*!
+    \brief Mutator for waveform color.
+
+    @param The desired color for the waveform visualization.
+*/
+void WaveformWidget::setColor(QColor color)
+{
+    this->waitForRefinement();
+    this->renderer->setColor(color);
+    this->invalidateBackground();
+    this->update();
+}
 
-            this->peakVector.clear();
-            vector<double> regionMax;
+/*!
+    \brief Shows the RMS and loudness of the audio along with its peaks.  See WaveformRenderer::setEnvelopeMode().
+*/
+void WaveformWidget::setEnvelopeMode(WaveformRenderer::EnvelopeMode mode)
+{
+    this->waitForRefinement();
+    this->renderer->setEnvelopeMode(mode);
+    this->invalidateBackground();
+    this->update();
+}
 
-            /*
-              Populate the peakVector with peak values for each region of the source audio
-              file to be represented by a single pixel of the widget.
-            */
+/*!
+    \brief Accessor for the envelope mode.
+*/
+WaveformRenderer::EnvelopeMode WaveformWidget::getEnvelopeMode()
+{
+    return this->renderer->getEnvelopeMode();
+}
 
-            for(int i = 0; i < totalFrames; i += frameIncrement)
-            {
-                regionMax = srcAudioFile->peakForRegion(i, i+frameIncrement);
-                double frameAbs = fabs(regionMax[0]);
+/*!
+    \brief Mutator for the color of the RMS envelope and the loudness curve.
+*/
+void WaveformWidget::setEnvelopeColor(QColor color)
+{
+    this->waitForRefinement();
+    this->renderer->setEnvelopeColor(color);
+    this->invalidateBackground();
+    this->update();
+}
 
-                this->peakVector.push_back(frameAbs);
-            }
-        }
+/*!
+    \brief Shows the waveform (WaveformRenderer::WAVEFORM_VIEW) or the spectrogram (WaveformRenderer::SPECTROGRAM_VIEW)
+    of the file.
+*/
+void WaveformWidget::setViewMode(WaveformRenderer::ViewMode mode)
+{
+    this->waitForRefinement();
+    this->renderer->setViewMode(mode);
+    this->invalidateBackground();
+    this->update();
+}
+
+/*!
+    \brief Accessor for the view mode.
+*/
+WaveformRenderer::ViewMode WaveformWidget::getViewMode()
+{
+    return this->renderer->getViewMode();
+}
+
+/*!
+    \brief Sets the FFT size of the spectrogram: larger sizes resolve frequencies more finely and time more coarsely.
+    See SpectrogramTileCache::setFFTSize().
+*/
+void WaveformWidget::setFFTSize(int size)
+{
+    this->waitForRefinement();
+    this->renderer->setFFTSize(size);
+    this->invalidateBackground();
+    this->update();
+}
+
+/*!
+    \brief Moves the playhead.
+
+    Only the columns under the old and the new playhead are repainted, so this can be called at display rate.
+
+    @param frame The frame of the wrapped file under the playhead, or -1 to hide it.
+*/
+void WaveformWidget::setPlayheadPosition(sf_count_t frame)
+{
+    if(frame == this->playheadFrame)
+    {
+        return;
+    }
+    if(this->playheadFrame >= 0)
+    {
+        int x = this->frameToX(this->playheadFrame);
+        this->updateColumns(x, x);
+    }
+    this->playheadFrame = frame;
+    if(this->playheadFrame >= 0)
+    {
+        int x = this->frameToX(this->playheadFrame);
+        this->updateColumns(x, x);
+        this->srcAudioFile->hintAccess(this->playheadFrame);
     }
 }
 
-void WaveformWidget::paintEvent( QPaintEvent * event )
+/*!
+    \brief Accessor for the playhead position.
+
+    @return The frame under the playhead, or -1 if it is hidden.
+*/
+sf_count_t WaveformWidget::getPlayheadPosition()
 {
+    return this->playheadFrame;
+}
 
-#ifdef DEBUG
-    char m[200];
-    sprintf(m, "widget width: %d\naudio file size in frames:%d\n", this->width(), this->srcAudioFile->getTotalFrames());
-    qDebug()<<m;
-#endif
+/*!
+    \brief Highlights the frames [startFrame, endFrame).
+
+    Only the columns between the old and the new edges of the selection are repainted.
 
-    this->establishDrawingMode();
+    @param startFrame First selected frame.
+    @param endFrame Frame just past the selection.
+*/
+void WaveformWidget::setSelection(sf_count_t startFrame, sf_count_t endFrame)
+{
+    if(endFrame < startFrame)
+    {
+        swap(startFrame, endFrame);
+    }
 
-    if(this->currentDrawingMode == OVERVIEW)
+    if(this->selectionStart == this->selectionEnd)
+    {
+        this->updateColumns(this->frameToX(startFrame), this->frameToX(endFrame));
+    }
+    else if(startFrame == endFrame)
     {
-        this->overviewDraw(event);
+        this->updateColumns(this->frameToX(this->selectionStart), this->frameToX(this->selectionEnd));
     }
-    else if(this->currentDrawingMode == MACRO)
+    else
     {
-        this->macroDraw(event);
+        this->updateColumns(this->frameToX(this->selectionStart), this->frameToX(startFrame));
+        this->updateColumns(this->frameToX(this->selectionEnd), this->frameToX(endFrame));
     }
 
-#ifdef DEBUG
-    if(currentMode == MACRO)
-        qDebug()<<"mode : MACRO\n";
-    if(currentMode==OVERVIEW)
-       qDebug()<<"mode: OVERVIEW\n";
-#endif
+    this->selectionStart = startFrame;
+    this->selectionEnd = endFrame;
 }
 
-/*
-the macroDraw drawing function takes into account every single sample in the region of
-the source audio file to be drawn in the body of the widget.  It maintains an optimal position
-for every sample, and rounds this to the nearest integer (because there are no pixels with
-non-integer indices) for drawing.
+/*!
+    \brief Removes the selection.
+*/
+void WaveformWidget::clearSelection()
+{
+    this->setSelection(0, 0);
+}
+
+/*!
+    \brief First frame of the selection.
+*/
+sf_count_t WaveformWidget::getSelectionStart()
+{
+    return this->selectionStart;
+}
+
+/*!
+    \brief Frame just past the selection.  Equal to getSelectionStart() when nothing is selected.
+*/
+sf_count_t WaveformWidget::getSelectionEnd()
+{
+    return this->selectionEnd;
+}
+
+/*!
+    \brief Adds a marker line at the given frame.
 */
-void WaveformWidget::macroDraw(QPaintEvent *event)
+void WaveformWidget::addMarker(sf_count_t frame)
 {
-    int yMidpoint = this->height()/2;
+    this->markers.push_back(frame);
+    int x = this->frameToX(frame);
+    this->updateColumns(x, x);
+}
+
+/*!
+    \brief Removes all markers.
+*/
+void WaveformWidget::clearMarkers()
+{
+    for(size_t i = 0; i < this->markers.size(); i++)
+    {
+        int x = this->frameToX(this->markers[i]);
+        this->updateColumns(x, x);
+    }
+    this->markers.clear();
+}
 
-    int minX = event->region().boundingRect().x();
-    int maxX = event->region().boundingRect().x() + event->region().boundingRect().width();
+/*!
+    \brief The frames at which markers are drawn.
+*/
+vector<sf_count_t> WaveformWidget::getMarkers()
+{
+    return this->markers;
+}
 
-    int startFrame = (int) ((double)this->srcAudioFile->getTotalFrames())*(((double)minX)/((double)this->width()));
-    int endFrame = (int) ((double)this->srcAudioFile->getTotalFrames())*(((double)maxX)/((double)this->width()));
+/*!
+    \brief Mutator for the playhead color.
+*/
+void WaveformWidget::setPlayheadColor(QColor color)
+{
+    this->playheadColor = color;
+    this->update();
+}
 
-    bool drawIndividualSamples = false;
+/*!
+    \brief Mutator for the selection color.  A translucent color lets the waveform show through.
+*/
+void WaveformWidget::setSelectionColor(QColor color)
+{
+    this->selectionColor = color;
+    this->update();
+}
 
-    QPainter linePainter(this);
-    QPainter pointPainter(this);
-    linePainter.setPen(QPen(this->waveformColor, LINE_WIDTH, Qt::SolidLine, Qt::RoundCap));
-    pointPainter.setPen(QPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap));
+/*!
+    \brief Mutator for the marker color.
+*/
+void WaveformWidget::setMarkerColor(QColor color)
+{
+    this->markerColor = color;
+    this->update();
+}
 
-    double optimalPosition = (double) minX;
-    double prevOptimalPosition = optimalPosition;
+/*!
+    \brief The AudioUtil instance the widget reads its file through.
 
-    /* Double-channel macro drawing routine:*/
+    Other views of the same file can read it too, instead of opening the file again: everything it has loaded and
+    indexed is shared.  While isLoading(), only AudioUtil::loadedPeaks() may be called on it.
+*/
+AudioUtil *WaveformWidget::getAudioUtil()
+{
+    return this->srcAudioFile;
+}
 
-    if(this->srcAudioFile->getNumChannels()==2)
+/*!
+    \brief Whether the file is being loaded on a worker thread.
+*/
+bool WaveformWidget::isLoading()
+{
+    return this->loading;
+}
+
+/*!
+    \brief The frames of the file in view: those under the visible part of the widget, or the whole file if the
+    widget is hidden.
+
+    @param startFrame Receives the first frame in view.
+    @param endFrame Receives the frame just past the view.
+*/
+void WaveformWidget::getVisibleFrames(sf_count_t *startFrame, sf_count_t *endFrame)
+{
+    QRect visible = this->visibleRegion().boundingRect();
+    if(visible.isEmpty())
     {
-        int chan1YMidpoint = yMidpoint - this->height()/4;
-        int chan2YMidpoint = yMidpoint + this->height()/4;
+        visible = this->rect();
+    }
+    *startFrame = this->xToFrame(visible.left());
+    *endFrame = min(this->srcAudioFile->getTotalFrames(), this->xToFrame(visible.right() + 1));
+}
 
-        double optimalSpacing = ((double)this->width())/(((double)this->dataVector.size())/2);
-        if(optimalSpacing > INDIVIDUAL_SAMPLE_DRAW_TOGGLE_POINT)
-        {
-            pointPainter.setPen(QPen(this->waveformColor, POINT_SIZE, Qt::SolidLine, Qt::SquareCap));
-            drawIndividualSamples = true;
-        }
-        int startIndex = 2*startFrame;
-        int endIndex;
-
-        /*Reading the values in the dataVector four additional indices deep will
-          allow us to graph a few more points just out of frame so that
-          the line will surpass the right edge of the viewable area, rather
-          than stops short of it.  The same thing is done in the macroDraw routine for
-          single-channel audio further down as well*/
-        if(endFrame < this->srcAudioFile->getTotalFrames()-4)
-        {
-            endIndex = 2*endFrame + 4;
-        }
-        else{
-            endIndex = 2*endFrame;
-        }
-        double prevLChannelVal = this->dataVector.at(startIndex);
-        double prevRChannelVal = this->dataVector.at(startIndex+1);
+/*!
+    \brief Scrolls the QScrollArea the widget sits in so that the view starts at the given frame, or as close to it as
+    the scroll area allows.  Does nothing if the widget is not in a scroll area.
+*/
+void WaveformWidget::scrollToFrame(sf_count_t frame)
+{
+    QScrollArea *scrollArea = NULL;
+    if(this->parentWidget() != NULL)
+    {
+        scrollArea = qobject_cast<QScrollArea *>(this->parentWidget()->parentWidget());
+    }
+    if(scrollArea != NULL && scrollArea->widget() == this)
+    {
+        scrollArea->horizontalScrollBar()->setValue(this->frameToX(frame));
+    }
+}
+
+void WaveformWidget::resizeEvent(QResizeEvent *event)
+{
+    /*
+      Keep the last exact layer to stand in for the waveform until it has been drawn at the new
+      size.  If a refinement is still running, the older stand-in is kept.
+    */
+    if(this->backgroundValid && this->interimLayer.isNull() && event->oldSize().width() > 0)
+    {
+        this->interimLayer = this->backgroundLayer;
+        this->interimRect = this->backgroundRect;
+        this->interimWidth = event->oldSize().width();
+    }
+    this->invalidateBackground();
+    emit viewChanged();
+}
+
+/* A scroll area scrolls its widget by moving it. */
+void WaveformWidget::moveEvent(QMoveEvent *)
+{
+    emit viewChanged();
+}
 
 /*
-    Meat of the drawing routine:
+    Marks the cached waveform as stale; the render scheduler draws it again, and the stale layer
+    stands in for it until then.  A refinement that is still running is discarded when it finishes.
 */
-        for(int i = startIndex + 2; i < endIndex; i+=2)
-        {
-            double lChannelVal = this->dataVector.at(i);
-            double rChannelVal = this->dataVector.at(i+1);
-
-            /*
-                If our zoom-level is such that it would be useful to see blocks
-                representing individual samples, draw such blocks:
-            */
-            if(drawIndividualSamples == true)
-            {
-                pointPainter.drawPoint(QPoint(MathUtil::round(optimalPosition), chan1YMidpoint+((this->height()/4)*lChannelVal*scaleFactor)));
-                pointPainter.drawPoint(QPoint(MathUtil::round(optimalPosition), chan2YMidpoint+((this->height()/4)*rChannelVal*scaleFactor)));
-            }
+void WaveformWidget::invalidateBackground()
+{
+    if(this->backgroundValid && this->interimLayer.isNull())
+    {
+        this->interimLayer = this->backgroundLayer;
+        this->interimRect = this->backgroundRect;
+        this->interimWidth = this->width();
+    }
+    this->backgroundValid = false;
+    this->backgroundGeneration++;
+}
+
+/*
+    The part of the widget the background layer should cover.  The widget can be far wider than the
+    screen when it sits in a scroll area, so the layer only covers the visible part of the widget plus
+    one visible width on either side, which lets short scrolls be served from the layer too.
+*/
+QRect WaveformWidget::backgroundArea(QRect exposed)
+{
+    QRect visible = this->visibleRegion().boundingRect().united(exposed);
+    QRect area = visible.adjusted(-visible.width(), 0, visible.width(), 0).intersected(this->rect());
+    return QRect(area.x(), 0, area.width(), this->height());
+}
+
+/*
+    Asks for a frame of the render scheduler.  However often this is called before the frame, the
+    frame draws once, for the geometry of the widget at that time.
+*/
+void WaveformWidget::scheduleRender()
+{
+    if(!this->renderTimer->isActive())
+    {
+        this->renderTimer->start();
+    }
+}
 
-            /*
-                Draw lines from previous samples to current samples:
-            */
-            linePainter.drawLine(MathUtil::round(prevOptimalPosition), chan1YMidpoint+((this->height()/4)*prevLChannelVal*scaleFactor), MathUtil::round(optimalPosition), chan1YMidpoint+((this->height()/4)*lChannelVal*scaleFactor));
-            linePainter.drawLine(MathUtil::round(prevOptimalPosition), chan2YMidpoint+((this->height()/4)*prevRChannelVal*scaleFactor), MathUtil::round(optimalPosition), chan2YMidpoint+((this->height()/4)*rChannelVal*scaleFactor));
+/*
+    A frame of the render scheduler.  Draws strips of the background layer, the visible columns
+    first, until RENDER_FRAME_BUDGET milliseconds are spent, and asks for another frame if the layer
+    is not complete.  When the renderer has to go through the whole file before it can draw anything,
+    which cannot be split up, the layer is drawn by a refinement on a worker thread instead.
+*/
+void WaveformWidget::renderFrame()
+{
+    PERF_SCOPE("WaveformWidget::renderFrame");
 
+    /* loadFinished() and refinementFinished() ask for a frame again. */
+    if(this->loading || this->refinementWatcher->isRunning())
+    {
+        return;
+    }
+    if(this->backgroundValid && this->backgroundRect.contains(this->renderExposed))
+    {
+        return;
+    }
 
-            prevLChannelVal = lChannelVal;
-            prevRChannelVal = rChannelVal;
+    if(this->pendingLayer.isNull() || this->pendingGeneration != this->backgroundGeneration || !this->pendingRect.contains(this->renderExposed))
+    {
+        QRect area = this->backgroundArea(this->renderExposed);
+        if(area.isEmpty())
+        {
+            return;
+        }
 
-            prevOptimalPosition = optimalPosition;
-            optimalPosition += optimalSpacing;
+        this->renderer->setSize(this->size());
+        if(!this->renderer->isPrepared())
+        {
+            PERF_COUNT("WaveformWidget::deferredToRefinement");
+            this->pendingLayer = QImage();
+            this->startRefinement(area);
+            return;
         }
 
-#ifdef DEBUG
-        qDebug()<<"width: "<<this->width()<<" \nv size: "<<this->dataVector.size()<<"\noptimal spacing "<<optimalSpacing;
-        qDebug()<<"audio file size: "<<this->srcAudioFile->getTotalFrames();
-#endif
+        this->pendingLayer = QImage(area.size(), QImage::Format_ARGB32_Premultiplied);
+        this->pendingLayer.fill(0);
+        this->pendingRect = area;
+        this->pendingGeneration = this->backgroundGeneration;
+
+        /* The strips grow rightwards from the left edge of the view, then leftwards from it. */
+        QRect visible = this->visibleRegion().boundingRect();
+        int start = visible.isEmpty() ? this->renderExposed.left() : visible.left();
+        this->pendingLeft = max(area.left(), min(start, area.right() + 1));
+        this->pendingRight = this->pendingLeft;
     }
-    /*Single-channel macro drawing routine: */
-    else if(this->srcAudioFile->getNumChannels() == 1)
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    QPainter painter(&this->pendingLayer);
+    painter.translate(-this->pendingRect.x(), 0);
+    int areaLeft = this->pendingRect.left();
+    int areaEnd = this->pendingRect.right() + 1;
+    while(this->pendingLeft > areaLeft || this->pendingRight < areaEnd)
     {
-        double optimalSpacing = ((double)this->width())/(((double)this->dataVector.size()));
-        if(optimalSpacing > INDIVIDUAL_SAMPLE_DRAW_TOGGLE_POINT)
+        QRect strip;
+        if(this->pendingRight < areaEnd)
         {
-            pointPainter.setPen(QPen(this->waveformColor, POINT_SIZE, Qt::SolidLine, Qt::SquareCap));
-            drawIndividualSamples = true;
+            strip = QRect(this->pendingRight, 0, min(RENDER_STRIP_WIDTH, areaEnd - this->pendingRight), this->height());
+            this->pendingRight += strip.width();
         }
-        int startIndex = startFrame;
-        int endIndex;
-        if(endFrame < this->srcAudioFile->getTotalFrames()-2)
+        else
         {
-            endIndex = endFrame+2;
+            int left = max(areaLeft, this->pendingLeft - RENDER_STRIP_WIDTH);
+            strip = QRect(left, 0, this->pendingLeft - left, this->height());
+            this->pendingLeft = left;
         }
-        else{
-           endIndex = endFrame;
+
+        PERF_COUNT("WaveformWidget::renderStrip");
+        painter.setClipRect(strip);
+        this->renderer->render(&painter, strip);
+        this->update(strip);
+
+        if(frameTimer.elapsed() >= RENDER_FRAME_BUDGET)
+        {
+            break;
         }
+    }
+    painter.end();
 
-        double prevAudioDataVal = this->dataVector.at(startIndex);
+    if(this->pendingLeft > areaLeft || this->pendingRight < areaEnd)
+    {
+        this->renderTimer->start();
+        return;
+    }
+
+    this->backgroundLayer = this->pendingLayer;
+    this->backgroundRect = this->pendingRect;
+    this->backgroundValid = true;
+    this->interimLayer = QImage();
+    this->pendingLayer = QImage();
+}
 
 /*
-      Meat of the drawing routine:
+    Stretches the layer drawn before the last resize over the exposed columns: column x of the widget
+    shows column x*interimWidth/width() of the old layer.  Columns the old layer did not cover are left
+    empty until the refinement arrives.
 */
-        for(int i = startIndex; i < endIndex; i++)
-        {
-            double audioDataVal = this->dataVector.at(i);
-
-            /*
-                If our zoom-level is such that it would be useful to see blocks
-                representing individual samples, draw such blocks:
-            */
-            if(drawIndividualSamples == true){
-                pointPainter.drawPoint(QPoint(MathUtil::round(optimalPosition), yMidpoint+((this->height()/2)*audioDataVal*scaleFactor)));
-            }
-            /*
-                Draw a line from the previous sample to the current sample:
-            */
-            linePainter.drawLine(MathUtil::round(prevOptimalPosition), yMidpoint+((this->height()/2)*prevAudioDataVal*scaleFactor), MathUtil::round(optimalPosition), yMidpoint+((this->height()/2)*audioDataVal*scaleFactor));
+void WaveformWidget::drawInterim(QPainter *painter, QRect exposed)
+{
+    PERF_COUNT("WaveformWidget::interimFrame");
 
-            prevAudioDataVal = audioDataVal;
+    double ratio = ((double) this->interimWidth)/this->width();
+    QRectF source(exposed.x()*ratio - this->interimRect.x(), 0, exposed.width()*ratio, this->interimLayer.height());
+    QRectF target(exposed.x(), 0, exposed.width(), this->height());
+    painter->drawImage(target, this->interimLayer, source);
+}
 
-            prevOptimalPosition = optimalPosition;
-            optimalPosition += optimalSpacing;
-        }
+/*
+    Starts drawing the exact waveform of area, at the current size, on a worker thread, unless that is
+    already under way.  While it runs, the renderer belongs to the worker: the GUI thread only draws the
+    interim layer and the overlay, and anything else that needs the renderer waits for the worker first.
+*/
+void WaveformWidget::startRefinement(QRect area)
+{
+    if(this->refinementWatcher->isRunning())
+    {
+        return;
     }
 
+    this->refinedRect = area;
+    this->refinedSize = this->size();
+    this->refinedGeneration = this->backgroundGeneration;
+    this->refinementWatcher->setFuture(QtConcurrent::run(this, &WaveformWidget::refine));
 }
 
 /*
-    The overview drawing function works with the peakVector, which contains the peak value
-    for every region (and each channel) of the source audio file to be represented by a single
-    pixel of the widget.  The function steps through this vector and draws two vertical bars
-    for each such value -- one above the Y-axis midpoint for the channel, and one below.
+    Runs on the worker thread.
 */
-void WaveformWidget::overviewDraw(QPaintEvent *event)
+void WaveformWidget::refine()
 {
-    QPainter painter(this);
-    painter.setPen(QPen(this->waveformColor, 1, Qt::SolidLine, Qt::RoundCap));
+    PERF_SCOPE("WaveformWidget::refine");
 
-    int minX = event->region().boundingRect().x();
-    int maxX = event->region().boundingRect().x() + event->region().boundingRect().width();
+    QImage layer(this->refinedRect.size(), QImage::Format_ARGB32_Premultiplied);
+    layer.fill(0);
 
-    /*grab peak values for each region to be represented by a pixel in the visible
-    portion of the widget, scale them, and draw: */
-    if(this->srcAudioFile->getNumChannels() == 2)
-    {
+    QPainter painter(&layer);
+    painter.translate(-this->refinedRect.x(), 0);
+    this->renderer->setSize(this->refinedSize);
+    this->renderer->render(&painter, this->refinedRect);
+    painter.end();
 
-            int startIndex = 2*minX;
-            int endIndex = 2*maxX;
+    this->refinedLayer = layer;
+}
 
-            int yMidpoint = this->height()/2;
-            int counter = minX;
+/*
+    Sketches the part of the file around the exposed area from a sparse sample of it, on the GUI
+    thread, and starts loading the file on a worker thread.  Until the load has finished, the worker
+    owns the AudioUtil instance: the GUI thread only asks it for the peaks loaded so far.
+*/
+void WaveformWidget::startLoad(QRect exposed)
+{
+    PERF_SCOPE("WaveformWidget::startLoad");
 
-            for(int i = startIndex;  i < endIndex; i+=2)
-            {
+    this->loadPending = false;
+    this->sketchRect = this->backgroundArea(exposed);
+    this->sketchWidth = this->width();
+    this->sketchExactColumns = 0;
+    this->sketchPeaks.clear();
 
-                int chan1YMidpoint = yMidpoint - this->height()/4;
-                int chan2YMidpoint = yMidpoint + this->height()/4;
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    if(this->sketchWidth > 0 && !this->sketchRect.isEmpty())
+    {
+        this->sketchStartFrame = (sf_count_t) (((double) this->sketchRect.x()) * totalFrames / this->sketchWidth);
+        this->sketchEndFrame = (sf_count_t) (((double) this->sketchRect.x() + this->sketchRect.width()) * totalFrames / this->sketchWidth);
+        this->sketchPeaks = this->srcAudioFile->approximatePeaks(this->sketchStartFrame, this->sketchEndFrame, this->sketchRect.width());
+    }
+    this->updateSketch();
 
+    this->loading = true;
+    this->loadWatcher->setFuture(QtConcurrent::run(this, &WaveformWidget::load));
+    this->loadProgressTimer->start();
+}
 
-                painter.drawLine(counter, chan1YMidpoint, counter, chan1YMidpoint+((this->height()/4)*this->peakVector.at(i)*scaleFactor));
-                painter.drawLine(counter, chan1YMidpoint, counter, chan1YMidpoint -((this->height()/4)*this->peakVector.at(i)*scaleFactor));
+/*
+    Runs on the worker thread.
+*/
+void WaveformWidget::load()
+{
+    this->srcAudioFile->loadFile();
+}
 
-                painter.drawLine(counter, chan2YMidpoint, counter, chan2YMidpoint+((this->height()/4)*this->peakVector.at(i+1)*scaleFactor)   );
-                painter.drawLine(counter, chan2YMidpoint, counter, chan2YMidpoint -((this->height()/4)*this->peakVector.at(i+1)*scaleFactor)   );
+/*
+    Blocks until a running load has finished, so that the AudioUtil instance can be used again.
+*/
+void WaveformWidget::waitForLoad()
+{
+    this->loadWatcher->waitForFinished();
+    if(this->loading)
+    {
+        this->loadFinished();
+    }
+}
 
-                counter++;
-            }
+/*
+    Takes the exact peaks of the columns the load has passed into the sketch.
+*/
+void WaveformWidget::loadProgress()
+{
+    emit peaksChanged();
+    if(this->sketchPeaks.empty())
+    {
+        return;
+    }
 
+    vector<double> exactPeaks;
+    int exactColumns = this->srcAudioFile->loadedPeaks(this->sketchStartFrame, this->sketchEndFrame, this->sketchRect.width(), &exactPeaks);
+    if(exactColumns > this->sketchExactColumns)
+    {
+        int numChannels = this->srcAudioFile->getNumChannels();
+        copy(exactPeaks.begin(), exactPeaks.begin() + exactColumns * numChannels, this->sketchPeaks.begin());
+        this->sketchExactColumns = exactColumns;
+        this->updateSketch();
+        this->update();
     }
+}
 
-    if(srcAudioFile->getNumChannels() == 1)
+/*
+    The file is loaded: the sketch gives way to the exact waveform.
+*/
+void WaveformWidget::loadFinished()
+{
+    if(!this->loading)
     {
-           int curIndex = minX;
-           int yMidpoint = this->height()/2;
+        return;
+    }
+    this->loading = false;
+    this->loadProgressTimer->stop();
+    this->invalidateBackground();
 
+    /* The sketch stands in for the waveform until the scheduler has drawn it. */
+    if(!this->sketchLayer.isNull())
+    {
+        this->interimLayer = this->sketchLayer;
+        this->interimRect = this->sketchRect;
+        this->interimWidth = this->sketchWidth;
+    }
+    this->sketchPeaks.clear();
+    this->sketchLayer = QImage();
+    this->update();
+    emit peaksChanged();
+}
 
-           for(unsigned int i = 0; i < peakVector.size(); i++)
-           {
-               painter.drawLine(curIndex, yMidpoint, curIndex, yMidpoint+((this->height()/4)*this->peakVector.at(i)*scaleFactor)   );
-               painter.drawLine(curIndex, yMidpoint, curIndex, yMidpoint -((this->height()/4)*this->peakVector.at(i)*scaleFactor)   );
+/*
+    Draws the sketch into its layer.
+*/
+void WaveformWidget::updateSketch()
+{
+    if(this->sketchRect.isEmpty())
+    {
+        this->sketchLayer = QImage();
+        return;
+    }
+    this->sketchLayer = QImage(this->sketchRect.size(), QImage::Format_ARGB32_Premultiplied);
+    this->sketchLayer.fill(0);
 
-               curIndex++;
-           }
+    QPainter painter(&this->sketchLayer);
+    this->renderer->renderSketch(&painter, this->sketchRect.size(), this->sketchPeaks, this->srcAudioFile->getNumChannels(), this->sketchExactColumns);
+    painter.end();
+}
 
+/*
+    Draws the sketch over the exposed columns, stretched if the widget was resized since it was made.
+*/
+void WaveformWidget::drawSketch(QPainter *painter, QRect exposed)
+{
+    if(this->sketchLayer.isNull() || this->width() <= 0)
+    {
+        return;
     }
 
+    double ratio = ((double) this->sketchWidth)/this->width();
+    QRectF source(exposed.x()*ratio - this->sketchRect.x(), 0, exposed.width()*ratio, this->sketchLayer.height());
+    QRectF target(exposed.x(), 0, exposed.width(), this->height());
+    painter->drawImage(target, this->sketchLayer, source);
 }
 
 /*
-This function determines which drawing mode the current instance of WaveformWidget
-should be operating in based on its dimensions and the size of the audio file that it
-visualizes.
+    Blocks until a running refinement has finished, so that the renderer can be used again.
 */
-void WaveformWidget::establishDrawingMode()
+void WaveformWidget::waitForRefinement()
 {
-    int audioFileSize = this->srcAudioFile->getTotalFrames();
+    this->refinementWatcher->waitForFinished();
+}
 
-    if(this->currentDrawingMode == NO_MODE)
+/*
+    Swaps the refined layer in, provided nothing invalidated it in the meantime.  If the widget was
+    resized again, the scheduler draws the layer again at the new size.
+*/
+void WaveformWidget::refinementFinished()
+{
+    if(this->refinedLayer.isNull())
     {
-        if(this->width() < audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
-        {
-            this->currentDrawingMode = OVERVIEW;
-            this->recalculatePeaks();
-        }else
-        {
-            this->currentDrawingMode = MACRO;
-            this->dataVector = this->srcAudioFile->getAllFrames();
-        }
+        return;
     }
 
-    if(this->currentDrawingMode != MACRO && this->width() >= audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
+    if(this->refinedGeneration == this->backgroundGeneration && this->refinedSize == this->size())
+    {
+        this->backgroundLayer = this->refinedLayer;
+        this->backgroundRect = this->refinedRect;
+        this->backgroundValid = true;
+        this->interimLayer = QImage();
+    }
+    else if(!this->interimLayer.isNull())
     {
-        this->currentDrawingMode = MACRO;
-        this->dataVector = this->srcAudioFile->getAllFrames();
+        /* The widget was zoomed again: the refined layer is still a closer stand-in than the old one. */
+        this->interimLayer = this->refinedLayer;
+        this->interimRect = this->refinedRect;
+        this->interimWidth = this->refinedSize.width();
     }
 
-    if(this->currentDrawingMode == MACRO && this->width() < audioFileSize/MACRO_MODE_TOGGLE_CONSTANT)
+    this->refinedLayer = QImage();
+    this->update();
+    this->scheduleRender();
+}
+
+/*
+    A spectrogram tile was computed on a worker thread.  Redrawing the layer draws it from the cache.
+*/
+void WaveformWidget::spectrogramTileReady()
+{
+    if(this->renderer->getViewMode() == WaveformRenderer::SPECTROGRAM_VIEW)
     {
-        this->currentDrawingMode = OVERVIEW;
+        this->invalidateBackground();
+        this->update();
     }
+}
 
-    if(this->size()!=this->lastSize && this->currentDrawingMode != MACRO)
+/*
+    Draws the selection, the markers and the playhead over the part of the widget in exposed.
+*/
+void WaveformWidget::drawOverlay(QPainter *painter, QRect exposed)
+{
+    if(this->selectionEnd > this->selectionStart)
     {
-        this->recalculatePeaks();
+        int x1 = this->frameToX(this->selectionStart);
+        int x2 = this->frameToX(this->selectionEnd);
+        QRect selection = QRect(x1, 0, max(1, x2 - x1), this->height()).intersected(exposed);
+        if(!selection.isEmpty())
+        {
+            painter->fillRect(selection, this->selectionColor);
+        }
     }
 
-    this->lastSize = this->size();
+    painter->setPen(QPen(this->markerColor, 1));
+    for(size_t i = 0; i < this->markers.size(); i++)
+    {
+        int x = this->frameToX(this->markers[i]);
+        if(x >= exposed.left() && x <= exposed.right())
+        {
+            painter->drawLine(x, 0, x, this->height());
+        }
+    }
 
+    if(this->playheadFrame >= 0)
+    {
+        int x = this->frameToX(this->playheadFrame);
+        if(x >= exposed.left() && x <= exposed.right())
+        {
+            painter->setPen(QPen(this->playheadColor, 1));
+            painter->drawLine(x, 0, x, this->height());
+        }
+    }
 }
 
-
-/*!
-    \brief Mutator for waveform color.
-
-    @param The desired color for the waveform visualization.
+/*
+    The column of the widget at which the given frame is drawn.
 */
-void WaveformWidget::setColor(QColor color)
+int WaveformWidget::frameToX(sf_count_t frame)
 {
-    this->waveformColor = color;
+    sf_count_t totalFrames = this->srcAudioFile->getTotalFrames();
+    if(totalFrames <= 0)
+    {
+        return 0;
+    }
+    return (int) (((double) frame) * this->width() / totalFrames);
 }
 
-
-void WaveformWidget::resizeEvent(QResizeEvent *)
+/*
+    The frame under column x.
+*/
+sf_count_t WaveformWidget::xToFrame(int x)
 {
+    if(this->width() <= 0)
+    {
+        return 0;
+    }
+    return (sf_count_t) (((double) x) * this->srcAudioFile->getTotalFrames() / this->width());
+}
 
+/*
+    Schedules a repaint of the columns between x1 and x2, inclusive, with a column to spare on
+    either side.
+*/
+void WaveformWidget::updateColumns(int x1, int x2)
+{
+    if(x2 < x1)
+    {
+        swap(x1, x2);
+    }
+    this->update(QRect(x1 - 1, 0, x2 - x1 + 3, this->height()));
 }
 
@@ -3,6 +3,8 @@
 
 #include "AudioUtil.h"
 #include "MathUtil.h"
+#include "PerfStats.h"
+#include "WaveformRenderer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,7 +20,18 @@
 #include <QPaintEvent>
 #include <QDebug>
 #include <QPoint>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 #include <QResizeEvent>
+#include <QMoveEvent>
+#include <QScrollArea>
+#include <QScrollBar>
+#include <QTimer>
+#include <QElapsedTimer>
 
 /*!
     \file WaveformWidget.h
@@ -27,44 +40,167 @@
 
 using namespace std;
 
+#define DEFAULT_PLAYHEAD_COLOR QColor(Qt::red)
+#define DEFAULT_SELECTION_COLOR QColor(0, 0, 255, 48)
+#define DEFAULT_MARKER_COLOR QColor(Qt::darkGray)
+/*!
+\brief Interval, in milliseconds, at which the sketch shown while a file loads takes in the exact peaks read so far.
+*/
+#define LOAD_PROGRESS_INTERVAL 100
+/*!
+\brief Interval, in milliseconds, between two frames of the render scheduler: the frame interval of a 60 Hz display.
+*/
+#define RENDER_FRAME_INTERVAL 16
+/*!
+\brief Time, in milliseconds, the render scheduler may spend drawing on the GUI thread in one frame.
+*/
+#define RENDER_FRAME_BUDGET 8
+/*!
+\brief Width, in columns, of the strips the render scheduler draws the waveform in.
+*/
+#define RENDER_STRIP_WIDTH 32
+
 /*!
 \brief A Qt widget to display the waveform of an audio file.
 
+The waveform is drawn once into a cached background layer.  A playhead, a selection and markers are drawn on top
+of it as an overlay; changing them only repaints the few columns that changed, copied from the cached layer, so a
+playhead can be moved at display rate without redrawing the waveform.
+
+The layer is never drawn while the widget paints.  A render scheduler redraws it once per frame at most, for the
+geometry at that time, so a storm of resizes or zoom steps costs one redraw per frame rather than one per step.
+Until the new layer is complete, the previous one stands in for it, stretched if the widget was resized.  When the
+waveform can be drawn a part at a time, the scheduler draws it in strips of RENDER_STRIP_WIDTH columns, the visible
+ones first, and stops for the frame once RENDER_FRAME_BUDGET milliseconds are spent.  When the renderer has to go
+through the whole file first (the peaks of a new width in overview mode), the layer is drawn on a worker thread and
+swapped in when it is ready.  Either way, painting the widget only copies images.
+
+A file is not loaded when it is set: only its header is read.  The first paint draws a sketch of the waveform from
+a sparse sample of the file (see AudioUtil::approximatePeaks()), drawn translucent, and starts loading the file on
+a worker thread.  While it loads, the sketch is replaced, from the left, by exact peaks as the pass reaches them,
+and the exact waveform is drawn once it is done.
+
+The widget can show a spectrogram instead of the waveform (setViewMode()).  Its tiles are computed on worker
+threads as they come into view, and the layer is redrawn as each one arrives.
 
+To zoom, make the widget wider than its QScrollArea.  getVisibleFrames() tells which part of the file is in view,
+and scrollToFrame() moves the view.  The viewChanged() signal is emitted whenever the view may have moved, and
+peaksChanged() whenever more of the file's peaks are known.  A WaveformOverviewWidget uses them to show the whole
+file next to the zoomed view.
 */
 class WaveformWidget : public QWidget
 {
+    Q_OBJECT
 public:
     WaveformWidget(string filePath);
     ~WaveformWidget();
     void resetFile(string fileName);
-    enum FileHandlingMode {FULL_CACHE, DISK_MODE};
+    bool setEdits(EditList edits);
+    enum FileHandlingMode {FULL_CACHE, DISK_MODE, COMPRESSED_CACHE};
     void setColor(QColor color);
+    void setEnvelopeMode(WaveformRenderer::EnvelopeMode mode);
+    WaveformRenderer::EnvelopeMode getEnvelopeMode();
+    void setEnvelopeColor(QColor color);
+    void setViewMode(WaveformRenderer::ViewMode mode);
+    WaveformRenderer::ViewMode getViewMode();
+    void setFFTSize(int size);
     void setFileHandlingMode(FileHandlingMode mode);
     FileHandlingMode getFileHandlingMode();
+    size_t getCacheBytes();
+    void setPlayheadPosition(sf_count_t frame);
+    sf_count_t getPlayheadPosition();
+    void setSelection(sf_count_t startFrame, sf_count_t endFrame);
+    void clearSelection();
+    sf_count_t getSelectionStart();
+    sf_count_t getSelectionEnd();
+    void addMarker(sf_count_t frame);
+    void clearMarkers();
+    vector<sf_count_t> getMarkers();
+    void setPlayheadColor(QColor color);
+    void setSelectionColor(QColor color);
+    void setMarkerColor(QColor color);
+    AudioUtil *getAudioUtil();
+    bool isLoading();
+    void getVisibleFrames(sf_count_t *startFrame, sf_count_t *endFrame);
+    void scrollToFrame(sf_count_t frame);
+
+signals:
+    /*! \brief The part of the file in view may have changed: the widget was scrolled, resized or set to a new file. */
+    void viewChanged();
+    /*! \brief More of the peaks of the file are known, or the file was replaced. */
+    void peaksChanged();
 
 protected:
-    virtual void resizeEvent(QResizeEvent *);
+    virtual void resizeEvent(QResizeEvent *event);
+    virtual void moveEvent(QMoveEvent *event);
     virtual void paintEvent( QPaintEvent * event );
 
 private:
     AudioUtil *srcAudioFile;
-    enum DrawingMode {OVERVIEW, MACRO, NO_MODE};
-    DrawingMode currentDrawingMode;
+    WaveformRenderer *renderer;
     FileHandlingMode currentFileHandlingMode;
-    vector<double> peakVector;
-    vector<double> dataVector;
     string audioFilePath;
-    double max_peak;
-    double padding;
-    QSize lastSize;
-    QColor waveformColor;
-
-    double scaleFactor;
-    void recalculatePeaks();
-    void establishDrawingMode();
-    void macroDraw(QPaintEvent* event);
-    void overviewDraw(QPaintEvent* event);
+    QImage backgroundLayer;
+    QRect backgroundRect;
+    bool backgroundValid;
+    QImage interimLayer;
+    QRect interimRect;
+    QFutureWatcher<void> *loadWatcher;
+    QTimer *loadProgressTimer;
+    bool loadPending;
+    bool loading;
+    vector<double> sketchPeaks;
+    int sketchExactColumns;
+    QImage sketchLayer;
+    QRect sketchRect;
+    int sketchWidth;
+    sf_count_t sketchStartFrame;
+    sf_count_t sketchEndFrame;
+    int interimWidth;
+    QFutureWatcher<void> *refinementWatcher;
+    QImage refinedLayer;
+    QRect refinedRect;
+    QSize refinedSize;
+    int backgroundGeneration;
+    QTimer *renderTimer;
+    QRect renderExposed;
+    QImage pendingLayer;
+    QRect pendingRect;
+    int pendingGeneration;
+    int pendingLeft;
+    int pendingRight;
+    int refinedGeneration;
+    sf_count_t playheadFrame;
+    sf_count_t selectionStart;
+    sf_count_t selectionEnd;
+    vector<sf_count_t> markers;
+    QColor playheadColor;
+    QColor selectionColor;
+    QColor markerColor;
+
+    void invalidateBackground();
+    QRect backgroundArea(QRect exposed);
+    void scheduleRender();
+    void drawInterim(QPainter *painter, QRect exposed);
+    void startRefinement(QRect area);
+    void refine();
+    void waitForRefinement();
+    void startLoad(QRect exposed);
+    void load();
+    void waitForLoad();
+    void updateSketch();
+    void drawSketch(QPainter *painter, QRect exposed);
+    void drawOverlay(QPainter *painter, QRect exposed);
+    int frameToX(sf_count_t frame);
+    sf_count_t xToFrame(int x);
+    void updateColumns(int x1, int x2);
+
+private slots:
+    void renderFrame();
+    void refinementFinished();
+    void spectrogramTileReady();
+    void loadProgress();
+    void loadFinished();
 };
 
 #endif // WAVEFORMWIDGET_H
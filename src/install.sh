@@ -3,3 +3,23 @@ cp build/* /usr/lib/
 cp AudioUtil.h /usr/include/
 cp WaveformWidget.h /usr/include/
 cp MathUtil.h /usr/include/
+cp PerfStats.h /usr/include/
+cp WaveformRenderer.h /usr/include/
+cp SeekIndex.h /usr/include/
+cp ChunkedSampleBuffer.h /usr/include/
+cp CompressedSampleBuffer.h /usr/include/
+cp KWeightingFilter.h /usr/include/
+cp SpectrogramTileCache.h /usr/include/
+cp WaveformListWidget.h /usr/include/
+cp SampleKernels.h /usr/include/
+cp SampleRing.h /usr/include/
+cp LiveAudioSource.h /usr/include/
+cp LiveWaveformWidget.h /usr/include/
+cp PeakCodes.h /usr/include/
+cp MemoryAccount.h /usr/include/
+cp EventIndex.h /usr/include/
+cp AudioSource.h /usr/include/
+cp AudioProbe.h /usr/include/
+cp WaveformOverviewWidget.h /usr/include/
+cp EditList.h /usr/include/
+cp FileReadHints.h /usr/include/
@@ -3,3 +3,23 @@ rm /usr/lib/libwaveformwidget.so*
 rm /usr/include/MathUtil.h 
 rm /usr/include/AudioUtil.h 
 rm /usr/include/WaveformWidget.h
+rm /usr/include/PerfStats.h
+rm /usr/include/WaveformRenderer.h
+rm /usr/include/SeekIndex.h
+rm /usr/include/ChunkedSampleBuffer.h
+rm /usr/include/CompressedSampleBuffer.h
+rm /usr/include/KWeightingFilter.h
+rm /usr/include/SpectrogramTileCache.h
+rm /usr/include/WaveformListWidget.h
+rm /usr/include/SampleKernels.h
+rm /usr/include/SampleRing.h
+rm /usr/include/LiveAudioSource.h
+rm /usr/include/LiveWaveformWidget.h
+rm /usr/include/PeakCodes.h
+rm /usr/include/MemoryAccount.h
+rm /usr/include/EventIndex.h
+rm /usr/include/AudioSource.h
+rm /usr/include/AudioProbe.h
+rm /usr/include/WaveformOverviewWidget.h
+rm /usr/include/EditList.h
+rm /usr/include/FileReadHints.h